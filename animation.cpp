@@ -0,0 +1,145 @@
+﻿#include "animation.hpp"
+
+#include <algorithm>
+
+namespace TVOS
+{
+	int32_t Ease(EasingType Easing, int32_t Progress)
+	{
+		int64_t t = std::clamp(Progress, 0, AnimationOne);
+		switch (Easing)
+		{
+		case EasingType::Linear:
+			return int32_t(t);
+		case EasingType::EaseOut:
+			// 1 - (1 - t)^2 = t * (2 - t)
+			return int32_t((t * (2 * AnimationOne - t)) >> 16);
+		case EasingType::EaseInOut:
+			// t^2 * (3 - 2t)
+			return int32_t((((t * t) >> 16) * (3 * AnimationOne - 2 * t)) >> 16);
+		}
+		return int32_t(t);
+	}
+
+	UIAnimation::~UIAnimation()
+	{
+		Stop();
+	}
+
+	void UIAnimation::Start(UIAnimationScheduler& Scheduler, int From, int To, Clock::duration Duration)
+	{
+		this->From = From;
+		this->To = To;
+		this->Value = From;
+		this->Duration = Duration;
+		StartTime = Clock::now();
+		if (this->Scheduler != &Scheduler)
+		{
+			Stop();
+			this->Scheduler = &Scheduler;
+			Scheduler.Add(*this);
+		}
+	}
+
+	void UIAnimation::Stop()
+	{
+		if (!Scheduler) return;
+		Scheduler->Remove(*this);
+		Scheduler = nullptr;
+	}
+
+	bool UIAnimation::IsActive() const
+	{
+		return Scheduler != nullptr;
+	}
+
+	int UIAnimation::GetValue() const
+	{
+		return Value;
+	}
+
+	int UIAnimation::GetTarget() const
+	{
+		return To;
+	}
+
+	bool UIAnimation::Step(Clock::time_point Now)
+	{
+		auto Elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Now - StartTime).count();
+		auto Total = std::chrono::duration_cast<std::chrono::microseconds>(Duration).count();
+		int32_t Progress = AnimationOne;
+		if (Elapsed < 0) Progress = 0;
+		else if (Total > 0 && Elapsed < Total) Progress = int32_t((int64_t(Elapsed) << 16) / Total);
+
+		auto OldValue = Value;
+		Value = From + int((int64_t(To - From) * Ease(Easing, Progress)) >> 16);
+		if (Progress >= AnimationOne)
+		{
+			Value = To;
+			Stop();
+		}
+		if (Value == OldValue) return false;
+		if (OnUpdate) OnUpdate(Value);
+		return true;
+	}
+
+	UIAnimationScheduler::UIAnimationScheduler(int RefreshRate) :
+		FrameInterval(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / (RefreshRate > 0 ? RefreshRate : 60))
+	{
+	}
+
+	void UIAnimationScheduler::Add(UIAnimation& Animation)
+	{
+		if (Active.empty()) NextFrame = Clock::now() + FrameInterval;
+		Active.push_back(&Animation);
+	}
+
+	void UIAnimationScheduler::Remove(UIAnimation& Animation)
+	{
+		Active.erase(std::remove(Active.begin(), Active.end(), &Animation), Active.end());
+	}
+
+	bool UIAnimationScheduler::IsIdle() const
+	{
+		return Active.empty();
+	}
+
+	size_t UIAnimationScheduler::GetActiveCount() const
+	{
+		return Active.size();
+	}
+
+	UIAnimationScheduler::Clock::duration UIAnimationScheduler::GetFrameInterval() const
+	{
+		return FrameInterval;
+	}
+
+	bool UIAnimationScheduler::Tick(Clock::time_point Now)
+	{
+		if (Active.empty() || Now < NextFrame) return false;
+
+		// 落后超过一帧时不补帧，从现在开始重新计时
+		NextFrame += FrameInterval;
+		if (NextFrame <= Now) NextFrame = Now + FrameInterval;
+
+		// 动画结束时会从 `Active` 中移除自己，所以先复制一份
+		bool Changed = false;
+		auto Animations = Active;
+		for (auto Animation : Animations)
+		{
+			if (std::find(Active.begin(), Active.end(), Animation) == Active.end()) continue;
+			if (Animation->Step(Now)) Changed = true;
+		}
+		return Changed;
+	}
+
+	bool UIAnimationScheduler::Tick()
+	{
+		return Tick(Clock::now());
+	}
+
+	UIAnimationScheduler::Clock::time_point UIAnimationScheduler::GetNextFrameTime() const
+	{
+		return Active.empty() ? Clock::time_point::max() : NextFrame;
+	}
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace TVOS
+{
+	// 定点数表示的进度，0 到 `AnimationOne` 对应 0 到 1
+	constexpr int32_t AnimationOne = 65536;
+
+	enum class EasingType
+	{
+		Linear,
+		EaseOut, // 开始快，结束慢，适合跟随按键的滚动
+		EaseInOut,
+	};
+
+	// 按缓动曲线映射进度，输入输出都是 0 到 `AnimationOne` 的定点数，只用整数运算
+	int32_t Ease(EasingType Easing, int32_t Progress);
+
+	class UIAnimationScheduler;
+
+	// 一个整数属性的动画，例如滚动位置。每一帧由调度器推进，通过 `OnUpdate` 把新的值写回属性。
+	// 动画对象由使用者持有，析构时自动从调度器中移除。
+	class UIAnimation
+	{
+		friend class UIAnimationScheduler;
+
+	public:
+		using Clock = std::chrono::steady_clock;
+
+	protected:
+		UIAnimationScheduler* Scheduler = nullptr;
+		int From = 0;
+		int To = 0;
+		int Value = 0;
+		Clock::time_point StartTime;
+		Clock::duration Duration = std::chrono::milliseconds(150);
+
+		// 推进到 Now，返回值是否变了。到达终点后从调度器中移除。
+		bool Step(Clock::time_point Now);
+
+	public:
+		UIAnimation() = default;
+		~UIAnimation();
+		UIAnimation(const UIAnimation&) = delete;
+		UIAnimation& operator = (const UIAnimation&) = delete;
+
+		EasingType Easing = EasingType::EaseOut;
+		std::function<void(int Value)> OnUpdate;
+
+		// 从 From 动画到 To。动画进行中再次开始时，传入当前值作为 From 就能平滑地改变目标。
+		void Start(UIAnimationScheduler& Scheduler, int From, int To, Clock::duration Duration);
+		void Stop(); // 停在当前值，不再调用 `OnUpdate`
+		bool IsActive() const;
+		int GetValue() const;
+		int GetTarget() const;
+	};
+
+	// 按屏幕刷新率推进动画的调度器。没有动画时不要求任何唤醒，主循环按原来的节奏等待输入即可。
+	class UIAnimationScheduler
+	{
+		friend class UIAnimation;
+
+	public:
+		using Clock = UIAnimation::Clock;
+
+	protected:
+		std::vector<UIAnimation*> Active;
+		Clock::duration FrameInterval;
+		Clock::time_point NextFrame;
+
+		void Add(UIAnimation& Animation);
+		void Remove(UIAnimation& Animation);
+
+	public:
+		UIAnimationScheduler(int RefreshRate = 60);
+
+		bool IsIdle() const;
+		size_t GetActiveCount() const;
+		Clock::duration GetFrameInterval() const;
+
+		// 推进所有到了帧时刻的动画，返回是否有属性发生了变化
+		bool Tick(Clock::time_point Now);
+		bool Tick();
+
+		// 下一帧的时刻，空闲时为 `Clock::time_point::max()`
+		Clock::time_point GetNextFrameTime() const;
+	};
+}
@@ -0,0 +1,267 @@
+// 界面布局与绘制的性能测试，用合成的组件树测量实际会执行的操作，结果以 JSON 输出，便于比较。
+// 用法：bench_gui [重复次数]
+
+#include "../gui.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace TVOS;
+
+static const int ScreenWidth = 480;
+static const int ScreenHeight = 272;
+
+static const char* Captions[] =
+{
+	"A5-MiniTV 小电视 第01集.avi",
+	"[字幕组] 动画片 - 12 [1080p].avi",
+	"周杰伦 - 晴天 (Live).avi",
+	"my_holiday_video_2023_08_20_final_v2.avi",
+	"纪录片：中国的世界文化遗产（上）.avi",
+	"音乐会 Concert 2019 - Part 3.avi",
+};
+
+static std::string GetCaption(size_t Index)
+{
+	return std::to_string(Index) + " " + Captions[Index % (sizeof Captions / sizeof Captions[0])];
+}
+
+// 一棵合成的组件树。`Build()` 在重置过的竞技场里建立组件，`Label` 是修改标题时使用的组件。
+struct BenchTree
+{
+	std::string Name;
+	size_t Items = 0;
+	std::function<void(BenchTree& Tree)> Build;
+
+	UIElementArena* Arena = nullptr;
+	UIHandle<UIElementBase> Root;
+	UIHandle<UIElementLabel> Label;
+	UIHandle<UIElementListView> ListView;
+
+	BenchTree(std::string Name, size_t Items, std::function<void(BenchTree& Tree)> Build) :
+		Name(std::move(Name)),
+		Items(Items),
+		Build(std::move(Build))
+	{
+	}
+
+	void Rebuild()
+	{
+		Arena->Reset();
+		Root = Arena->Create<UIElementBase>("root");
+		Root->XMargin = Root->YMargin = Root->XBorder = Root->YBorder = 2;
+		Root->FillColor = 0;
+		Root->BorderColor = 0xFFFFFFFF;
+		Root->ExpandToParentX = Root->ExpandToParentY = true;
+		Label = UIHandle<UIElementLabel>();
+		ListView = UIHandle<UIElementListView>();
+		Build(*this);
+	}
+};
+
+static UIHandle<UIElementLabel> AddLabel(UIElementArena& Arena, UIElementBase& Parent, const std::string& Name, const std::string& Caption)
+{
+	auto Label = Arena.Create<UIElementLabel>(Name);
+	Parent.InsertElement(*Label);
+	Label->XPadding = Label->YPadding = 1;
+	Label->FillColor = 0xFF000000;
+	Label->SetCaption(Caption);
+	return Label;
+}
+
+// 逐层嵌套的容器，最里面是一个标签
+static void BuildDeep(BenchTree& Tree)
+{
+	auto& Arena = *Tree.Arena;
+	UIElementBase* Parent = Tree.Root.get();
+	for (size_t i = 0; i < Tree.Items; i++)
+	{
+		auto Sub = Arena.Create<UIElementBase>("box" + std::to_string(i));
+		Parent->InsertElement(*Sub);
+		Sub->XPadding = Sub->YPadding = 1;
+		Sub->XBorder = Sub->YBorder = 1;
+		Sub->FillColor = (i & 1) ? 0xFF202020 : 0xFF404040;
+		Sub->BorderColor = 0xFFC0C0C0;
+		Sub->ExpandToParentX = true;
+		Parent = Sub.get();
+	}
+	Tree.Label = AddLabel(Arena, *Parent, "label", GetCaption(0));
+}
+
+// 一行排不下就换行的大量标签
+static void BuildWide(BenchTree& Tree)
+{
+	auto& Arena = *Tree.Arena;
+	for (size_t i = 0; i < Tree.Items; i++)
+	{
+		auto Label = AddLabel(Arena, *Tree.Root, "label" + std::to_string(i), GetCaption(i));
+		if (!i) Tree.Label = Label;
+	}
+}
+
+// 与 `main.cpp` 相同的标题加列表框
+static void BuildList(BenchTree& Tree)
+{
+	auto& Arena = *Tree.Arena;
+	Tree.Label = AddLabel(Arena, *Tree.Root, "Title", "请选择要播放的曲目");
+	Tree.Label->ExpandToParentX = true;
+	Tree.Label->YBorder = 1;
+	Tree.Label->Alignment = AlignmentType::CenterTop;
+
+	auto ListView = Arena.Create<UIElementListView>("ListView");
+	Tree.Root->InsertElement(*ListView);
+	ListView->XMargin = ListView->YMargin = 10;
+	ListView->XBorder = ListView->YBorder = 1;
+	ListView->XPadding = ListView->YPadding = 1;
+	ListView->BorderColor = 0xFFC0C0C0;
+	ListView->ExpandToParentX = ListView->ExpandToParentY = true;
+	ListView->Transparent = true;
+	for (size_t i = 0; i < Tree.Items; i++)
+	{
+		ListView->AddItem(std::to_string(i), GetCaption(i));
+	}
+	Tree.ListView = ListView;
+}
+
+struct BenchResult
+{
+	std::string Tree;
+	size_t Items;
+	const char* Operation;
+	int Iterations;
+	double MeanUs;
+	double MinUs;
+	double MaxUs;
+	uint64_t PixelsWritten; // 每次操作的平均值
+};
+
+static std::vector<BenchResult> Results;
+
+// 每次先执行不计时的 `Prepare`，再计时执行 `Run`
+static void Measure(Graphics& FB, BenchTree& Tree, const char* Operation, int Repeat, const std::function<void()>& Prepare, const std::function<void()>& Run)
+{
+	double Total = 0, Min = 1e30, Max = 0;
+	uint64_t PixelsWritten = 0;
+	for (int r = 0; r < Repeat; r++)
+	{
+		if (Prepare) Prepare();
+		auto Pixels = FB.PixelsWritten;
+		auto Start = std::chrono::steady_clock::now();
+		Run();
+		auto Elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Start).count();
+		PixelsWritten += FB.PixelsWritten - Pixels;
+		Total += Elapsed;
+		Min = std::min(Min, Elapsed);
+		Max = std::max(Max, Elapsed);
+	}
+	Results.push_back({ Tree.Name, Tree.Items, Operation, Repeat, Total / Repeat, Min, Max, PixelsWritten / uint64_t(Repeat) });
+}
+
+static void RunTree(Graphics& FB, BenchTree& Tree, int Repeat)
+{
+	// 首次布局：每次都重建组件树，只计布局的时间
+	Measure(FB, Tree, "first_layout", Repeat, [&]()
+	{
+		Tree.Rebuild();
+	}, [&]()
+	{
+		Tree.Root->RearrangeElementsAsRoot();
+	});
+
+	Tree.Rebuild();
+	Tree.Root->RearrangeElementsAsRoot();
+	Tree.Root->Render();
+
+	// 修改一个标签的标题后重新布局，没有失效的组件使用缓存的测量结果
+	size_t Counter = 0;
+	Measure(FB, Tree, "relayout_caption", Repeat, nullptr, [&]()
+	{
+		Tree.Label->SetCaption(GetCaption(++Counter));
+		Tree.Root->RearrangeElementsAsRoot();
+	});
+
+	// 整个屏幕被破坏后的完整重绘
+	Measure(FB, Tree, "full_render", Repeat, [&]()
+	{
+		Tree.Root->InvalidateScreen();
+	}, [&]()
+	{
+		Tree.Root->Render();
+	});
+
+	if (!Tree.ListView) return;
+
+	// 按一次下键：改变选择并局部重绘
+	Tree.ListView->SelectByIndex(0);
+	Tree.Root->Render();
+	Measure(FB, Tree, "select_next", Repeat, nullptr, [&]()
+	{
+		Tree.ListView->SelectNext();
+		Tree.Root->Render();
+	});
+
+	// 插拔 SD 卡后重新填充列表并绘制
+	Measure(FB, Tree, "relist", Repeat, nullptr, [&]()
+	{
+		Tree.ListView->ClearItems();
+		for (size_t i = 0; i < Tree.Items; i++)
+		{
+			Tree.ListView->AddItem(std::to_string(i), GetCaption(i + Counter));
+		}
+		Tree.ListView->SelectByIndex(0);
+		Tree.Root->Render();
+		Counter++;
+	});
+}
+
+static std::string JsonString(const std::string& s)
+{
+	std::string ret = "\"";
+	for (auto ch : s)
+	{
+		if (ch == '"' || ch == '\\') ret += '\\';
+		ret += ch;
+	}
+	return ret + "\"";
+}
+
+int main(int argc, char** argv)
+{
+	int Repeat = argc > 1 ? atoi(argv[1]) : 20;
+	if (Repeat < 1) Repeat = 1;
+
+	auto FB = Graphics(nullptr, ScreenWidth, ScreenHeight, false);
+	UIElementArena Arena(FB);
+
+	std::vector<BenchTree> Trees;
+	for (size_t Depth : { 8, 32, 64 }) Trees.push_back({ "deep", Depth, BuildDeep });
+	for (size_t Count : { 16, 128 }) Trees.push_back({ "wide", Count, BuildWide });
+	for (size_t Count : { 10, 100, 1000, 10000 }) Trees.push_back({ "list", Count, BuildList });
+
+	for (auto& Tree : Trees)
+	{
+		Tree.Arena = &Arena;
+		RunTree(FB, Tree, Repeat);
+	}
+
+	printf("{\n");
+	printf("  \"benchmark\": \"gui\",\n");
+	printf("  \"screen\": [%d, %d],\n", ScreenWidth, ScreenHeight);
+	printf("  \"repeat\": %d,\n", Repeat);
+	printf("  \"results\": [\n");
+	for (size_t i = 0; i < Results.size(); i++)
+	{
+		auto& r = Results[i];
+		printf("    {\"tree\": %s, \"items\": %zu, \"op\": %s, \"iterations\": %d, \"mean_us\": %.2f, \"min_us\": %.2f, \"max_us\": %.2f, \"pixels_written\": %llu}%s\n",
+			JsonString(r.Tree).c_str(), r.Items, JsonString(r.Operation).c_str(), r.Iterations, r.MeanUs, r.MinUs, r.MaxUs, (unsigned long long)r.PixelsWritten,
+			i + 1 < Results.size() ? "," : "");
+	}
+	printf("  ]\n");
+	printf("}\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+// UTF-8 解码吞吐量测试，使用中英文混合的文件名。
+// 用法：bench_utf [重复次数]
+
+#include "../utf.hpp"
+#include "../graphics.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// 改写之前的 `Utf8_to_Utf32()`，每次调用都分配内存，作为对照
+static std::vector<uint32_t> LegacyUtf8_to_Utf32(const std::string& Utf8s)
+{
+	size_t i = 0;
+	std::vector<uint32_t> ret;
+	while (i < Utf8s.length())
+	{
+		auto Lead = uint8_t(Utf8s[i]);
+		if ((Lead & 0xF8) == 0xF0 && i + 4 <= Utf8s.size())
+		{
+			ret.push_back(((uint32_t(Utf8s[i]) & 0x07) << 18) | ((uint32_t(Utf8s[i + 1]) & 0x3F) << 12) | ((uint32_t(Utf8s[i + 2]) & 0x3F) << 6) | (uint32_t(Utf8s[i + 3]) & 0x3F));
+			i += 4;
+		}
+		else if ((Lead & 0xF0) == 0xE0 && i + 3 <= Utf8s.size())
+		{
+			ret.push_back(((uint32_t(Utf8s[i]) & 0x0F) << 12) | ((uint32_t(Utf8s[i + 1]) & 0x3F) << 6) | (uint32_t(Utf8s[i + 2]) & 0x3F));
+			i += 3;
+		}
+		else if ((Lead & 0xE0) == 0xC0 && i + 2 <= Utf8s.size())
+		{
+			ret.push_back(((uint32_t(Utf8s[i]) & 0x1F) << 6) | (uint32_t(Utf8s[i + 1]) & 0x3F));
+			i += 2;
+		}
+		else
+		{
+			ret.push_back(Lead & 0x7F);
+			i++;
+		}
+	}
+	return ret;
+}
+
+static std::vector<std::string> MakeFileNames()
+{
+	static const char* Samples[] =
+	{
+		"A5-MiniTV 小电视 第01集.avi",
+		"[字幕组] 动画片 - 12 [1080p].avi",
+		"周杰伦 - 晴天 (Live).avi",
+		"my_holiday_video_2023_08_20_final_v2.avi",
+		"VID_20240101_120000.avi",
+		"纪录片：中国的世界文化遗产（上）.avi",
+		"Bad Apple!! PV.avi",
+		"音乐会 Concert 2019 - Part 3.avi",
+	};
+	std::vector<std::string> ret;
+	for (int i = 0; i < 64; i++)
+	{
+		for (auto Sample : Samples)
+		{
+			ret.push_back(std::to_string(i) + " " + Sample);
+		}
+	}
+	return ret;
+}
+
+template<typename FuncType>
+static void Measure(const char* Name, const std::vector<std::string>& FileNames, int Repeat, FuncType&& Func)
+{
+	size_t Bytes = 0;
+	for (auto& s : FileNames) Bytes += s.size();
+
+	uint32_t Sink = 0;
+	auto Start = std::chrono::steady_clock::now();
+	for (int r = 0; r < Repeat; r++)
+	{
+		for (auto& s : FileNames) Sink += Func(s);
+	}
+	auto Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	double Strings = double(FileNames.size()) * Repeat;
+	printf("%-28s %9.2f MB/s %9.1f ns/string (checksum %08x)\n", Name, double(Bytes) * Repeat / Elapsed / 1e6, Elapsed * 1e9 / Strings, Sink);
+}
+
+int main(int argc, char** argv)
+{
+	int Repeat = argc > 1 ? atoi(argv[1]) : 200;
+	auto FileNames = MakeFileNames();
+
+	Measure("legacy Utf8_to_Utf32", FileNames, Repeat, [](const std::string& s)
+	{
+		uint32_t Sum = 0;
+		for (auto ch : LegacyUtf8_to_Utf32(s)) Sum += ch;
+		return Sum;
+	});
+
+	Measure("Utf8_to_Utf32", FileNames, Repeat, [](const std::string& s)
+	{
+		uint32_t Sum = 0;
+		for (auto ch : UTF::Utf8_to_Utf32(s)) Sum += ch;
+		return Sum;
+	});
+
+	Measure("Utf8Decoder", FileNames, Repeat, [](const std::string& s)
+	{
+		uint32_t Sum = 0;
+		for (auto ch : UTF::Utf8Decoder(s)) Sum += ch;
+		return Sum;
+	});
+
+	auto FB = TVOS::Graphics(nullptr, 480, 272, false);
+	Measure("Graphics::GetTextMetrics", FileNames, Repeat, [&FB](const std::string& s)
+	{
+		int w, h;
+		FB.GetTextMetrics(s, w, h);
+		return uint32_t(w + h);
+	});
+	return 0;
+}
@@ -0,0 +1,260 @@
+﻿#include "childproc.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+extern char** environ;
+#else
+#include <Windows.h>
+#endif
+
+namespace TVOS
+{
+#if !defined(_MSC_VER)
+	static int OpenPidFD(pid_t Pid)
+	{
+#if defined(SYS_pidfd_open)
+		return int(syscall(SYS_pidfd_open, Pid, 0));
+#else
+		(void)Pid;
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+#endif
+
+	ChildProcessManager::ChildProcessManager(EventLoop& Loop) :
+		Loop(Loop)
+	{
+#if !defined(_MSC_VER)
+		// 内核 5.3 以前没有 pidfd，用自己的 pid 试一下
+		int fd = OpenPidFD(getpid());
+		if (fd != -1)
+		{
+			close(fd);
+			UsePidFD = true;
+		}
+		// SIGCHLD 总要接收：没有 pidfd 时靠它回收，有 pidfd 时也让主循环醒来处理子进程退出
+		Loop.AddSignal(SIGCHLD, [this](int) { ReapAll(); });
+#endif
+	}
+
+	ChildProcessManager::~ChildProcessManager()
+	{
+		while (!Children.empty())
+		{
+			auto Pid = Children.begin()->first;
+#if !defined(_MSC_VER)
+			kill(Pid, SIGKILL);
+			int Status;
+			waitpid(Pid, &Status, 0);
+#else
+			TerminateProcess(Children.begin()->second.Process, 1);
+#endif
+			Forget(Pid);
+		}
+	}
+
+	pid_t ChildProcessManager::Spawn(const std::string& Command, int StdinFD, int StdoutFD)
+	{
+#if !defined(_MSC_VER)
+		// posix_spawn 不复制父进程的内存，界面进程占用的内存再多也能很快启动
+		posix_spawn_file_actions_t Actions;
+		posix_spawn_file_actions_init(&Actions);
+		if (StdinFD != -1) posix_spawn_file_actions_adddup2(&Actions, StdinFD, STDIN_FILENO);
+		if (StdoutFD != -1) posix_spawn_file_actions_adddup2(&Actions, StdoutFD, STDOUT_FILENO);
+
+		// 主循环为了用 signalfd 屏蔽了一些信号，子进程恢复默认
+		posix_spawnattr_t Attr;
+		posix_spawnattr_init(&Attr);
+		sigset_t Mask;
+		sigemptyset(&Mask);
+		posix_spawnattr_setsigmask(&Attr, &Mask);
+		sigaddset(&Mask, SIGCHLD);
+		sigaddset(&Mask, SIGUSR1);
+		posix_spawnattr_setsigdefault(&Attr, &Mask);
+		posix_spawnattr_setflags(&Attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+		pid_t Pid = -1;
+		const char* Argv[] = { "sh", "-c", Command.c_str(), nullptr };
+		int ret = posix_spawn(&Pid, "/bin/sh", &Actions, &Attr, const_cast<char* const*>(Argv), environ);
+		posix_spawnattr_destroy(&Attr);
+		posix_spawn_file_actions_destroy(&Actions);
+		if (ret != 0)
+		{
+			errno = ret;
+			perror("posix_spawn()");
+			return -1;
+		}
+		Watch(Pid);
+		return Pid;
+#else
+		(void)StdinFD; (void)StdoutFD;
+		PROCESS_INFORMATION ProcInfo;
+		STARTUPINFOA StartupInfo =
+		{
+			sizeof(STARTUPINFOA), NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0,
+			STARTF_USESTDHANDLES,
+			0,
+			0,
+			NULL,
+			GetStdHandle(STD_INPUT_HANDLE),
+			GetStdHandle(STD_OUTPUT_HANDLE),
+			GetStdHandle(STD_ERROR_HANDLE)
+		};
+		if (!CreateProcessA(NULL, const_cast<char*>(Command.c_str()), NULL, NULL, TRUE, 0, 0, NULL, &StartupInfo, &ProcInfo))
+		{
+			std::cerr << "CreateProcessA() failed: " << GetLastError() << "\n";
+			return -1;
+		}
+		CloseHandle(ProcInfo.hThread);
+		auto Pid = pid_t(ProcInfo.dwProcessId);
+		Children[Pid].Process = ProcInfo.hProcess;
+		return Pid;
+#endif
+	}
+
+	bool ChildProcessManager::SpawnPipeline(const std::string& Writer, const std::string& Reader, pid_t& WriterPid, pid_t& ReaderPid)
+	{
+		WriterPid = -1;
+		ReaderPid = -1;
+#if !defined(_MSC_VER)
+		int pipefd[2];
+		if (pipe2(pipefd, O_CLOEXEC) == -1)
+		{
+			perror("pipe2()");
+			return false;
+		}
+		// 管道两端都带 O_CLOEXEC，只有 dup2 到标准输入输出的那一份留给子进程，读端才能在写端退出时读到结束
+		WriterPid = Spawn(Writer, -1, pipefd[1]);
+		if (WriterPid != -1) ReaderPid = Spawn(Reader, pipefd[0], -1);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		if (ReaderPid == -1 && WriterPid != -1)
+		{
+			Stop(WriterPid, Clock::duration::zero());
+			WriterPid = -1;
+		}
+		return ReaderPid != -1;
+#else
+		(void)Writer; (void)Reader;
+		return false;
+#endif
+	}
+
+	void ChildProcessManager::Watch(pid_t Pid)
+	{
+		auto& c = Children[Pid];
+#if !defined(_MSC_VER)
+		if (!UsePidFD) return;
+		c.PidFD = OpenPidFD(Pid);
+		if (c.PidFD == -1) return;
+		fcntl(c.PidFD, F_SETFD, FD_CLOEXEC);
+		Loop.AddFD(c.PidFD, EventLoop::Readable, [this, Pid](uint32_t) { Reap(Pid); });
+#else
+		(void)c;
+#endif
+	}
+
+	bool ChildProcessManager::Reap(pid_t Pid)
+	{
+		if (!Children.count(Pid)) return false;
+		int Status = 0;
+#if !defined(_MSC_VER)
+		auto ret = waitpid(Pid, &Status, WNOHANG);
+		if (ret == 0) return false;
+		if (ret == -1 && errno != ECHILD) return false;
+#else
+		auto Process = Children[Pid].Process;
+		if (WaitForSingleObject(Process, 0) != WAIT_OBJECT_0) return false;
+		DWORD ExitCode = 0;
+		GetExitCodeProcess(Process, &ExitCode);
+		Status = int(ExitCode);
+#endif
+		Forget(Pid);
+		if (OnExit) OnExit(Pid, Status);
+		return true;
+	}
+
+	void ChildProcessManager::ReapAll()
+	{
+		std::vector<pid_t> Pids;
+		for (auto& it : Children) Pids.push_back(it.first);
+		for (auto Pid : Pids) Reap(Pid);
+	}
+
+	void ChildProcessManager::Forget(pid_t Pid)
+	{
+		auto it = Children.find(Pid);
+		if (it == Children.end()) return;
+		if (it->second.Timer) Loop.CancelTimer(it->second.Timer);
+#if !defined(_MSC_VER)
+		if (it->second.PidFD != -1)
+		{
+			Loop.RemoveFD(it->second.PidFD);
+			close(it->second.PidFD);
+		}
+#else
+		CloseHandle(it->second.Process);
+#endif
+		Children.erase(it);
+	}
+
+	bool ChildProcessManager::IsRunning(pid_t Pid) const
+	{
+		return Children.count(Pid) != 0;
+	}
+
+	void ChildProcessManager::Poll()
+	{
+		ReapAll();
+	}
+
+	void ChildProcessManager::Escalate(pid_t Pid, Clock::duration Delay)
+	{
+		auto it = Children.find(Pid);
+		if (it == Children.end()) return;
+		auto& c = it->second;
+		if (c.Stage >= 3) return;
+		c.Stage++;
+#if !defined(_MSC_VER)
+		static const int Signals[] = { SIGINT, SIGTERM, SIGKILL };
+		kill(Pid, Signals[c.Stage - 1]);
+		if (c.Stage < 3)
+		{
+			c.Timer = Loop.AddTimer(Clock::now() + Delay, [this, Pid]()
+			{
+				auto it = Children.find(Pid);
+				if (it == Children.end()) return;
+				it->second.Timer = 0;
+				if (!Reap(Pid)) Escalate(Pid, KillDelay);
+			});
+		}
+#else
+		(void)Delay;
+		TerminateProcess(c.Process, 1);
+		c.Stage = 3;
+#endif
+	}
+
+	void ChildProcessManager::Stop(pid_t Pid, Clock::duration TermDelay)
+	{
+		auto it = Children.find(Pid);
+		if (it == Children.end() || it->second.Stage) return; // 已经在结束了
+		Escalate(Pid, TermDelay);
+	}
+
+	size_t ChildProcessManager::GetChildCount() const
+	{
+		return Children.size();
+	}
+}
@@ -0,0 +1,74 @@
+﻿#pragma once
+#include "eventloop.hpp"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+
+#if defined(_MSC_VER)
+using pid_t = int;
+#else
+#include <sys/types.h>
+#endif
+
+namespace TVOS
+{
+	// 管理播放器等子进程：启动、在主循环中等待退出、回收退出状态、不阻塞地结束。
+	// 每个子进程持有一个 pidfd 放进主循环，退出时立即回收；内核不支持 pidfd 时改为在 SIGCHLD 时检查所有子进程。
+	// 结束子进程时先发 SIGINT，到时还没退出再发 SIGTERM，最后 SIGKILL，全部由定时器完成，不在主线程中等待。
+	class ChildProcessManager
+	{
+	public:
+		using Clock = EventLoop::Clock;
+		using ExitCallback = std::function<void(pid_t Pid, int Status)>; // Status 为 waitpid 的状态
+
+	protected:
+		struct Child
+		{
+			int PidFD = -1;
+			int Stage = 0; // 已经发送的信号：0 没有，1 SIGINT，2 SIGTERM，3 SIGKILL
+			EventLoop::TimerID Timer = 0;
+#if defined(_MSC_VER)
+			void* Process = nullptr;
+#endif
+		};
+		EventLoop& Loop;
+		std::map<pid_t, Child> Children;
+		bool UsePidFD = false;
+
+		void Watch(pid_t Pid);
+		bool Reap(pid_t Pid);
+		void ReapAll();
+		void Escalate(pid_t Pid, Clock::duration Delay);
+		void Forget(pid_t Pid);
+
+	public:
+		ChildProcessManager(EventLoop& Loop);
+		~ChildProcessManager(); // 杀死并回收剩下的子进程
+		ChildProcessManager(const ChildProcessManager&) = delete;
+		ChildProcessManager& operator = (const ChildProcessManager&) = delete;
+
+		Clock::duration KillDelay = std::chrono::milliseconds(1000); // SIGTERM 之后多久发 SIGKILL
+
+		// 子进程退出并被回收后调用
+		ExitCallback OnExit;
+
+		// 用 sh -c 执行 Command，StdinFD、StdoutFD 不为 -1 时重定向，失败时返回 -1
+		pid_t Spawn(const std::string& Command, int StdinFD = -1, int StdoutFD = -1);
+
+		// Writer 的标准输出通过管道连接到 Reader 的标准输入
+		bool SpawnPipeline(const std::string& Writer, const std::string& Reader, pid_t& WriterPid, pid_t& ReaderPid);
+
+		// 还没有退出。已经开始结束但还没退出的也算。
+		bool IsRunning(pid_t Pid) const;
+
+		// 发送 SIGINT 后立即返回，TermDelay 后仍未退出时发 SIGTERM，再过 `KillDelay` 发 SIGKILL
+		void Stop(pid_t Pid, Clock::duration TermDelay = std::chrono::milliseconds(300));
+
+		size_t GetChildCount() const;
+
+		// 检查所有子进程是否退出。Linux 上由主循环自动完成，Windows 上没有可等待的事件，需要定时调用。
+		void Poll();
+	};
+}
@@ -0,0 +1,331 @@
+﻿#include "displaylist.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <unordered_map>
+
+namespace TVOS
+{
+	bool UIRect::IsEmpty() const
+	{
+		return r < x || b < y;
+	}
+
+	bool UIRect::Intersects(const UIRect& other) const
+	{
+		return !Intersect(other).IsEmpty();
+	}
+
+	bool UIRect::Touches(const UIRect& other) const
+	{
+		if (IsEmpty() || other.IsEmpty()) return false;
+		return x <= other.r + 1 && other.x <= r + 1 && y <= other.b + 1 && other.y <= b + 1;
+	}
+
+	UIRect UIRect::Union(const UIRect& other) const
+	{
+		if (IsEmpty()) return other;
+		if (other.IsEmpty()) return *this;
+		return { std::min(x, other.x), std::min(y, other.y), std::max(r, other.r), std::max(b, other.b) };
+	}
+
+	UIRect UIRect::Intersect(const UIRect& other) const
+	{
+		return { std::max(x, other.x), std::max(y, other.y), std::min(r, other.r), std::min(b, other.b) };
+	}
+
+	bool UIRect::operator == (const UIRect& other) const
+	{
+		return x == other.x && y == other.y && r == other.r && b == other.b;
+	}
+
+	bool UIRect::operator != (const UIRect& other) const
+	{
+		return !(*this == other);
+	}
+
+	void AddRectToRegion(std::vector<UIRect>& Region, const UIRect& Rect, size_t MaxRects)
+	{
+		if (Rect.IsEmpty()) return;
+
+		// 与相交或相邻的区域合并，直到不再与任何区域接触
+		auto Merged = Rect;
+		for (size_t i = 0; i < Region.size();)
+		{
+			if (Region[i].Touches(Merged))
+			{
+				Merged = Merged.Union(Region[i]);
+				Region.erase(Region.begin() + i);
+				i = 0;
+			}
+			else i++;
+		}
+		Region.push_back(Merged);
+
+		// 区域太零碎时合并成一个，避免重复执行命令
+		if (Region.size() > MaxRects)
+		{
+			UIRect BoundingBox;
+			for (auto& r : Region) BoundingBox = BoundingBox.Union(r);
+			Region.assign(1, BoundingBox);
+		}
+	}
+
+	UIRect DisplayCommand::GetBounds() const
+	{
+		return Rect.Intersect(Clip);
+	}
+
+	size_t DisplayCommand::Hash() const
+	{
+		size_t h = size_t(Type);
+		auto Mix = [&h](size_t v) { h ^= v + 0x9E3779B9 + (h << 6) + (h >> 2); };
+		Mix(size_t(Rect.x)); Mix(size_t(Rect.y)); Mix(size_t(Rect.r)); Mix(size_t(Rect.b));
+		Mix(size_t(Clip.x)); Mix(size_t(Clip.y)); Mix(size_t(Clip.r)); Mix(size_t(Clip.b));
+		Mix(Color);
+		Mix(size_t(BorderX)); Mix(size_t(BorderY));
+		Mix(size_t(SrcX)); Mix(size_t(SrcY));
+		Mix(size_t(Transparent));
+		Mix(BackColor);
+		Mix(std::hash<std::string>()(Text));
+		Mix(std::hash<const ImageBlock*>()(Image.get()));
+		return h;
+	}
+
+	bool DisplayCommand::operator == (const DisplayCommand& other) const
+	{
+		return
+			Type == other.Type &&
+			Rect == other.Rect &&
+			Clip == other.Clip &&
+			Color == other.Color &&
+			BorderX == other.BorderX &&
+			BorderY == other.BorderY &&
+			SrcX == other.SrcX &&
+			SrcY == other.SrcY &&
+			Transparent == other.Transparent &&
+			BackColor == other.BackColor &&
+			Text == other.Text &&
+			Image == other.Image;
+	}
+
+	void DisplayCommand::Execute(Graphics& FB) const
+	{
+		switch (Type)
+		{
+		case DisplayCommandType::FillRect:
+			FB.FillRect(Rect.x, Rect.y, Rect.r, Rect.b, Color);
+			break;
+		case DisplayCommandType::Border:
+			{ // `FillRect()` 会交换颠倒的坐标，所以组件太小时要跳过宽高不为正的边
+				auto FillSide = [&FB, this](int x, int y, int r, int b)
+				{
+					if (r >= x && b >= y) FB.FillRect(x, y, r, b, Color);
+				};
+				if (BorderX > 0)
+				{ // 左右边框不包括上下边框占用的部分
+					FillSide(Rect.x, Rect.y + BorderY, Rect.x + BorderX - 1, Rect.b - BorderY);
+					FillSide(Rect.r - BorderX + 1, Rect.y + BorderY, Rect.r, Rect.b - BorderY);
+				}
+				if (BorderY > 0)
+				{
+					FillSide(Rect.x, Rect.y, Rect.r, Rect.y + BorderY - 1);
+					FillSide(Rect.x, Rect.b - BorderY + 1, Rect.r, Rect.b);
+				}
+			}
+			break;
+		case DisplayCommandType::Text:
+			if (Transparent) FB.DrawText(Rect.x, Rect.y, Text, true, Color);
+			else FB.DrawText(Rect.x, Rect.y, Text, Color, BackColor);
+			break;
+		case DisplayCommandType::Image:
+			if (Image) FB.DrawImage(*Image, Rect.x, Rect.y, Rect.r + 1 - Rect.x, Rect.b + 1 - Rect.y, SrcX, SrcY);
+			break;
+		}
+	}
+
+	DisplayCommand& DisplayList::AddCommand(DisplayCommandType Type, const UIRect& Rect)
+	{
+		Commands.emplace_back();
+		auto& Cmd = Commands.back();
+		Cmd.Type = Type;
+		Cmd.Rect = Rect;
+		Cmd.Clip = ClipStack.size() ? ClipStack.back() : UIRect{ 0, 0, INT_MAX, INT_MAX };
+		return Cmd;
+	}
+
+	void DisplayList::Clear()
+	{
+		Commands.clear();
+		ClipStack.clear();
+	}
+
+	size_t DisplayList::size() const
+	{
+		return Commands.size();
+	}
+
+	const std::vector<DisplayCommand>& DisplayList::GetCommands() const
+	{
+		return Commands;
+	}
+
+	void DisplayList::PushClip(const UIRect& Clip)
+	{
+		ClipStack.push_back(ClipStack.size() ? ClipStack.back().Intersect(Clip) : Clip);
+	}
+
+	void DisplayList::PopClip()
+	{
+		if (ClipStack.size()) ClipStack.pop_back();
+	}
+
+	void DisplayList::FillRect(const UIRect& Rect, uint32_t Color)
+	{
+		if (Rect.IsEmpty()) return;
+		AddCommand(DisplayCommandType::FillRect, Rect).Color = Color;
+	}
+
+	void DisplayList::Border(const UIRect& Rect, int BorderX, int BorderY, uint32_t Color)
+	{
+		if (Rect.IsEmpty() || (BorderX <= 0 && BorderY <= 0)) return;
+		auto& Cmd = AddCommand(DisplayCommandType::Border, Rect);
+		Cmd.BorderX = BorderX > 0 ? BorderX : 0;
+		Cmd.BorderY = BorderY > 0 ? BorderY : 0;
+		Cmd.Color = Color;
+	}
+
+	void DisplayList::Text(int x, int y, int w, int h, const std::string& t, bool Transparent, uint32_t Color, uint32_t BackColor)
+	{
+		if (t.empty() || w <= 0 || h <= 0) return;
+		auto& Cmd = AddCommand(DisplayCommandType::Text, { x, y, x + w - 1, y + h - 1 });
+		Cmd.Text = t;
+		Cmd.Transparent = Transparent;
+		Cmd.Color = Color;
+		if (!Transparent) Cmd.BackColor = BackColor;
+	}
+
+	void DisplayList::Image(int x, int y, int w, int h, int srcx, int srcy, std::shared_ptr<const ImageBlock> ib)
+	{
+		if (!ib || w <= 0 || h <= 0) return;
+		auto& Cmd = AddCommand(DisplayCommandType::Image, { x, y, x + w - 1, y + h - 1 });
+		Cmd.SrcX = srcx;
+		Cmd.SrcY = srcy;
+		Cmd.Image = std::move(ib);
+	}
+
+	void DisplayList::Offset(int dx, int dy)
+	{
+		auto Move = [](int& v, int d)
+		{ // 不裁剪的边界保持 INT_MAX
+			if (v != INT_MAX) v += d;
+		};
+		for (auto& Cmd : Commands)
+		{
+			Move(Cmd.Rect.x, dx); Move(Cmd.Rect.r, dx); Move(Cmd.Clip.x, dx); Move(Cmd.Clip.r, dx);
+			Move(Cmd.Rect.y, dy); Move(Cmd.Rect.b, dy); Move(Cmd.Clip.y, dy); Move(Cmd.Clip.b, dy);
+		}
+	}
+
+	void DisplayList::Diff(const DisplayList& Previous, std::vector<UIRect>& Region, size_t MaxRects) const
+	{
+		// 上一帧的命令按哈希值分组，配对上的命令从中删除，最后剩下的就是消失了的命令
+		std::unordered_multimap<size_t, const DisplayCommand*> Unmatched;
+		Unmatched.reserve(Previous.Commands.size());
+		for (auto& Cmd : Previous.Commands)
+		{
+			Unmatched.emplace(Cmd.Hash(), &Cmd);
+		}
+		for (auto& Cmd : Commands)
+		{
+			bool Matched = false;
+			auto Range = Unmatched.equal_range(Cmd.Hash());
+			for (auto it = Range.first; it != Range.second; ++it)
+			{
+				if (*it->second == Cmd)
+				{
+					Unmatched.erase(it);
+					Matched = true;
+					break;
+				}
+			}
+			if (!Matched) AddRectToRegion(Region, Cmd.GetBounds(), MaxRects);
+		}
+		for (auto& Pair : Unmatched)
+		{
+			AddRectToRegion(Region, Pair.second->GetBounds(), MaxRects);
+		}
+	}
+
+	size_t DisplayList::Rasterize(Graphics& FB, const UIRect& Region) const
+	{
+		size_t Executed = 0;
+		for (auto& Cmd : Commands)
+		{
+			auto Clip = Cmd.Clip.Intersect(Region);
+			if (!Cmd.Rect.Intersects(Clip)) continue;
+			FB.SetClipRect(Clip.x, Clip.y, Clip.r, Clip.b);
+			Cmd.Execute(FB);
+			Executed++;
+		}
+		FB.ResetClipRect();
+		return Executed;
+	}
+
+	std::string DisplayList::Serialize() const
+	{
+		std::string ret;
+		char Buffer[256];
+		auto RectString = [&Buffer](const char* Name, const UIRect& r)
+		{
+			snprintf(Buffer, sizeof Buffer, " %s %d %d %d %d", Name, r.x, r.y, r.r, r.b);
+			return std::string(Buffer);
+		};
+		for (auto& Cmd : Commands)
+		{
+			switch (Cmd.Type)
+			{
+			case DisplayCommandType::FillRect: ret += "fill"; break;
+			case DisplayCommandType::Border: ret += "border"; break;
+			case DisplayCommandType::Text: ret += "text"; break;
+			case DisplayCommandType::Image: ret += "image"; break;
+			}
+			ret += RectString("rect", Cmd.Rect);
+			if (Cmd.Clip.r != INT_MAX || Cmd.Clip.b != INT_MAX || Cmd.Clip.x || Cmd.Clip.y) ret += RectString("clip", Cmd.Clip);
+			switch (Cmd.Type)
+			{
+			case DisplayCommandType::FillRect:
+				snprintf(Buffer, sizeof Buffer, " color %08x", Cmd.Color);
+				ret += Buffer;
+				break;
+			case DisplayCommandType::Border:
+				snprintf(Buffer, sizeof Buffer, " size %d %d color %08x", Cmd.BorderX, Cmd.BorderY, Cmd.Color);
+				ret += Buffer;
+				break;
+			case DisplayCommandType::Text:
+				if (Cmd.Transparent) snprintf(Buffer, sizeof Buffer, " color %08x transparent \"", Cmd.Color);
+				else snprintf(Buffer, sizeof Buffer, " color %08x back %08x \"", Cmd.Color, Cmd.BackColor);
+				ret += Buffer;
+				for (auto ch : Cmd.Text)
+				{
+					if (ch == '"' || ch == '\\') ret += '\\';
+					if (ch == '\n') ret += "\\n";
+					else ret += ch;
+				}
+				ret += '"';
+				break;
+			case DisplayCommandType::Image:
+				{ // 图像以内容的哈希值表示，这样不同的运行之间也可以比较
+					uint32_t ImageHash = 2166136261u;
+					for (auto Pixel : Cmd.Image->Pixels) ImageHash = (ImageHash ^ Pixel) * 16777619u;
+					snprintf(Buffer, sizeof Buffer, " src %d %d image %dx%d %08x", Cmd.SrcX, Cmd.SrcY, Cmd.Image->w, Cmd.Image->h, ImageHash);
+					ret += Buffer;
+				}
+				break;
+			}
+			ret += '\n';
+		}
+		return ret;
+	}
+}
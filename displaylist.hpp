@@ -0,0 +1,96 @@
+﻿#pragma once
+#include "graphics.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace TVOS
+{
+	// 屏幕上的矩形区域，右边和下边是闭区间
+	struct UIRect
+	{
+		int x = 0;
+		int y = 0;
+		int r = -1;
+		int b = -1;
+
+		bool IsEmpty() const;
+		bool Intersects(const UIRect& other) const;
+		bool Touches(const UIRect& other) const; // 相交或相邻，合并后不会多出太多面积
+		UIRect Union(const UIRect& other) const;
+		UIRect Intersect(const UIRect& other) const;
+		bool operator == (const UIRect& other) const;
+		bool operator != (const UIRect& other) const;
+	};
+
+	// 将矩形加入区域，与相交或相邻的矩形合并；矩形数超过 MaxRects 时整个区域合并为一个矩形。
+	void AddRectToRegion(std::vector<UIRect>& Region, const UIRect& Rect, size_t MaxRects);
+
+	enum class DisplayCommandType
+	{
+		FillRect,
+		Border,
+		Text,
+		Image,
+	};
+
+	// 一条绘图命令。所有参数都参与比较，前后两帧中完全相同的命令不需要重绘。
+	struct DisplayCommand
+	{
+		DisplayCommandType Type = DisplayCommandType::FillRect;
+		UIRect Rect; // 绘制的范围。`Text` `Image` 为左上角位置与大小
+		UIRect Clip; // 记录时的裁剪区域
+		uint32_t Color = 0;
+		int BorderX = 0; // `Border` 左右边框的宽度
+		int BorderY = 0; // `Border` 上下边框的宽度
+		int SrcX = 0; // `Image` 在源图像中的起点
+		int SrcY = 0;
+		bool Transparent = false; // `Text` 是否透明背景
+		uint32_t BackColor = 0; // 不透明的 `Text` 的底色
+		std::string Text;
+		std::shared_ptr<const ImageBlock> Image; // 以指针区分图像，内容改变时要换一个新的图像
+
+		UIRect GetBounds() const; // 实际会影响到的屏幕区域
+		size_t Hash() const;
+		bool operator == (const DisplayCommand& other) const;
+		void Execute(Graphics& FB) const;
+	};
+
+	// 保留模式的显示列表：界面先记录成一串绘图命令，与上一帧比较后只重绘变化了的区域。
+	class DisplayList
+	{
+	protected:
+		std::vector<DisplayCommand> Commands;
+		std::vector<UIRect> ClipStack;
+
+		DisplayCommand& AddCommand(DisplayCommandType Type, const UIRect& Rect);
+
+	public:
+		void Clear();
+		size_t size() const;
+		const std::vector<DisplayCommand>& GetCommands() const;
+
+		// 裁剪区域可以嵌套，之后记录的命令只影响所有裁剪区域的交集
+		void PushClip(const UIRect& Clip);
+		void PopClip();
+
+		void FillRect(const UIRect& Rect, uint32_t Color);
+		void Border(const UIRect& Rect, int BorderX, int BorderY, uint32_t Color); // Rect 为边框的外边缘
+		void Text(int x, int y, int w, int h, const std::string& t, bool Transparent, uint32_t Color, uint32_t BackColor = 0); // 不透明时整个文字区域画成 BackColor 作底
+		void Image(int x, int y, int w, int h, int srcx, int srcy, std::shared_ptr<const ImageBlock> ib);
+
+		// 平移所有命令，用于将按屏幕坐标记录的命令执行到离屏图像里
+		void Offset(int dx, int dy);
+
+		// 与上一帧比较，将只在其中一帧出现的命令所影响的区域加入 Region。
+		// 命令按内容配对，不考虑先后顺序的变化。
+		void Diff(const DisplayList& Previous, std::vector<UIRect>& Region, size_t MaxRects) const;
+
+		// 将与 Region 相交的命令裁剪到 Region 内执行，返回执行了的命令数
+		size_t Rasterize(Graphics& FB, const UIRect& Region) const;
+
+		// 每行一条命令的文本形式，用于测试比较和记录
+		std::string Serialize() const;
+	};
+}
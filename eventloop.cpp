@@ -0,0 +1,249 @@
+﻿#include "eventloop.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace TVOS
+{
+#if !defined(_MSC_VER)
+	static_assert(EventLoop::Readable == EPOLLIN, "EventLoop::Readable must match EPOLLIN.");
+#endif
+
+	EventLoop::EventLoop()
+	{
+#if !defined(_MSC_VER)
+		EpollFD = epoll_create1(EPOLL_CLOEXEC);
+		if (EpollFD == -1)
+		{
+			perror("epoll_create1()");
+			return;
+		}
+		TimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		WakeupFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		for (auto fd : { TimerFD, WakeupFD })
+		{
+			if (fd == -1) continue;
+			epoll_event Event;
+			memset(&Event, 0, sizeof Event);
+			Event.events = EPOLLIN;
+			Event.data.fd = fd;
+			epoll_ctl(EpollFD, EPOLL_CTL_ADD, fd, &Event);
+		}
+#endif
+	}
+
+	EventLoop::~EventLoop()
+	{
+#if !defined(_MSC_VER)
+		for (auto fd : { SignalFD, WakeupFD, TimerFD, EpollFD })
+		{
+			if (fd != -1) close(fd);
+		}
+#endif
+	}
+
+	bool EventLoop::AddFD(int FD, uint32_t Events, FDCallback Callback)
+	{
+#if !defined(_MSC_VER)
+		if (EpollFD == -1 || FD == -1) return false;
+		epoll_event Event;
+		memset(&Event, 0, sizeof Event);
+		Event.events = Events;
+		Event.data.fd = FD;
+		bool Exists = FDCallbacks.count(FD) != 0;
+		if (epoll_ctl(EpollFD, Exists ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, FD, &Event) == -1)
+		{
+			perror("epoll_ctl()");
+			return false;
+		}
+		FDCallbacks[FD] = std::make_shared<FDCallback>(std::move(Callback));
+		return true;
+#else
+		(void)FD; (void)Events; (void)Callback;
+		return false;
+#endif
+	}
+
+	void EventLoop::RemoveFD(int FD)
+	{
+		if (!FDCallbacks.erase(FD)) return;
+#if !defined(_MSC_VER)
+		epoll_ctl(EpollFD, EPOLL_CTL_DEL, FD, nullptr);
+#endif
+	}
+
+	EventLoop::TimerID EventLoop::AddTimer(Clock::time_point When, TimerCallback Callback, Clock::duration Period)
+	{
+		auto ID = NextTimerID++;
+		Timers[ID] = Timer{ When, Period, std::make_shared<TimerCallback>(std::move(Callback)) };
+		return ID;
+	}
+
+	void EventLoop::CancelTimer(TimerID ID)
+	{
+		Timers.erase(ID);
+	}
+
+	bool EventLoop::AddSignal(int Signal, SignalCallback Callback)
+	{
+#if !defined(_MSC_VER)
+		SignalCallbacks[Signal] = std::move(Callback);
+		sigset_t Mask;
+		sigemptyset(&Mask);
+		for (auto& it : SignalCallbacks) sigaddset(&Mask, it.first);
+		pthread_sigmask(SIG_BLOCK, &Mask, nullptr);
+
+		// 已有的 signalfd 传进去只是更新它接收的信号
+		int fd = signalfd(SignalFD, &Mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (fd == -1)
+		{
+			perror("signalfd()");
+			SignalCallbacks.erase(Signal);
+			return false;
+		}
+		if (SignalFD == -1)
+		{
+			SignalFD = fd;
+			epoll_event Event;
+			memset(&Event, 0, sizeof Event);
+			Event.events = EPOLLIN;
+			Event.data.fd = SignalFD;
+			epoll_ctl(EpollFD, EPOLL_CTL_ADD, SignalFD, &Event);
+		}
+		return true;
+#else
+		(void)Signal; (void)Callback;
+		return false;
+#endif
+	}
+
+	void EventLoop::Wakeup()
+	{
+#if !defined(_MSC_VER)
+		uint64_t One = 1;
+		if (write(WakeupFD, &One, sizeof One) < 0) {} // 计数器满了说明已经有未处理的唤醒
+#endif
+	}
+
+	void EventLoop::ArmTimerFD(Clock::time_point When)
+	{
+#if !defined(_MSC_VER)
+		if (When == ArmedTime) return;
+		ArmedTime = When;
+		itimerspec Spec;
+		memset(&Spec, 0, sizeof Spec);
+		if (When != Clock::time_point::max())
+		{
+			// steady_clock 就是 CLOCK_MONOTONIC，可以直接设绝对时间
+			auto Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(When.time_since_epoch()).count();
+			if (Ns <= 0) Ns = 1; // 全为 0 表示停止定时器
+			Spec.it_value.tv_sec = time_t(Ns / 1000000000);
+			Spec.it_value.tv_nsec = long(Ns % 1000000000);
+		}
+		timerfd_settime(TimerFD, TFD_TIMER_ABSTIME, &Spec, nullptr);
+#else
+		(void)When;
+#endif
+	}
+
+	void EventLoop::RunDueTimers()
+	{
+		auto Now = Clock::now();
+		std::vector<std::pair<TimerID, std::shared_ptr<TimerCallback>>> Due;
+		for (auto& it : Timers)
+		{
+			if (it.second.When <= Now) Due.emplace_back(it.first, it.second.Callback);
+		}
+		for (auto& d : Due)
+		{
+			auto it = Timers.find(d.first);
+			if (it == Timers.end()) continue; // 被前面的回调取消了
+			if (it->second.Period > Clock::duration::zero())
+			{
+				// 落后超过一个周期时不补触发
+				it->second.When += it->second.Period;
+				if (it->second.When <= Now) it->second.When = Now + it->second.Period;
+			}
+			else
+			{
+				Timers.erase(it);
+			}
+			(*d.second)();
+		}
+	}
+
+	void EventLoop::ReadSignals()
+	{
+#if !defined(_MSC_VER)
+		signalfd_siginfo Info;
+		while (read(SignalFD, &Info, sizeof Info) == sizeof Info)
+		{
+			auto it = SignalCallbacks.find(int(Info.ssi_signo));
+			if (it != SignalCallbacks.end()) it->second(int(Info.ssi_signo));
+		}
+#endif
+	}
+
+	void EventLoop::RunOnce(Clock::time_point Deadline)
+	{
+		auto WakeTime = Deadline;
+		for (auto& it : Timers) WakeTime = std::min(WakeTime, it.second.When);
+
+#if !defined(_MSC_VER)
+		if (EpollFD != -1)
+		{
+			int Timeout = -1;
+			if (WakeTime <= Clock::now()) Timeout = 0;
+			else ArmTimerFD(WakeTime);
+
+			epoll_event Ready[16];
+			int Count = epoll_wait(EpollFD, Ready, 16, Timeout);
+			if (Count == -1 && errno != EINTR) perror("epoll_wait()");
+			for (int i = 0; i < Count; i++)
+			{
+				auto fd = Ready[i].data.fd;
+				uint64_t Value;
+				if (fd == TimerFD)
+				{
+					if (read(TimerFD, &Value, sizeof Value) < 0) {}
+					ArmedTime = Clock::time_point::max();
+				}
+				else if (fd == WakeupFD)
+				{
+					if (read(WakeupFD, &Value, sizeof Value) < 0) {}
+				}
+				else if (fd == SignalFD)
+				{
+					ReadSignals();
+				}
+				else
+				{
+					auto it = FDCallbacks.find(fd);
+					if (it == FDCallbacks.end()) continue; // 被前面的回调移除了
+					auto Callback = it->second;
+					(*Callback)(Ready[i].events);
+				}
+			}
+			RunDueTimers();
+			return;
+		}
+#endif
+		// 没有 epoll 时（Windows 调试）只能睡到下一个定时器或者 Deadline
+		if (WakeTime != Clock::time_point::max()) std::this_thread::sleep_until(WakeTime);
+		RunDueTimers();
+	}
+}
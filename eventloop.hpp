@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace TVOS
+{
+	// 主循环的事件分发。所有等待都合并到一个 epoll 上：
+	// 文件描述符（输入、热插拔等）、定时器（一个 timerfd，总是设到最早的到期时间）、
+	// 信号（signalfd，例如 SIGCHLD）以及其它线程的唤醒（eventfd）。
+	// 没有事情要做时进程一直睡眠，不再按固定间隔醒来轮询。
+	// 回调都在调用 `RunOnce()` 的线程中执行，除 `Wakeup()` 外所有方法都只能在这个线程调用。
+	class EventLoop
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+		using FDCallback = std::function<void(uint32_t Events)>; // 参数是 epoll 的事件位
+		using TimerCallback = std::function<void()>;
+		using SignalCallback = std::function<void(int Signal)>;
+		using TimerID = uint64_t;
+
+		static constexpr uint32_t Readable = 0x001; // 与 EPOLLIN 相同，Windows 上也能编译
+
+	protected:
+		int EpollFD = -1;
+		int TimerFD = -1;
+		int WakeupFD = -1;
+		int SignalFD = -1;
+
+		std::unordered_map<int, std::shared_ptr<FDCallback>> FDCallbacks;
+		std::unordered_map<int, SignalCallback> SignalCallbacks;
+
+		struct Timer
+		{
+			Clock::time_point When;
+			Clock::duration Period; // 为 0 时只触发一次
+			std::shared_ptr<TimerCallback> Callback;
+		};
+		std::map<TimerID, Timer> Timers;
+		TimerID NextTimerID = 1;
+		Clock::time_point ArmedTime = Clock::time_point::max();
+
+		void ArmTimerFD(Clock::time_point When);
+		void RunDueTimers();
+		void ReadSignals();
+
+	public:
+		EventLoop();
+		~EventLoop();
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator = (const EventLoop&) = delete;
+
+		// 注册文件描述符，Events 为 EPOLLIN 等。同一个描述符再次注册时替换回调。
+		bool AddFD(int FD, uint32_t Events, FDCallback Callback);
+		void RemoveFD(int FD);
+
+		// 在 When 触发一次，Period 不为 0 时之后按周期触发。回调中可以增删定时器。
+		TimerID AddTimer(Clock::time_point When, TimerCallback Callback, Clock::duration Period = Clock::duration::zero());
+		void CancelTimer(TimerID ID);
+
+		// 屏蔽信号并改为通过 signalfd 接收。需在创建其它线程之前调用，子进程在 exec 之前应恢复信号屏蔽字。
+		bool AddSignal(int Signal, SignalCallback Callback);
+
+		// 让正在等待的 `RunOnce()` 立即返回，可以在任何线程调用
+		void Wakeup();
+
+		// 等到有事件或者到达 Deadline，执行所有就绪的回调和到期的定时器后返回
+		void RunOnce(Clock::time_point Deadline = Clock::time_point::max());
+	};
+}
@@ -1,118 +1,306 @@
 #include "font.hpp"
 
-#include <unordered_map>
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <fstream>
+
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace TVOS
 {
-	constexpr auto GlyphHeight = 22;
-	constexpr auto NumGlyphs = 7541;
-	static constexpr uint16_t AllGlyphsSet[NumGlyphs] =
+	// 内置字体，由 `fontgen -c` 在编译时生成，格式与 .tvf 文件相同
+	alignas(4) static constexpr uint8_t BuiltinFontData[] =
 	{
-		#include "font/allglyphs"
+		#include "font/builtin22.inc"
 	};
 
-	static constexpr uint32_t GlyphBinaryCode[] =
+	static const FontFace& GetBuiltinFont()
 	{
-		#include "font/binarycode"
-	};
+		static const FontFace BuiltinFont(BuiltinFontData, sizeof BuiltinFontData, "<built-in>", false);
+		return BuiltinFont;
+	}
 
-	static constexpr uint8_t GlyphWidthMap[NumGlyphs] =
+	bool GetGlyphSize(uint32_t Unicode, int& Width, int& Height, bool Verbose)
 	{
-		#include "font/widthtable"
-	};
+		if (!GetBuiltinFont().GetGlyphSize(Unicode, Width, Height))
+		{
+			if (Verbose)
+			{
+				std::cerr << "[WARN] In the call to `GetGlyphSize()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
+			}
+			return false;
+		}
+		return true;
+	}
 
-	static constexpr auto BinaryCodeStride = (sizeof GlyphBinaryCode) / GlyphHeight;
+	bool ExtractGlyph(ImageBlock& ImgOut, uint32_t Unicode, uint32_t color1, uint32_t color2, bool Verbose)
+	{
+		if (!GetBuiltinFont().ExtractGlyph(ImgOut, Unicode, color1, color2))
+		{
+			if (Verbose)
+			{
+				std::cerr << "[WARN] In the call to `ExtractGlyph()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
+			}
+			return false;
+		}
+		return true;
+	}
 
-	static std::unordered_map<uint16_t, int> MakeCharToGlyphMap()
+	FontLoadFailed::FontLoadFailed(const std::string& what) noexcept :
+		std::runtime_error(what)
 	{
-		std::unordered_map<uint16_t, int> ret;
+	}
 
-		for(size_t i = 0; i < NumGlyphs; i++)
+	FontFace::FontFace(const std::string& FontFile, bool Verbose) :
+		Verbose(Verbose)
+	{
+		if (Verbose)
 		{
-			ret[AllGlyphsSet[i]] = int(i);
+			std::cout << "[INFO] Loading font file `" << FontFile << "`.\n";
 		}
+#if !defined(_MSC_VER)
+		int fd = open(FontFile.c_str(), O_RDONLY);
+		if (fd == -1) throw FontLoadFailed(std::string("Open font file `") + FontFile + "` failed: " + strerror(errno));
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			close(fd);
+			throw FontLoadFailed(std::string("Stat font file `") + FontFile + "` failed: " + strerror(errno));
+		}
+		MappedSize = size_t(st.st_size);
+		if (MappedSize < sizeof(FontFileHeader))
+		{
+			close(fd);
+			throw FontLoadFailed(std::string("Font file `") + FontFile + "` is too small.");
+		}
+		MappedPtr = mmap(nullptr, MappedSize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (MappedPtr == MAP_FAILED)
+		{
+			MappedPtr = nullptr;
+			throw FontLoadFailed(std::string("mmap() font file `") + FontFile + "` failed: " + strerror(errno));
+		}
+#else
+		std::ifstream ifs(FontFile, std::ios::binary | std::ios::ate);
+		if (!ifs.is_open()) throw FontLoadFailed(std::string("Open font file `") + FontFile + "` failed.");
+		MappedSize = size_t(ifs.tellg());
+		if (MappedSize < sizeof(FontFileHeader)) throw FontLoadFailed(std::string("Font file `") + FontFile + "` is too small.");
+		MappedPtr = new uint8_t[MappedSize];
+		ifs.seekg(0);
+		ifs.read(reinterpret_cast<char*>(MappedPtr), MappedSize);
+#endif
+		try
+		{
+			Attach(MappedPtr, MappedSize, FontFile);
+		}
+		catch (const FontLoadFailed&)
+		{
+			Unmap();
+			throw;
+		}
+	}
 
-		return ret;
+	FontFace::FontFace(const void* FontData, size_t FontDataSize, const std::string& Name, bool Verbose) :
+		Verbose(Verbose)
+	{
+		Attach(FontData, FontDataSize, Name);
 	}
 
-	static std::unordered_map<uint32_t, int> MakeCharToGlyphXPos()
+	void FontFace::Attach(const void* FontData, size_t FontDataSize, const std::string& Name)
 	{
-		std::unordered_map<uint32_t, int> ret;
+		Data = reinterpret_cast<const uint8_t*>(FontData);
+		DataSize = FontDataSize;
+		Header = reinterpret_cast<const FontFileHeader*>(Data);
+		if (DataSize < sizeof(FontFileHeader)) throw FontLoadFailed(std::string("Font `") + Name + "` is too small.");
 
-		int xpos = 0;
-		for(size_t i = 0; i < NumGlyphs; i++)
+		auto FitsIn = [this](size_t Offset, size_t Size) { return Offset <= DataSize && Size <= DataSize - Offset; };
+		size_t N = Header->NumGlyphs;
+		size_t NumPages = Header->GlyphsPerPage ? (N + Header->GlyphsPerPage - 1) / Header->GlyphsPerPage : 0;
+		if (memcmp(Header->Magic, FontFileMagic, sizeof FontFileMagic) ||
+			Header->Version != FontFileVersion ||
+			Header->FileSize != DataSize ||
+			Header->GlyphHeight == 0 ||
+			Header->GlyphsPerPage == 0 ||
+			(Header->BitsPerPixel != 1 && Header->BitsPerPixel != 8) ||
+			!FitsIn(Header->CodePointsOffset, N * sizeof(uint32_t)) ||
+			!FitsIn(Header->GlyphInfosOffset, N * sizeof(FontGlyphInfo)) ||
+			!FitsIn(Header->PagesOffset, NumPages * sizeof(FontPageInfo)) ||
+			!FitsIn(Header->PageDataOffset, 0) ||
+			Header->CodePointsOffset % 4 || Header->GlyphInfosOffset % 4 || Header->PagesOffset % 4)
 		{
-			ret[AllGlyphsSet[i]] = xpos;
-			xpos += GlyphWidthMap[i];
+			throw FontLoadFailed(std::string("Font `") + Name + "` has an invalid header.");
 		}
+		CodePoints = reinterpret_cast<const uint32_t*>(Data + Header->CodePointsOffset);
+		GlyphInfos = reinterpret_cast<const FontGlyphInfo*>(Data + Header->GlyphInfosOffset);
+		Pages = reinterpret_cast<const FontPageInfo*>(Data + Header->PagesOffset);
+		PageData = Data + Header->PageDataOffset;
 
-		return ret;
+		if (Verbose)
+		{
+			std::cout << "[INFO] Font `" << Name << "` has " << N << " glyphs in " << NumPages << " pages, glyph height = " << Header->GlyphHeight << ", " << Header->BitsPerPixel << " bpp.\n";
+		}
 	}
 
-	static std::unordered_map<uint32_t, int> MakeCharToGlyphWidth()
+	FontFace::~FontFace()
 	{
-		std::unordered_map<uint32_t, int> ret;
+		Unmap();
+	}
 
-		for (size_t i = 0; i < NumGlyphs; i++)
-		{
-			ret[AllGlyphsSet[i]] = GlyphWidthMap[i];
-		}
+	void FontFace::Unmap()
+	{
+		if (!MappedPtr) return;
+#if !defined(_MSC_VER)
+		munmap(MappedPtr, MappedSize);
+#else
+		delete[] reinterpret_cast<uint8_t*>(MappedPtr);
+#endif
+		MappedPtr = nullptr;
+	}
 
-		return ret;
+	int FontFace::GetGlyphHeight() const
+	{
+		return Header->GlyphHeight;
 	}
 
-	static auto CharToGlyphMap = MakeCharToGlyphMap();
-	static auto GlyphXPos = MakeCharToGlyphXPos();
-	static auto GlyphWidth = MakeCharToGlyphWidth();
+	size_t FontFace::GetNumGlyphs() const
+	{
+		return Header->NumGlyphs;
+	}
 
-	static int GetGlyphPixel(int x, int y)
+	int FontFace::GetBitsPerPixel() const
 	{
-		auto BytePtr = reinterpret_cast<const uint8_t*>(GlyphBinaryCode);
-		int b = 7 - x % 8;
-		int i = x / 8;
-		int bit = 1 << b;
-		return (BytePtr[y * BinaryCodeStride + i] & bit) ? 1 : 0;
+		return Header->BitsPerPixel;
 	}
 
-	bool GetGlyphSize(uint32_t Unicode, int& Width, int& Height, bool Verbose)
+	int FontFace::FindGlyph(uint32_t Unicode) const
+	{
+		auto End = CodePoints + Header->NumGlyphs;
+		auto Found = std::lower_bound(CodePoints, End, Unicode);
+		if (Found == End || *Found != Unicode) return -1;
+		return int(Found - CodePoints);
+	}
+
+	const uint8_t* FontFace::GetPage(uint32_t PageIndex, size_t& PageSize) const
 	{
-		if (!CharToGlyphMap.count(Unicode))
+		auto& Page = Pages[PageIndex];
+		auto CompressedOffset = size_t(Header->PageDataOffset) + Page.Offset;
+		if (CompressedOffset > DataSize || Page.CompressedSize > DataSize - CompressedOffset)
+		{
+			std::cerr << "[WARN] In the call to `FontFace::GetPage()`: Page " << PageIndex << " is out of the font data.\n";
+			return nullptr;
+		}
+		PageSize = Page.RawSize;
+
+		// 原样存放的页直接使用，不占用页缓存
+		if (Page.CompressedSize == Page.RawSize) return PageData + Page.Offset;
+
+		PageCacheClock++;
+		for (auto& Cached : PageCache)
+		{
+			if (Cached.PageIndex == PageIndex)
+			{
+				Cached.LastUsed = PageCacheClock;
+				return Cached.Data.data();
+			}
+		}
+
+		// 缓存满了则替换掉最久没有用到的页
+		CachedPage* Slot = nullptr;
+		if (PageCache.size() < MaxCachedPages)
+		{
+			PageCache.emplace_back();
+			Slot = &PageCache.back();
+		}
+		else
+		{
+			Slot = &PageCache.front();
+			for (auto& Cached : PageCache)
+			{
+				if (Cached.LastUsed < Slot->LastUsed) Slot = &Cached;
+			}
+		}
+		Slot->PageIndex = PageIndex;
+		Slot->LastUsed = PageCacheClock;
+		Slot->Data.resize(Page.RawSize);
+		if (!UnpackBits(PageData + Page.Offset, Page.CompressedSize, Slot->Data.data(), Slot->Data.size()))
+		{
+			std::cerr << "[WARN] In the call to `FontFace::GetPage()`: Page " << PageIndex << " is corrupted.\n";
+			Slot->PageIndex = uint32_t(-1);
+			return nullptr;
+		}
+		if (Verbose)
+		{
+			std::cout << "[INFO] Decompressed font page " << PageIndex << ": " << Page.CompressedSize << " -> " << Page.RawSize << " bytes.\n";
+		}
+		return Slot->Data.data();
+	}
+
+	bool FontFace::GetGlyphSize(uint32_t Unicode, int& Width, int& Height) const
+	{
+		auto GlyphIndex = FindGlyph(Unicode);
+		if (GlyphIndex < 0)
 		{
 			if (Verbose)
 			{
-				std::cerr << "[WARN] In the call to `GetGlyphSize()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
+				std::cerr << "[WARN] In the call to `FontFace::GetGlyphSize()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
 			}
 			return false;
 		}
-		auto GlyphIndex = CharToGlyphMap.at(Unicode);
-		Width = GlyphWidth.at(Unicode);
-		Height = 22;
+		Width = GlyphInfos[GlyphIndex].Width;
+		Height = Header->GlyphHeight;
 		return true;
 	}
 
-	bool ExtractGlyph(ImageBlock& ImgOut, uint32_t Unicode, uint32_t color1, uint32_t color2, bool Verbose)
+	bool FontFace::ExtractGlyph(ImageBlock& ImgOut, uint32_t Unicode, uint32_t color1, uint32_t color2) const
 	{
-		if (!CharToGlyphMap.count(Unicode))
+		auto GlyphIndex = FindGlyph(Unicode);
+		if (GlyphIndex < 0)
 		{
 			if (Verbose)
 			{
-				std::cerr << "[WARN] In the call to `ExtractGlyph()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
+				std::cerr << "[WARN] In the call to `FontFace::ExtractGlyph()`: Glyph U+" << std::hex << Unicode << std::dec << " not found.\n";
 			}
 			return false;
 		}
-		auto GlyphIndex = CharToGlyphMap.at(Unicode);
-		auto X = GlyphXPos.at(Unicode);
-		ImgOut = ImageBlock();
-		ImgOut.h = 22;
-		ImgOut.w = GlyphWidth.at(Unicode);
-		ImgOut.Pixels.resize(size_t(ImgOut.w) * ImgOut.h);
-		for(int iy = 0 ; iy < ImgOut.h; iy ++)
+		auto& Info = GlyphInfos[GlyphIndex];
+		size_t PageSize = 0;
+		auto Page = GetPage(uint32_t(GlyphIndex / Header->GlyphsPerPage), PageSize);
+		if (!Page) return false;
+
+		int w = Info.Width;
+		int h = Header->GlyphHeight;
+		size_t RowBytes = (size_t(w) * Header->BitsPerPixel + 7) / 8;
+		if (Info.Top + Info.Rows > h || Info.OffsetInPage > PageSize || RowBytes * Info.Rows > PageSize - Info.OffsetInPage)
 		{
-			for(int ix = 0; ix < ImgOut.w; ix ++)
+			std::cerr << "[WARN] In the call to `FontFace::ExtractGlyph()`: Glyph U+" << std::hex << Unicode << std::dec << " is out of its page.\n";
+			return false;
+		}
+		auto GlyphBits = Page + Info.OffsetInPage;
+		ImgOut = ImageBlock(w, h, color2);
+		for (int iy = 0; iy < Info.Rows; iy++)
+		{
+			auto Row = GlyphBits + RowBytes * iy;
+			auto Pixels = &ImgOut.Pixels[size_t(Info.Top + iy) * w];
+			if (Header->BitsPerPixel == 8)
+			{ // 按覆盖率在两种颜色之间混合，绘制时就不需要再逐像素计算了
+				for (int ix = 0; ix < w; ix++)
+				{
+					if (Row[ix]) Pixels[ix] = BlendColor(color2, color1, Row[ix]);
+				}
+			}
+			else
 			{
-				ImgOut.Pixels[size_t(iy) * ImgOut.w + ix] = GetGlyphPixel(X + ix, iy) ? color1 : color2;
+				for (int ix = 0; ix < w; ix++)
+				{
+					if (Row[ix / 8] & (0x80 >> (ix % 8))) Pixels[ix] = color1;
+				}
 			}
 		}
 		return true;
@@ -1,11 +1,68 @@
 #pragma once
 
 #include "graphics.hpp"
+#include "fontformat.hpp"
 
 #include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
 
 namespace TVOS
 {
 	bool GetGlyphSize(uint32_t Unicode, int& Width, int& Height, bool Verbose);
 	bool ExtractGlyph(ImageBlock& ImgOut, uint32_t Unicode, uint32_t color1, uint32_t color2, bool Verbose);
+
+	class FontLoadFailed : public std::runtime_error
+	{
+	public:
+		FontLoadFailed(const std::string& what) noexcept;
+	};
+
+	// .tvf 格式的字体。外部字体文件通过 mmap() 载入，只有实际用到的字符所在的页面才会被载入内存。
+	// 字符位图按页压缩存放，第一次用到某页时才解压到一个很小的页缓存里。
+	class FontFace
+	{
+	protected:
+		void* MappedPtr = nullptr;
+		size_t MappedSize = 0;
+
+		const uint8_t* Data = nullptr;
+		size_t DataSize = 0;
+		const FontFileHeader* Header = nullptr;
+		const uint32_t* CodePoints = nullptr;
+		const FontGlyphInfo* GlyphInfos = nullptr;
+		const FontPageInfo* Pages = nullptr;
+		const uint8_t* PageData = nullptr;
+
+		struct CachedPage
+		{
+			uint32_t PageIndex = 0;
+			uint32_t LastUsed = 0;
+			std::vector<uint8_t> Data;
+		};
+		static constexpr size_t MaxCachedPages = 8;
+		mutable std::vector<CachedPage> PageCache;
+		mutable uint32_t PageCacheClock = 0;
+
+		void Attach(const void* FontData, size_t FontDataSize, const std::string& Name);
+		int FindGlyph(uint32_t Unicode) const;
+		const uint8_t* GetPage(uint32_t PageIndex, size_t& PageSize) const;
+		void Unmap();
+
+	public:
+		FontFace(const std::string& FontFile, bool Verbose);
+		FontFace(const void* FontData, size_t FontDataSize, const std::string& Name, bool Verbose); // 不复制、不释放 `FontData`
+		FontFace(const FontFace&) = delete;
+		FontFace& operator = (const FontFace&) = delete;
+		~FontFace();
+
+		bool Verbose = false;
+
+		int GetGlyphHeight() const;
+		size_t GetNumGlyphs() const;
+		int GetBitsPerPixel() const; // 1 为单色字体，8 为带覆盖率（抗锯齿）的字体
+		bool GetGlyphSize(uint32_t Unicode, int& Width, int& Height) const;
+		bool ExtractGlyph(ImageBlock& ImgOut, uint32_t Unicode, uint32_t color1, uint32_t color2) const;
+	};
 }
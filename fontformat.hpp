@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace TVOS
+{
+	// 字体文件（.tvf）格式，所有数值均为小端序：
+	// [FontFileHeader]
+	// [uint32_t CodePoints[NumGlyphs]]          按码位升序排列，用于二分查找
+	// [FontGlyphInfo GlyphInfos[NumGlyphs]]     每个字符的宽度、去掉上下空白行后的位置，以及在所在页中的偏移
+	// [FontPageInfo Pages[NumPages]]            每页 GlyphsPerPage 个字符（按码位顺序），页内容单独压缩
+	// [压缩后的页数据]
+	// 字符位图逐行排列，每行 (Width * BitsPerPixel + 7) / 8 字节，1 bpp 时高位在前。
+	// 相邻码位的字符位于同一页，使用时只解压用到的页，mmap() 后也只有用到的页面才会被载入。
+	constexpr char FontFileMagic[4] = { 'T', 'V', 'F', 'T' };
+	constexpr uint16_t FontFileVersion = 2;
+
+	struct FontFileHeader
+	{
+		char Magic[4];
+		uint16_t Version;
+		uint16_t GlyphHeight;
+		uint32_t NumGlyphs;
+		uint16_t GlyphsPerPage;
+		uint16_t BitsPerPixel;
+		uint32_t CodePointsOffset;
+		uint32_t GlyphInfosOffset;
+		uint32_t PagesOffset;
+		uint32_t PageDataOffset;
+		uint32_t FileSize;
+		uint32_t Reserved;
+	};
+
+	struct FontGlyphInfo
+	{
+		uint32_t OffsetInPage;
+		uint8_t Width;
+		uint8_t Top; // 字符上方被去掉的空白行数
+		uint8_t Rows; // 实际存储的行数
+		uint8_t Reserved;
+	};
+
+	struct FontPageInfo
+	{
+		uint32_t Offset; // 相对于压缩页数据区
+		uint32_t CompressedSize;
+		uint32_t RawSize;
+	};
+
+	static_assert(sizeof(FontFileHeader) == 40, "FontFileHeader must be packed to 40 bytes.");
+	static_assert(sizeof(FontGlyphInfo) == 8, "FontGlyphInfo must be packed to 8 bytes.");
+	static_assert(sizeof(FontPageInfo) == 12, "FontPageInfo must be packed to 12 bytes.");
+
+	// CompressedSize 等于 RawSize 的页原样存放，否则使用 PackBits 行程编码：
+	// 控制字节 n 为 0~127 时后面跟 n + 1 个原样字节；为 -127~-1 时后面的一个字节重复 1 - n 次；-128 不使用。
+	inline bool UnpackBits(const uint8_t* Src, size_t SrcSize, uint8_t* Dst, size_t DstSize)
+	{
+		size_t i = 0, o = 0;
+		while (i < SrcSize)
+		{
+			auto n = int8_t(Src[i++]);
+			if (n >= 0)
+			{
+				size_t Count = size_t(n) + 1;
+				if (i + Count > SrcSize || o + Count > DstSize) return false;
+				for (size_t k = 0; k < Count; k++) Dst[o++] = Src[i++];
+			}
+			else if (n != -128)
+			{
+				size_t Count = size_t(1 - n);
+				if (i >= SrcSize || o + Count > DstSize) return false;
+				auto Value = Src[i++];
+				for (size_t k = 0; k < Count; k++) Dst[o++] = Value;
+			}
+		}
+		return o == DstSize;
+	}
+}
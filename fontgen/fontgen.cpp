@@ -0,0 +1,375 @@
+// 字体文件生成工具，在编译主机上运行。
+// 从 `font/AllInOne.bmp`（所有字符横向排列的单色位图）以及 `font/allglyphs` `font/widthtable` 两张表生成 .tvf 字体文件。
+// 用法：fontgen [-c] [-s <num>[/<den>]] <AllInOne.bmp> <allglyphs> <widthtable> <output>
+// 指定 `-c` 时输出 C 数组初始化列表，用于把字体编译进程序作为内置字体。
+// 指定 `-s` 时按比例放大字符并平滑为 8 位覆盖率（A8），用于分辨率较高的屏幕，避免在设备上缩放字体。
+
+#include "../fontformat.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace TVOS;
+
+struct MonoBitmap
+{
+	int w = 0;
+	int h = 0;
+	std::vector<uint8_t> Pixels; // 每个像素一个字节，1 表示笔画
+
+	int GetPixel(int x, int y) const
+	{
+		return Pixels[size_t(y) * w + x];
+	}
+};
+
+static std::vector<uint8_t> ReadWholeFile(const std::string& Path)
+{
+	std::ifstream ifs(Path, std::ios::binary);
+	if (!ifs.is_open()) throw std::runtime_error(std::string("Could not open `") + Path + "`.");
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+template<typename T>
+static T ReadLE(const std::vector<uint8_t>& Data, size_t Offset)
+{
+	if (Offset + sizeof(T) > Data.size()) throw std::runtime_error("Unexpected end of the BMP file.");
+	T ret;
+	memcpy(&ret, &Data[Offset], sizeof(T));
+	return ret;
+}
+
+static MonoBitmap LoadMonoBMP(const std::string& Path)
+{
+	auto Data = ReadWholeFile(Path);
+	if (Data.size() < 62 || Data[0] != 'B' || Data[1] != 'M') throw std::runtime_error(std::string("`") + Path + "` is not a BMP file.");
+
+	auto PixelsOffset = ReadLE<uint32_t>(Data, 10);
+	auto HeaderSize = ReadLE<uint32_t>(Data, 14);
+	auto Width = ReadLE<int32_t>(Data, 18);
+	auto Height = ReadLE<int32_t>(Data, 22);
+	auto BitCount = ReadLE<uint16_t>(Data, 28);
+	auto Compression = ReadLE<uint32_t>(Data, 30);
+	if (BitCount != 1 || Compression != 0) throw std::runtime_error(std::string("`") + Path + "` must be an uncompressed 1-bit BMP file.");
+
+	// 调色板中较暗的颜色为笔画
+	auto Palette = 14 + HeaderSize;
+	int Luma[2];
+	for (int i = 0; i < 2; i++)
+	{
+		Luma[i] = int(ReadLE<uint8_t>(Data, Palette + i * 4 + 0)) + ReadLE<uint8_t>(Data, Palette + i * 4 + 1) + ReadLE<uint8_t>(Data, Palette + i * 4 + 2);
+	}
+	int InkIndex = Luma[1] < Luma[0] ? 1 : 0;
+
+	bool TopDown = Height < 0;
+	MonoBitmap ret;
+	ret.w = Width;
+	ret.h = TopDown ? -Height : Height;
+	ret.Pixels.resize(size_t(ret.w) * ret.h);
+	size_t Stride = ((size_t(ret.w) + 31) / 32) * 4;
+	if (PixelsOffset + Stride * ret.h > Data.size()) throw std::runtime_error(std::string("`") + Path + "` is truncated.");
+	for (int y = 0; y < ret.h; y++)
+	{
+		auto Row = &Data[PixelsOffset + Stride * (TopDown ? y : ret.h - 1 - y)];
+		for (int x = 0; x < ret.w; x++)
+		{
+			int Index = (Row[x / 8] >> (7 - x % 8)) & 1;
+			ret.Pixels[size_t(y) * ret.w + x] = Index == InkIndex ? 1 : 0;
+		}
+	}
+	return ret;
+}
+
+// 读取 `font/allglyphs` `font/widthtable` 这种以逗号分隔的 C 数组初始化列表
+static std::vector<uint32_t> LoadNumberTable(const std::string& Path)
+{
+	auto Data = ReadWholeFile(Path);
+	std::string Text(Data.begin(), Data.end());
+	std::vector<uint32_t> ret;
+	std::stringstream ss(Text);
+	std::string Token;
+	while (std::getline(ss, Token, ','))
+	{
+		auto Begin = Token.find_first_not_of(" \t\r\n");
+		if (Begin == std::string::npos) continue;
+		ret.push_back(uint32_t(std::stoul(Token.substr(Begin), nullptr, 0)));
+	}
+	return ret;
+}
+
+static void AppendBytes(std::vector<uint8_t>& Out, const void* Data, size_t Size)
+{
+	auto Bytes = reinterpret_cast<const uint8_t*>(Data);
+	Out.insert(Out.end(), Bytes, Bytes + Size);
+}
+
+static void AlignTo(std::vector<uint8_t>& Out, size_t Alignment)
+{
+	while (Out.size() % Alignment) Out.push_back(0);
+}
+
+// 与 `UnpackBits()` 对应的 PackBits 行程编码
+static std::vector<uint8_t> PackBits(const std::vector<uint8_t>& Src)
+{
+	std::vector<uint8_t> ret;
+	size_t i = 0, n = Src.size();
+	while (i < n)
+	{
+		size_t j = i;
+		while (j < n && j - i < 128 && Src[j] == Src[i]) j++;
+		if (j - i >= 2)
+		{
+			ret.push_back(uint8_t(int8_t(1 - int(j - i))));
+			ret.push_back(Src[i]);
+			i = j;
+			continue;
+		}
+		j = i;
+		while (j < n && j - i < 128)
+		{
+			if (j + 1 < n && Src[j] == Src[j + 1]) break;
+			j++;
+		}
+		ret.push_back(uint8_t(j - i - 1));
+		ret.insert(ret.end(), Src.begin() + i, Src.begin() + j);
+		i = j;
+	}
+	return ret;
+}
+
+static void WriteCArray(std::ostream& os, const std::vector<uint8_t>& Data)
+{
+	char buf[8];
+	for (size_t i = 0; i < Data.size(); i++)
+	{
+		snprintf(buf, sizeof buf, "0x%02x,", Data[i]);
+		os << (i % 16 ? " " : "    ") << buf;
+		if (i % 16 == 15 || i + 1 == Data.size()) os << "\n";
+	}
+}
+
+// 把一个字符放大 Num / Den 倍，输出每像素一个字节的覆盖率（0~255）。
+// 每个输出像素取 4x4 个子采样点，在原字符上做双线性插值后以 0.5 为阈值判断是否为笔画，
+// 这样放大后的斜线和圆弧边缘是平滑的，而不是一个个方块。
+static std::vector<uint8_t> ScaleGlyph(const MonoBitmap& Strip, int XPos, int Width, int Num, int Den, int OutW, int OutH)
+{
+	auto Ink = [&](int x, int y) -> double
+	{
+		if (x < 0 || y < 0 || x >= Width || y >= Strip.h) return 0;
+		return Strip.GetPixel(XPos + x, y);
+	};
+
+	constexpr int SubSamples = 4;
+	std::vector<uint8_t> ret(size_t(OutW) * OutH);
+	for (int oy = 0; oy < OutH; oy++)
+	{
+		for (int ox = 0; ox < OutW; ox++)
+		{
+			int Covered = 0;
+			for (int sy = 0; sy < SubSamples; sy++)
+			{
+				for (int sx = 0; sx < SubSamples; sx++)
+				{
+					double fx = (ox + (sx + 0.5) / SubSamples) * Den / Num - 0.5;
+					double fy = (oy + (sy + 0.5) / SubSamples) * Den / Num - 0.5;
+					int x0 = int(floor(fx)), y0 = int(floor(fy));
+					double ax = fx - x0, ay = fy - y0;
+					double v =
+						Ink(x0, y0) * (1 - ax) * (1 - ay) + Ink(x0 + 1, y0) * ax * (1 - ay) +
+						Ink(x0, y0 + 1) * (1 - ax) * ay + Ink(x0 + 1, y0 + 1) * ax * ay;
+					if (v >= 0.5) Covered++;
+				}
+			}
+			ret[size_t(oy) * OutW + ox] = uint8_t(Covered * 255 / (SubSamples * SubSamples));
+		}
+	}
+	return ret;
+}
+
+// 每页解压后的大小上限，决定 `GlyphsPerPage`
+constexpr size_t MaxRawPageSize = 4096;
+constexpr size_t MinGlyphsPerPage = 16;
+
+int main(int argc, char** argv)
+{
+	bool OutputCArray = false;
+	int ScaleNum = 1, ScaleDen = 1;
+	std::vector<const char*> Files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-c"))
+		{
+			OutputCArray = true;
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			// 缩放比例，例如 `2` 或 `3/2`
+			auto Scale = argv[++i];
+			ScaleNum = atoi(Scale);
+			auto Slash = strchr(Scale, '/');
+			ScaleDen = Slash ? atoi(Slash + 1) : 1;
+		}
+		else
+		{
+			Files.push_back(argv[i]);
+		}
+	}
+	if (Files.size() != 4 || ScaleNum <= 0 || ScaleDen <= 0)
+	{
+		std::cerr << "Usage: " << argv[0] << " [-c] [-s <num>[/<den>]] <AllInOne.bmp> <allglyphs> <widthtable> <output>\n";
+		std::cerr << "  -c  Output a C array initializer instead of a binary .tvf file.\n";
+		std::cerr << "  -s  Scale the glyphs, e.g. `-s 3/2`. Scaled fonts store 8-bit coverage (A8).\n";
+		return 1;
+	}
+	bool Scaled = ScaleNum != ScaleDen;
+
+	try
+	{
+		auto Strip = LoadMonoBMP(Files[0]);
+		auto CodePoints = LoadNumberTable(Files[1]);
+		auto Widths = LoadNumberTable(Files[2]);
+		if (CodePoints.size() != Widths.size()) throw std::runtime_error("The glyph table and the width table have different sizes.");
+
+		int GlyphHeight = (Strip.h * ScaleNum + ScaleDen / 2) / ScaleDen;
+		int BitsPerPixel = Scaled ? 8 : 1;
+		if (GlyphHeight > 255) throw std::runtime_error("Glyph too tall.");
+
+		struct GlyphInfo
+		{
+			uint32_t CodePoint;
+			int SrcWidth;
+			int XPos;
+			int Width = 0;
+			int Top = 0;
+			int Rows = 0;
+			std::vector<uint8_t> Bits; // 去掉上下空白行后的位图
+		};
+		std::vector<GlyphInfo> Glyphs;
+		int XPos = 0;
+		for (size_t i = 0; i < CodePoints.size(); i++)
+		{
+			Glyphs.push_back({ CodePoints[i], int(Widths[i]), XPos });
+			XPos += int(Widths[i]);
+		}
+		if (XPos > Strip.w) throw std::runtime_error("The glyph strip is narrower than the sum of the glyph widths.");
+		std::sort(Glyphs.begin(), Glyphs.end(), [](const GlyphInfo& a, const GlyphInfo& b) { return a.CodePoint < b.CodePoint; });
+
+		size_t MaxGlyphSize = 0;
+		for (auto& Glyph : Glyphs)
+		{
+			// 统一转换为每像素一个字节的覆盖率
+			std::vector<uint8_t> Coverage;
+			if (Scaled)
+			{
+				Glyph.Width = (Glyph.SrcWidth * ScaleNum + ScaleDen / 2) / ScaleDen;
+				Coverage = ScaleGlyph(Strip, Glyph.XPos, Glyph.SrcWidth, ScaleNum, ScaleDen, Glyph.Width, GlyphHeight);
+			}
+			else
+			{
+				Glyph.Width = Glyph.SrcWidth;
+				Coverage.resize(size_t(Glyph.Width) * GlyphHeight);
+				for (int y = 0; y < GlyphHeight; y++)
+				{
+					for (int x = 0; x < Glyph.Width; x++) Coverage[size_t(y) * Glyph.Width + x] = Strip.GetPixel(Glyph.XPos + x, y) ? 255 : 0;
+				}
+			}
+			if (Glyph.Width > 255) throw std::runtime_error("Glyph too wide.");
+
+			auto RowIsBlank = [&](int y)
+			{
+				for (int x = 0; x < Glyph.Width; x++) if (Coverage[size_t(y) * Glyph.Width + x]) return false;
+				return true;
+			};
+			int Top = 0, Bottom = GlyphHeight;
+			while (Top < Bottom && RowIsBlank(Top)) Top++;
+			while (Bottom > Top && RowIsBlank(Bottom - 1)) Bottom--;
+			Glyph.Top = Top;
+			Glyph.Rows = Bottom - Top;
+
+			size_t RowBytes = (size_t(Glyph.Width) * BitsPerPixel + 7) / 8;
+			Glyph.Bits.resize(RowBytes * Glyph.Rows);
+			for (int y = 0; y < Glyph.Rows; y++)
+			{
+				auto Src = &Coverage[size_t(Top + y) * Glyph.Width];
+				auto Dst = &Glyph.Bits[RowBytes * y];
+				for (int x = 0; x < Glyph.Width; x++)
+				{
+					if (BitsPerPixel == 8) Dst[x] = Src[x];
+					else if (Src[x] >= 128) Dst[x / 8] |= uint8_t(0x80 >> (x % 8));
+				}
+			}
+			MaxGlyphSize = std::max(MaxGlyphSize, RowBytes * GlyphHeight);
+		}
+
+		FontFileHeader Header = {};
+		memcpy(Header.Magic, FontFileMagic, sizeof FontFileMagic);
+		Header.Version = FontFileVersion;
+		Header.GlyphHeight = uint16_t(GlyphHeight);
+		Header.NumGlyphs = uint32_t(Glyphs.size());
+		Header.GlyphsPerPage = uint16_t(std::min<size_t>(256, std::max(MinGlyphsPerPage, MaxRawPageSize / MaxGlyphSize)));
+		Header.BitsPerPixel = uint16_t(BitsPerPixel);
+		std::vector<FontGlyphInfo> GlyphInfos;
+		std::vector<FontPageInfo> Pages;
+		std::vector<uint8_t> PageData;
+		size_t RawTotal = 0;
+		for (size_t First = 0; First < Glyphs.size(); First += Header.GlyphsPerPage)
+		{
+			std::vector<uint8_t> RawPage;
+			for (size_t i = First; i < Glyphs.size() && i < First + Header.GlyphsPerPage; i++)
+			{
+				auto& Glyph = Glyphs[i];
+				GlyphInfos.push_back({ uint32_t(RawPage.size()), uint8_t(Glyph.Width), uint8_t(Glyph.Top), uint8_t(Glyph.Rows), 0 });
+				RawPage.insert(RawPage.end(), Glyph.Bits.begin(), Glyph.Bits.end());
+			}
+			auto Packed = PackBits(RawPage);
+			if (Packed.size() >= RawPage.size()) Packed = RawPage; // 压缩后反而更大的页原样存放
+			Pages.push_back({ uint32_t(PageData.size()), uint32_t(Packed.size()), uint32_t(RawPage.size()) });
+			PageData.insert(PageData.end(), Packed.begin(), Packed.end());
+			RawTotal += RawPage.size();
+		}
+
+		std::vector<uint8_t> Out;
+		AppendBytes(Out, &Header, sizeof Header);
+		Header.CodePointsOffset = uint32_t(Out.size());
+		for (auto& Glyph : Glyphs) AppendBytes(Out, &Glyph.CodePoint, 4);
+		Header.GlyphInfosOffset = uint32_t(Out.size());
+		AppendBytes(Out, GlyphInfos.data(), GlyphInfos.size() * sizeof(FontGlyphInfo));
+		Header.PagesOffset = uint32_t(Out.size());
+		AppendBytes(Out, Pages.data(), Pages.size() * sizeof(FontPageInfo));
+		AlignTo(Out, 4);
+		Header.PageDataOffset = uint32_t(Out.size());
+		AppendBytes(Out, PageData.data(), PageData.size());
+		AlignTo(Out, 4);
+		Header.FileSize = uint32_t(Out.size());
+		memcpy(&Out[0], &Header, sizeof Header);
+
+		std::ofstream ofs(Files[3], std::ios::binary);
+		if (!ofs.is_open()) throw std::runtime_error(std::string("Could not create `") + Files[3] + "`.");
+		if (OutputCArray)
+		{
+			WriteCArray(ofs, Out);
+		}
+		else
+		{
+			ofs.write(reinterpret_cast<const char*>(Out.data()), Out.size());
+		}
+		std::cout << "[INFO] Wrote `" << Files[3] << "`: " << Glyphs.size() << " glyphs in " << Pages.size() << " pages, height " << GlyphHeight << ", " << BitsPerPixel << " bpp, " <<
+			RawTotal << " bytes of bitmaps packed into " << PageData.size() << " bytes, " << Out.size() << " bytes in total.\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "[ERROR] " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -28,6 +28,11 @@ bool GPIO_PeriphType::ReadBit(int Port) const
 	return (ReadPeriph(&DATA) & (1 << Port)) ? true : false;
 }
 
+uint32_t GPIO_PeriphType::ReadBits() const
+{
+	return ReadPeriph(&DATA);
+}
+
 void GPIO_PeriphType::WriteBit(int Port, bool Value)
 {
 	uint32_t Bit = 1 << Port;
@@ -74,30 +79,67 @@ void GPIO_PeriphType::SetMode(int Port, uint32_t Mode)
 	}
 }
 
-void GPIO_PeriphType::WritePeriph(volatile uint32_t* Ptr, uint32_t Data)
+GPIO_MappingType::GPIO_MappingType()
 {
 #if !defined(_MSC_VER)
-	const uint32_t MapSize = getpagesize();
-	const uint32_t MapMask = MapSize - 1;
-	volatile uint32_t* VirtAddr = nullptr;
-	uint32_t Addr = uint32_t(reinterpret_cast<size_t>(Ptr));
-	uint32_t* MapPtr = nullptr;
+	// 所有端口的寄存器都在 GPIO_Periph 所在的这一页里
+	MapSize = size_t(getpagesize());
+	MapPhysAddr = reinterpret_cast<size_t>(GPIO_Periph) & ~(MapSize - 1);
 
-	int MemFD = open("/dev/mem", O_RDWR | O_SYNC);
-	if (MemFD == -1) goto NotAbleToMap;
+	MemFD = open("/dev/mem", O_RDWR | O_SYNC);
+	if (MemFD == -1)
+	{
+		perror("open(/dev/mem)");
+		return;
+	}
+	auto MapPtr = mmap(0, MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, MemFD, off_t(MapPhysAddr));
+	if (MapPtr == MAP_FAILED)
+	{
+		perror("mmap(/dev/mem)");
+		close(MemFD);
+		MemFD = -1;
+		return;
+	}
+	MapBase = reinterpret_cast<volatile uint8_t*>(MapPtr);
+#endif
+}
 
-	MapPtr = (uint32_t*)mmap(0, MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, MemFD, Addr & ~MapMask);
-	if (MapPtr == (uint32_t*)-1) goto NotAbleToMap;
+GPIO_MappingType::~GPIO_MappingType()
+{
+#if !defined(_MSC_VER)
+	if (MapBase) munmap(const_cast<uint8_t*>(MapBase), MapSize);
+	if (MemFD != -1) close(MemFD);
+#endif
+}
 
-	VirtAddr = reinterpret_cast<volatile uint32_t*>(reinterpret_cast<char *>(MapPtr) + (Addr & MapMask));
-	*VirtAddr = Data;
+GPIO_MappingType& GPIO_MappingType::Get()
+{
+	static GPIO_MappingType Mapping;
+	return Mapping;
+}
 
-	munmap(MapPtr, MapSize);
-	close(MemFD);
-	return;
+bool GPIO_MappingType::IsMapped() const
+{
+	return MapBase != nullptr;
+}
+
+volatile uint32_t* GPIO_MappingType::Translate(const volatile uint32_t* PhysPtr) const
+{
+	auto Addr = reinterpret_cast<size_t>(PhysPtr);
+	if (!MapBase || Addr < MapPhysAddr || Addr + sizeof(uint32_t) > MapPhysAddr + MapSize) return nullptr;
+	return reinterpret_cast<volatile uint32_t*>(MapBase + (Addr - MapPhysAddr));
+}
+
+void GPIO_PeriphType::WritePeriph(volatile uint32_t* Ptr, uint32_t Data)
+{
+#if !defined(_MSC_VER)
+	auto VirtAddr = GPIO_MappingType::Get().Translate(Ptr);
+	if (VirtAddr)
+	{
+		*VirtAddr = Data;
+		return;
+	}
 
-NotAbleToMap:
-	if (MemFD != -1) close(MemFD);
 	char cmd[1024];
 	snprintf(cmd, sizeof(cmd), "devmem 0x%08x 32 0x%08x", uint32_t(reinterpret_cast<size_t>(Ptr)), Data);
 	system(cmd);
@@ -107,28 +149,9 @@ NotAbleToMap:
 uint32_t GPIO_PeriphType::ReadPeriph(const volatile uint32_t* Ptr)
 {
 #if !defined(_MSC_VER)
-	const uint32_t MapSize = getpagesize();
-	const uint32_t MapMask = MapSize - 1;
-	volatile uint32_t* VirtAddr = nullptr;
-	uint32_t Addr = uint32_t(reinterpret_cast<size_t>(Ptr));
-	uint32_t* MapPtr = nullptr;
-	uint32_t Data = 0;
-
-	int MemFD = open("/dev/mem", O_RDONLY | O_SYNC);
-	if (MemFD == -1) goto NotAbleToMap;
-
-	MapPtr = (uint32_t*)mmap(0, MapSize, PROT_READ, MAP_SHARED, MemFD, Addr & ~MapMask);
-	if (MapPtr == (uint32_t*)-1) goto NotAbleToMap;
-
-	VirtAddr = reinterpret_cast<volatile uint32_t*>(reinterpret_cast<char*>(MapPtr) + (Addr & MapMask));
-	Data = *VirtAddr;
-
-	munmap(MapPtr, MapSize);
-	close(MemFD);
-	return Data;
+	auto VirtAddr = GPIO_MappingType::Get().Translate(Ptr);
+	if (VirtAddr) return *VirtAddr;
 
-NotAbleToMap:
-	if (MemFD != -1) close(MemFD);
 	char cmd[1024];
 	snprintf(cmd, sizeof(cmd), "devmem 0x%08x", uint32_t(reinterpret_cast<size_t>(Ptr)));
 	FILE* fp = popen(cmd, "r");
@@ -232,3 +255,8 @@ bool ReadGPIOF(int Port)
 	GPIO_Periph[GPIO_F].SetModeIn(Port);
 	return GPIO_Periph[GPIO_F].ReadBit(Port);
 }
+
+uint32_t ReadGPIOPins(GPIO_GroupEnumType Group, uint32_t Mask)
+{
+	return GPIO_Periph[Group].ReadBits() & Mask;
+}
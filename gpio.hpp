@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 struct GPIO_PeriphType
@@ -15,6 +16,7 @@ struct GPIO_PeriphType
 	volatile uint32_t PUL1;
 
 	bool ReadBit(int Port) const;
+	uint32_t ReadBits() const; // 一次读取 DATA 寄存器，第 n 位是第 n 个引脚的电平
 	void WriteBit(int Port, bool Value);
 
 	void SetModeIn(int Port);
@@ -30,6 +32,31 @@ protected:
 
 GPIO_PeriphType * const GPIO_Periph = reinterpret_cast<GPIO_PeriphType * const>(0x01C20800);
 
+// GPIO 寄存器所在物理页的映射。第一次访问寄存器时打开 /dev/mem 映射一次，之后一直保留，
+// 每次访问寄存器只是一次读写。映射失败时 `GPIO_PeriphType` 退回到调用 devmem 命令。
+class GPIO_MappingType
+{
+protected:
+	int MemFD = -1;
+	volatile uint8_t* MapBase = nullptr;
+	size_t MapPhysAddr = 0;
+	size_t MapSize = 0;
+
+	GPIO_MappingType();
+
+public:
+	~GPIO_MappingType();
+	GPIO_MappingType(const GPIO_MappingType&) = delete;
+	GPIO_MappingType& operator = (const GPIO_MappingType&) = delete;
+
+	static GPIO_MappingType& Get();
+
+	bool IsMapped() const;
+
+	// 将寄存器的物理地址转换为映射后的地址，不在映射范围内时返回 nullptr
+	volatile uint32_t* Translate(const volatile uint32_t* PhysPtr) const;
+};
+
 enum GPIO_GroupEnumType
 {
 	GPIO_A = 0,
@@ -53,3 +80,6 @@ bool ReadGPIOC(int Port);
 bool ReadGPIOD(int Port);
 bool ReadGPIOE(int Port);
 bool ReadGPIOF(int Port);
+
+// 一次读取整个端口，返回 Mask 中各引脚的电平
+uint32_t ReadGPIOPins(GPIO_GroupEnumType Group, uint32_t Mask);
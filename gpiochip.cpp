@@ -0,0 +1,300 @@
+#include "gpiochip.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#endif
+
+#if !defined(_MSC_VER) && defined(GPIO_V2_GET_LINE_IOCTL)
+#define GPIO_HAS_V2_UAPI 1
+#endif
+#if !defined(_MSC_VER) && defined(GPIO_GET_LINEEVENT_IOCTL)
+#define GPIO_HAS_V1_UAPI 1
+#endif
+
+GPIO_ChipLines::~GPIO_ChipLines()
+{
+	Close();
+}
+
+bool GPIO_ChipLines::Open(const std::string& ChipPath, const std::vector<uint32_t>& Offsets, uint32_t DebounceUs, const std::string& Consumer)
+{
+	Close();
+#if defined(GPIO_HAS_V2_UAPI) || defined(GPIO_HAS_V1_UAPI)
+	if (Offsets.empty() || Offsets.size() > 32) return false;
+
+	int ChipFD = open(ChipPath.c_str(), O_RDWR | O_CLOEXEC);
+	if (ChipFD == -1)
+	{
+		perror(("open(" + ChipPath + ")").c_str());
+		return false;
+	}
+	// 头文件有 v2 接口而运行的内核没有时，ioctl 失败，再试 v1
+	bool Opened = RequestV2(ChipFD, ChipPath, Offsets, DebounceUs, Consumer) || RequestV1(ChipFD, ChipPath, Offsets, Consumer);
+	close(ChipFD); // 请求到的线有自己的文件描述符，不再需要 chip
+	if (!Opened) return false;
+	this->Offsets = Offsets;
+	return true;
+#else
+	(void)ChipPath; (void)Offsets; (void)DebounceUs; (void)Consumer;
+	return false;
+#endif
+}
+
+bool GPIO_ChipLines::RequestV2(int ChipFD, const std::string& ChipPath, const std::vector<uint32_t>& Offsets, uint32_t DebounceUs, const std::string& Consumer)
+{
+#if defined(GPIO_HAS_V2_UAPI)
+	gpio_v2_line_request Request;
+	memset(&Request, 0, sizeof Request);
+	for (size_t i = 0; i < Offsets.size(); i++) Request.offsets[i] = Offsets[i];
+	strncpy(Request.consumer, Consumer.c_str(), sizeof Request.consumer - 1);
+	Request.num_lines = uint32_t(Offsets.size());
+	Request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	if (DebounceUs)
+	{
+		auto& Attr = Request.config.attrs[Request.config.num_attrs++];
+		Attr.attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+		Attr.attr.debounce_period_us = DebounceUs;
+		Attr.mask = (uint64_t(1) << Offsets.size()) - 1;
+	}
+
+	if (ioctl(ChipFD, GPIO_V2_GET_LINE_IOCTL, &Request) == -1)
+	{
+		if (errno == ENOTTY) return false; // 内核没有 v2 接口，不算错误
+		fprintf(stderr, "%s: GPIO_V2_GET_LINE_IOCTL on %s failed: %s\n", __func__, ChipPath.c_str(), strerror(errno));
+		return false;
+	}
+	LinesFD = Request.fd;
+	return true;
+#else
+	(void)ChipFD; (void)ChipPath; (void)Offsets; (void)DebounceUs; (void)Consumer;
+	return false;
+#endif
+}
+
+bool GPIO_ChipLines::RequestV1(int ChipFD, const std::string& ChipPath, const std::vector<uint32_t>& Offsets, const std::string& Consumer)
+{
+#if defined(GPIO_HAS_V1_UAPI)
+	LinesFD = epoll_create1(EPOLL_CLOEXEC);
+	if (LinesFD == -1)
+	{
+		perror("epoll_create1()");
+		return false;
+	}
+	for (size_t i = 0; i < Offsets.size(); i++)
+	{
+		gpioevent_request Request;
+		memset(&Request, 0, sizeof Request);
+		Request.lineoffset = Offsets[i];
+		Request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+		Request.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+		strncpy(Request.consumer_label, Consumer.c_str(), sizeof Request.consumer_label - 1);
+		if (ioctl(ChipFD, GPIO_GET_LINEEVENT_IOCTL, &Request) == -1)
+		{
+			fprintf(stderr, "%s: GPIO_GET_LINEEVENT_IOCTL for line %u on %s failed: %s\n", __func__, Offsets[i], ChipPath.c_str(), strerror(errno));
+			Close();
+			return false;
+		}
+		EventFDs.push_back(Request.fd);
+
+		epoll_event Event;
+		memset(&Event, 0, sizeof Event);
+		Event.events = EPOLLIN;
+		Event.data.u32 = uint32_t(i);
+		if (epoll_ctl(LinesFD, EPOLL_CTL_ADD, Request.fd, &Event) == -1)
+		{
+			perror("epoll_ctl()");
+			Close();
+			return false;
+		}
+	}
+	return true;
+#else
+	(void)ChipFD; (void)ChipPath; (void)Offsets; (void)Consumer;
+	return false;
+#endif
+}
+
+void GPIO_ChipLines::Close()
+{
+#if !defined(_MSC_VER)
+	for (auto fd : EventFDs) close(fd);
+	if (LinesFD != -1) close(LinesFD);
+#endif
+	EventFDs.clear();
+	LinesFD = -1;
+	Offsets.clear();
+}
+
+bool GPIO_ChipLines::IsOpen() const
+{
+	return LinesFD != -1;
+}
+
+int GPIO_ChipLines::GetFD() const
+{
+	return LinesFD;
+}
+
+size_t GPIO_ChipLines::GetLineCount() const
+{
+	return Offsets.size();
+}
+
+uint32_t GPIO_ChipLines::ReadValues() const
+{
+	if (LinesFD == -1) return 0;
+#if defined(GPIO_HAS_V1_UAPI)
+	if (!EventFDs.empty())
+	{
+		uint32_t Bits = 0;
+		for (size_t i = 0; i < EventFDs.size(); i++)
+		{
+			gpiohandle_data Data;
+			memset(&Data, 0, sizeof Data);
+			if (ioctl(EventFDs[i], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &Data) == 0 && Data.values[0]) Bits |= uint32_t(1) << i;
+		}
+		return Bits;
+	}
+#endif
+#if defined(GPIO_HAS_V2_UAPI)
+	gpio_v2_line_values Values;
+	memset(&Values, 0, sizeof Values);
+	Values.mask = (uint64_t(1) << Offsets.size()) - 1;
+	if (ioctl(LinesFD, GPIO_V2_LINE_GET_VALUES_IOCTL, &Values) == -1) return 0;
+	return uint32_t(Values.bits);
+#else
+	return 0;
+#endif
+}
+
+size_t GPIO_ChipLines::WaitEvents(std::vector<GPIO_LineEvent>& Events, int TimeoutMs)
+{
+#if !defined(_MSC_VER)
+	if (LinesFD == -1) return 0;
+	pollfd pfd = { LinesFD, POLLIN, 0 };
+	int ret;
+	do ret = poll(&pfd, 1, TimeoutMs);
+	while (ret == -1 && errno == EINTR);
+	if (ret <= 0) return 0;
+	return ReadEvents(Events);
+#else
+	(void)Events; (void)TimeoutMs;
+	return 0;
+#endif
+}
+
+#if defined(GPIO_HAS_V1_UAPI)
+// 内核 5.7 以前 v1 接口的事件时间是 CLOCK_REALTIME，之后是 CLOCK_MONOTONIC。离哪个时钟的当前时间近就是哪个，统一换算成 CLOCK_MONOTONIC
+static uint64_t ToMonotonicNs(uint64_t TimestampNs)
+{
+	auto Now = [](clockid_t Clock)
+	{
+		timespec ts;
+		clock_gettime(Clock, &ts);
+		return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	};
+	int64_t Monotonic = Now(CLOCK_MONOTONIC);
+	int64_t Realtime = Now(CLOCK_REALTIME);
+	int64_t Timestamp = int64_t(TimestampNs);
+	if (std::abs(Timestamp - Realtime) < std::abs(Timestamp - Monotonic)) Timestamp += Monotonic - Realtime;
+	return uint64_t(Timestamp);
+}
+#endif
+
+size_t GPIO_ChipLines::ReadEvents(std::vector<GPIO_LineEvent>& Events)
+{
+	if (LinesFD == -1) return 0;
+	auto First = Events.size();
+#if defined(GPIO_HAS_V1_UAPI)
+	if (!EventFDs.empty())
+	{
+		for (size_t i = 0; i < EventFDs.size(); i++)
+		{
+			while (true)
+			{
+				// 读之前确认有数据，这样不需要把文件描述符设为非阻塞
+				pollfd pfd = { EventFDs[i], POLLIN, 0 };
+				if (poll(&pfd, 1, 0) <= 0) break;
+
+				gpioevent_data Buffer[16];
+				auto Bytes = read(EventFDs[i], Buffer, sizeof Buffer);
+				if (Bytes <= 0) break;
+				for (size_t j = 0; j < size_t(Bytes) / sizeof Buffer[0]; j++)
+				{
+					GPIO_LineEvent Event;
+					Event.Index = i;
+					Event.Offset = Offsets[i];
+					Event.Rising = Buffer[j].id == GPIOEVENT_EVENT_RISING_EDGE;
+					Event.TimestampNs = ToMonotonicNs(Buffer[j].timestamp);
+					Events.push_back(Event);
+				}
+			}
+		}
+		// 各条线分开读，按时间合并成一个序列
+		std::stable_sort(Events.begin() + First, Events.end(), [](const GPIO_LineEvent& a, const GPIO_LineEvent& b) { return a.TimestampNs < b.TimestampNs; });
+		return Events.size() - First;
+	}
+#endif
+#if defined(GPIO_HAS_V2_UAPI)
+	while (true)
+	{
+		pollfd pfd = { LinesFD, POLLIN, 0 };
+		if (poll(&pfd, 1, 0) <= 0) break;
+
+		gpio_v2_line_event Buffer[16];
+		auto Bytes = read(LinesFD, Buffer, sizeof Buffer);
+		if (Bytes <= 0) break;
+		for (size_t i = 0; i < size_t(Bytes) / sizeof Buffer[0]; i++)
+		{
+			GPIO_LineEvent Event;
+			Event.Offset = Buffer[i].offset;
+			Event.Rising = Buffer[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+			Event.TimestampNs = Buffer[i].timestamp_ns;
+			for (size_t j = 0; j < Offsets.size(); j++)
+			{
+				if (Offsets[j] == Event.Offset) Event.Index = j;
+			}
+			Events.push_back(Event);
+		}
+	}
+#else
+	(void)Events;
+#endif
+	return Events.size() - First;
+}
+
+std::string GPIO_ChipLines::FindChipByLabel(const std::string& Label)
+{
+#if !defined(_MSC_VER)
+	for (int i = 0; i < 64; i++)
+	{
+		auto Path = "/dev/gpiochip" + std::to_string(i);
+		int fd = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			if (errno == ENOENT) continue;
+			break;
+		}
+		gpiochip_info Info;
+		memset(&Info, 0, sizeof Info);
+		bool Found = ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &Info) == 0 && Label == Info.label;
+		close(fd);
+		if (Found) return Path;
+	}
+#else
+	(void)Label;
+#endif
+	return "";
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 一次电平变化事件
+struct GPIO_LineEvent
+{
+	size_t Index = 0; // 在请求的线中的序号
+	uint32_t Offset = 0; // 在 gpiochip 上的线号
+	bool Rising = false;
+	uint64_t TimestampNs = 0; // 内核记录的时间（CLOCK_MONOTONIC），不受用户程序调度延迟的影响
+};
+
+// 通过 GPIO 字符设备（/dev/gpiochipN）请求若干条输入线并接收双边沿事件。
+// 按键按下时内核立即记录事件，`WaitEvents()` 在 poll() 里等待，响应时间只取决于调度，不取决于轮询间隔。
+// 在开发机上可以用 gpio-sim 模块测试：在 configfs 里建立一个模拟的 chip，
+// 用 `FindChipByLabel()` 找到它的设备文件，再写 sysfs 的 `pull` 属性模拟按键。
+// 优先用 v2 接口（内核 5.10 起）一次请求所有的线；内核或工具链的头文件没有 v2 接口时用 v1 接口（内核 4.8 起），
+// 每条线一个事件描述符，放进一个 epoll 里，对外仍然只有一个描述符。v1 接口不支持内核消抖。
+class GPIO_ChipLines
+{
+protected:
+	int LinesFD = -1; // v2：请求到的线；v1：包含 `EventFDs` 的 epoll
+	std::vector<int> EventFDs; // v1：每条线的事件描述符，与 `Offsets` 一一对应
+	std::vector<uint32_t> Offsets;
+
+	bool RequestV2(int ChipFD, const std::string& ChipPath, const std::vector<uint32_t>& Offsets, uint32_t DebounceUs, const std::string& Consumer);
+	bool RequestV1(int ChipFD, const std::string& ChipPath, const std::vector<uint32_t>& Offsets, const std::string& Consumer);
+
+public:
+	GPIO_ChipLines() = default;
+	~GPIO_ChipLines();
+	GPIO_ChipLines(const GPIO_ChipLines&) = delete;
+	GPIO_ChipLines& operator = (const GPIO_ChipLines&) = delete;
+
+	// 请求 Chip 上的 Offsets 这些线作为输入。DebounceUs 不为 0 时请内核消抖。
+	bool Open(const std::string& ChipPath, const std::vector<uint32_t>& Offsets, uint32_t DebounceUs = 0, const std::string& Consumer = "tvos");
+	void Close();
+	bool IsOpen() const;
+	int GetFD() const; // 有事件时可读，可交给 poll() 或 epoll
+	size_t GetLineCount() const;
+
+	// 当前电平，第 i 位对应第 i 条请求的线
+	uint32_t ReadValues() const;
+
+	// 等待事件直到超时（毫秒，负数为一直等待），将读到的事件追加到 Events，返回读到的个数
+	size_t WaitEvents(std::vector<GPIO_LineEvent>& Events, int TimeoutMs);
+
+	// 读取所有已经到达的事件，不等待
+	size_t ReadEvents(std::vector<GPIO_LineEvent>& Events);
+
+	// 按标签查找 gpiochip，例如 gpio-sim 的 "gpio-sim.0-node0"，找不到时返回空字符串
+	static std::string FindChipByLabel(const std::string& Label);
+};
@@ -27,6 +27,18 @@ namespace TVOS
 		cb = int(c & 0x000000FF) >>  0;
 	}
 
+	uint32_t BlendColor(uint32_t c1, uint32_t c2, int Alpha)
+	{
+		if (Alpha <= 0) return c1;
+		if (Alpha >= 255) return c2;
+		// ARMv5 没有除法指令，用定点运算：Alpha 换算到 0~256，隔一个通道放在一起相乘，每个像素四次乘法
+		uint32_t a = uint32_t(Alpha + (Alpha >> 7));
+		uint32_t na = 256 - a;
+		uint32_t rb = (((c1 & 0x00FF00FF) * na + (c2 & 0x00FF00FF) * a + 0x00800080) >> 8) & 0x00FF00FF;
+		uint32_t ag = (((c1 >> 8) & 0x00FF00FF) * na + ((c2 >> 8) & 0x00FF00FF) * a + 0x00800080) & 0xFF00FF00;
+		return rb | ag;
+	}
+
 	ImageBlock::ImageBlock(int width, int height) :
 		w(width),
 		h(height)
@@ -127,6 +139,76 @@ namespace TVOS
 		return true;
 	}
 
+	bool Graphics::PreFitClipXYRB(int& x, int& y, int& r, int& b) const
+	{
+		if (!PreFitXYRB(x, y, r, b)) return false;
+		if (x < ClipX) x = ClipX;
+		if (y < ClipY) y = ClipY;
+		if (r > ClipR) r = ClipR;
+		if (b > ClipB) b = ClipB;
+		return x <= r && y <= b;
+	}
+
+	bool Graphics::ClipImageArea(const ImageBlock& ib, int& x, int& y, int& w, int& h, int& srcx, int& srcy) const
+	{
+		int cx, cy, cr, cb;
+		if (!GetClipRect(cx, cy, cr, cb)) return false;
+		if (x < cx)
+		{
+			srcx += cx - x;
+			w -= cx - x;
+			x = cx;
+		}
+		if (y < cy)
+		{
+			srcy += cy - y;
+			h -= cy - y;
+			y = cy;
+		}
+		if (srcx >= ib.w || srcy >= ib.h) return false;
+		if (x + w > cr + 1) w = cr + 1 - x;
+		if (y + h > cb + 1) h = cb + 1 - y;
+		int srcw = ib.w - srcx;
+		int srch = ib.h - srcy;
+		w = w > srcw ? srcw : w;
+		h = h > srch ? srch : h;
+		return w > 0 && h > 0;
+	}
+
+	void Graphics::SetClipRect(int x, int y, int r, int b)
+	{
+		ClipX = x;
+		ClipY = y;
+		ClipR = r;
+		ClipB = b;
+	}
+
+	bool Graphics::IntersectClipRect(int x, int y, int r, int b)
+	{
+		if (ClipX < x) ClipX = x;
+		if (ClipY < y) ClipY = y;
+		if (ClipR > r) ClipR = r;
+		if (ClipB > b) ClipB = b;
+		return ClipX <= ClipR && ClipY <= ClipB;
+	}
+
+	void Graphics::ResetClipRect()
+	{
+		ClipX = 0;
+		ClipY = 0;
+		ClipR = INT_MAX;
+		ClipB = INT_MAX;
+	}
+
+	bool Graphics::GetClipRect(int& x, int& y, int& r, int& b) const
+	{
+		x = ClipX > 0 ? ClipX : 0;
+		y = ClipY > 0 ? ClipY : 0;
+		r = ClipR < Width - 1 ? ClipR : Width - 1;
+		b = ClipB < Height - 1 ? ClipB : Height - 1;
+		return x <= r && y <= b;
+	}
+
 	ImageBlock Graphics::ReadPixelsRect(int x, int y, int r, int b)
 	{
 		ImageBlock ret;
@@ -322,6 +404,7 @@ namespace TVOS
 
 	void Graphics::WriteData(const uint32_t* pixels, int Count)
 	{
+		PixelsWritten += Count;
 		if (BackBufferMode)
 		{
 			auto* Buffer = BackBuffer.get();
@@ -345,6 +428,8 @@ namespace TVOS
 
 	void Graphics::PutPixel(int x, int y, uint32_t color)
 	{
+		int r = x, b = y;
+		if (!PreFitClipXYRB(x, y, r, b) || r != x || b != y) return;
 		SetDrawPos(x, y);
 		WriteData(color, 1);
 	}
@@ -359,6 +444,7 @@ namespace TVOS
 		std::vector<uint32_t> ret;
 		if (x + count > Width) count = Width - x;
 		if (count <= 0) return ret;
+		PixelsRead += count;
 		SetReadPos(x, y);
 		if (BackBufferMode)
 		{
@@ -414,6 +500,54 @@ namespace TVOS
 		}
 	}
 
+	bool Graphics::FrontBufferRowDiffers(int y, uint32_t color)
+	{
+		if (y < 0 || y >= Height) return false;
+		auto WasBackBufferMode = BackBufferMode;
+		BackBufferMode = false;
+		auto Row = ReadPixelsRow(0, y, Width);
+		BackBufferMode = WasBackBufferMode;
+		for (auto Pixel : Row)
+		{
+			if ((Pixel ^ color) & 0xFFFFFF) return true;
+		}
+		return false;
+	}
+
+	void Graphics::MarkDirty(int x, int y, int r, int b)
+	{
+		if (!PreFitXYRB(x, y, r, b)) return;
+		if (!HasDirtyRect)
+		{
+			DirtyX = x;
+			DirtyY = y;
+			DirtyR = r;
+			DirtyB = b;
+			HasDirtyRect = true;
+			return;
+		}
+		if (DirtyX > x) DirtyX = x;
+		if (DirtyY > y) DirtyY = y;
+		if (DirtyR < r) DirtyR = r;
+		if (DirtyB < b) DirtyB = b;
+	}
+
+	void Graphics::RefreshDirtyRect()
+	{
+		if (!HasDirtyRect) return;
+		HasDirtyRect = false;
+		if (BackBufferMode)
+		{
+			if (Verbose)
+			{
+				std::cout << "[INFO] Refreshing dirty rectangle: x=" << DirtyX << ", y=" << DirtyY << ", r=" << DirtyR << ", b=" << DirtyB << ".\n";
+			}
+			SetFrontBufferMode();
+			DrawImage(*BackBuffer, DirtyX, DirtyY, DirtyR + 1 - DirtyX, DirtyB + 1 - DirtyY, DirtyX, DirtyY);
+			SetBackBufferMode();
+		}
+	}
+
 	void Graphics::DrawVLine(int x, int y1, int y2, uint32_t color)
 	{
 		FillRect(x, y1, x, y2, color);
@@ -471,8 +605,8 @@ namespace TVOS
 
 	void Graphics::FillRect(int x, int y, int r, int b, uint32_t color)
 	{
-		int w, h;
-		if (!PreFitAreaGetWH(x, y, r, b, w, h)) return;
+		if (!PreFitClipXYRB(x, y, r, b)) return;
+		int w = r + 1 - x;
 
 		for(int iy = y; iy <= b; iy ++)
 		{
@@ -488,7 +622,7 @@ namespace TVOS
 
 	void Graphics::FillRectXor(int x, int y, int r, int b)
 	{
-		if (!PreFitXYRB(x, y, r, b)) return;
+		if (!PreFitClipXYRB(x, y, r, b)) return;
 
 		auto ImageSrc = ReadPixelsRect(x, y, r, b).InvertPixelColors();
 		DrawImage(ImageSrc, x, y);
@@ -496,7 +630,7 @@ namespace TVOS
 
 	void Graphics::FillRectXor(int x, int y, int r, int b, uint32_t color)
 	{
-		if (!PreFitXYRB(x, y, r, b)) return;
+		if (!PreFitClipXYRB(x, y, r, b)) return;
 
 		auto ImageSrc = ReadPixelsRect(x, y, r, b);
 		for (auto& Pix : ImageSrc.Pixels) { Pix ^= color; }
@@ -505,7 +639,7 @@ namespace TVOS
 
 	void Graphics::FillRectAnd(int x, int y, int r, int b, uint32_t color)
 	{
-		if (!PreFitXYRB(x, y, r, b)) return;
+		if (!PreFitClipXYRB(x, y, r, b)) return;
 
 		auto ImageSrc = ReadPixelsRect(x, y, r, b);
 		for (auto& Pix : ImageSrc.Pixels) { Pix &= color; }
@@ -514,7 +648,7 @@ namespace TVOS
 
 	void Graphics::FillRectOr(int x, int y, int r, int b, uint32_t color)
 	{
-		if (!PreFitXYRB(x, y, r, b)) return;
+		if (!PreFitClipXYRB(x, y, r, b)) return;
 
 		auto ImageSrc = ReadPixelsRect(x, y, r, b);
 		for (auto& Pix : ImageSrc.Pixels) { Pix |= color; }
@@ -530,22 +664,24 @@ namespace TVOS
 			std::cout << "[INFO] Drawing image 0x" << std::hex << size_t(&ib) << std::dec << " at x=" << x << ", y=" << y << ", w=" << w << ", h=" << h << ", srcx=" << srcx << ", srcy=" << srcy << ", ops=" << ops << ".\n";
 		}
 
+		// 先裁剪，只读回真正要写入的区域
+		if (!ClipImageArea(ib, x, y, w, h, srcx, srcy)) return;
 		auto ImageSrc = ReadPixels(x, y, w, h);
-		for(int y = 0; y < ImageSrc.h; y++)
+		for(int iy = 0; iy < ImageSrc.h; iy++)
 		{
-			if (y >= ib.h) break;
-			for(int x = 0; x < ImageSrc.w; x++)
+			auto Dst = &ImageSrc.Pixels[size_t(iy) * ImageSrc.w];
+			auto Src = &ib.Pixels[size_t(iy + srcy) * ib.w + srcx];
+			for(int ix = 0; ix < ImageSrc.w; ix++)
 			{
-				if (x >= ib.w) break;
 				switch(ops)
 				{
-				case 1:  ImageSrc.Pixels[y * ImageSrc.w + x] &= ib.Pixels[y * ib.w + x]; break;
-				case 2:  ImageSrc.Pixels[y * ImageSrc.w + x] |= ib.Pixels[y * ib.w + x]; break;
-				case 3:  ImageSrc.Pixels[y * ImageSrc.w + x] ^= ib.Pixels[y * ib.w + x]; break;
+				case 1:  Dst[ix] &= Src[ix]; break;
+				case 2:  Dst[ix] |= Src[ix]; break;
+				case 3:  Dst[ix] ^= Src[ix]; break;
 				}
 			}
 		}
-		DrawImage(ImageSrc, x, y, w, h, srcx, srcy);
+		DrawImage(ImageSrc, x, y);
 	}
 
 	void Graphics::DrawImage(const ImageBlock& ib, int x, int y, int ops)
@@ -560,26 +696,7 @@ namespace TVOS
 			std::cout << "[INFO] Drawing image 0x" << std::hex << size_t(&ib) << std::dec << " at x=" << x << ", y=" << y << ", w=" << w << ", h=" << h << ", srcx=" << srcx << ", srcy=" << srcy << ".\n";
 		}
 
-		if (x < 0)
-		{
-			srcx -= x;
-			w += x;
-			x = 0;
-		}
-		if (y < 0)
-		{
-			srcy -= y;
-			h += y;
-			y = 0;
-		}
-		if (srcx >= ib.w || srcy >= ib.h) return;
-		if (x + w > Width) w = Width - x;
-		if (y + h > Height) h = Height - y;
-		if (w <= 0 || h <= 0) return;
-		int srcw = ib.w - srcx;
-		int srch = ib.h - srcy;
-		w = w > srcw ? srcw : w;
-		h = h > srch ? srch : h;
+		if (!ClipImageArea(ib, x, y, w, h, srcx, srcy)) return;
 
 		for(int iy = 0; iy < h; iy ++)
 		{
@@ -628,8 +745,74 @@ namespace TVOS
 		FillRect(0, 0, Width - 1, Height - 1, color);
 	}
 
+	bool Graphics::LoadFont(const std::string& FontFile)
+	{
+		try
+		{
+			Font = std::make_shared<FontFace>(FontFile, Verbose);
+		}
+		catch (const FontLoadFailed& e)
+		{
+			std::cerr << "[WARN] " << e.what() << " Using the built-in font.\n";
+			return false;
+		}
+		Glyphs.clear();
+		return true;
+	}
+
+	bool Graphics::LoadFontForResolution(const std::string& FontDir)
+	{
+		// 内置字体的字高 22 是按 272 行的屏幕设计的，屏幕更高时选用不超过等比例字高的最大字体
+		static const int FontHeights[] = { 44, 33, 22 };
+		int IdealHeight = Height * 22 / 272;
+		for (auto FontHeight : FontHeights)
+		{
+			if (FontHeight > IdealHeight && FontHeight != 22) continue;
+			auto FontFile = FontDir + "/font" + std::to_string(FontHeight) + ".tvf";
+			if (LoadFont(FontFile))
+			{
+				if (Verbose)
+				{
+					std::cout << "[INFO] Using font `" << FontFile << "` for the " << Width << "x" << Height << " screen.\n";
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Graphics::UseBuiltinFont()
+	{
+		Font = nullptr;
+		Glyphs.clear();
+	}
+	void Graphics::ShareFont(const Graphics& Other)
+	{
+		if (Font == Other.Font) return;
+		Font = Other.Font;
+		Glyphs.clear();
+	}
+
+	int Graphics::GetFontHeight() const
+	{
+		int w, h;
+		GetGlyphMetrics(' ', w, h);
+		return h;
+	}
+
+	bool Graphics::IsFontAntialiased() const
+	{
+		return Font && Font->GetBitsPerPixel() > 1;
+	}
+
 	void Graphics::GetGlyphMetrics(uint32_t GlyphUnicode, int& w, int& h) const
 	{ // 不能获取到字符大小的时候获取问号的字符大小
+		if (Font)
+		{
+			if (Font->GetGlyphSize(GlyphUnicode, w, h)) return;
+			Font->GetGlyphSize('?', w, h);
+			return;
+		}
 		if (GetGlyphSize(GlyphUnicode, w, h, Verbose)) return;
 		GetGlyphSize('?', w, h, Verbose);
 	}
@@ -652,18 +835,27 @@ namespace TVOS
 			}
 
 			// 生成字体
-			if (!ExtractGlyph(Glyphs[GlyphUnicode].first, GlyphUnicode, 0xFF000000, 0xFFFFFFFF, Verbose))
+			auto& NewGlyph = Glyphs[GlyphUnicode].first;
+			bool Extracted = Font ?
+				Font->ExtractGlyph(NewGlyph, GlyphUnicode, 0xFF000000, 0xFFFFFFFF) :
+				ExtractGlyph(NewGlyph, GlyphUnicode, 0xFF000000, 0xFFFFFFFF, Verbose);
+			if (!Extracted)
 			{ // 不能显示的字符使用问号
 				if (Verbose)
 				{
 					std::cout << "[INFO] Create glyph cache U+" << std::hex << GlyphUnicode << std::dec << " failed.\n";
 				}
+				Glyphs.erase(GlyphUnicode);
 				return GetGlyph('?', InvertColor);
 			}
 
 			auto& GlyphImage = Glyphs[GlyphUnicode];
 			GlyphImage.second = GlyphImage.first;
 			GlyphImage.second.InvertPixelColors();
+			if (IsFontAntialiased())
+			{ // 灰色的边缘做 XOR 会留下杂色，XOR 只用覆盖过半的像素
+				for (auto& Pixel : GlyphImage.second.Pixels) Pixel = (Pixel & 0xFF) >= 128 ? 0x00FFFFFF : 0;
+			}
 			if (Verbose)
 			{
 				std::cout << "[INFO] Glyph cache U+" << std::hex << GlyphUnicode << std::dec << " has w=" << GlyphImage.first.w << ", h=" << GlyphImage.first.h << ".\n";
@@ -672,6 +864,18 @@ namespace TVOS
 		}
 	}
 
+	const uint32_t* Graphics::GetBlendTable(uint32_t GlyphColor, uint32_t BackColor)
+	{
+		if (BlendTables.size() >= 64) BlendTables.clear(); // 界面只用几种颜色，不会经常走到这里
+		auto& Table = BlendTables[(uint64_t(GlyphColor) << 32) | BackColor];
+		if (Table.empty())
+		{
+			Table.resize(256);
+			for (int i = 0; i < 256; i++) Table[i] = BlendColor(BackColor, GlyphColor, 255 - i);
+		}
+		return Table.data();
+	}
+
 	void Graphics::DrawGlyph(int x, int y, uint32_t GlyphUnicode, bool Transparent, uint32_t GlyphColor)
 	{
 		if (Verbose)
@@ -682,6 +886,31 @@ namespace TVOS
 		{
 			DrawImage(GetGlyph(GlyphUnicode, false), x, y);
 		}
+		else if (IsFontAntialiased())
+		{ // 抗锯齿字体的边缘是灰色的，不能用 AND/OR 叠加
+			auto& GlyphImage = GetGlyph(GlyphUnicode, false);
+			if (!Transparent)
+			{ // 不透明时底色是黑色
+				DrawGlyphBlended(x, y, GlyphUnicode, GetBlendTable(GlyphColor, 0));
+				return;
+			}
+			// 底色未知时读回背景，只读裁剪后要写的部分，只有边缘的像素需要混合
+			int cx = x, cy = y, w = GlyphImage.w, h = GlyphImage.h, srcx = 0, srcy = 0;
+			if (!ClipImageArea(GlyphImage, cx, cy, w, h, srcx, srcy)) return;
+			auto Back = ReadPixels(cx, cy, w, h);
+			for (int iy = 0; iy < Back.h; iy++)
+			{
+				auto Src = &GlyphImage.Pixels[size_t(srcy + iy) * GlyphImage.w + srcx];
+				auto Dst = &Back.Pixels[size_t(iy) * Back.w];
+				for (int ix = 0; ix < Back.w; ix++)
+				{
+					int Coverage = 255 - int(Src[ix] & 0xFF);
+					if (Coverage == 0) continue;
+					Dst[ix] = Coverage == 255 ? GlyphColor : BlendColor(Dst[ix], GlyphColor, Coverage);
+				}
+			}
+			DrawImage(Back, cx, cy);
+		}
 		else
 		{
 			auto& GlyphImageP = GetGlyph(GlyphUnicode, false);
@@ -699,14 +928,28 @@ namespace TVOS
 		}
 	}
 
+	void Graphics::DrawGlyphBlended(int x, int y, uint32_t GlyphUnicode, const uint32_t* Table)
+	{
+		auto& GlyphImage = GetGlyph(GlyphUnicode, false);
+		int w = GlyphImage.w, h = GlyphImage.h, srcx = 0, srcy = 0;
+		if (!ClipImageArea(GlyphImage, x, y, w, h, srcx, srcy)) return;
+		if (GlyphRow.size() < size_t(w)) GlyphRow.resize(w);
+		for (int iy = 0; iy < h; iy++)
+		{
+			auto Src = &GlyphImage.Pixels[size_t(iy + srcy) * GlyphImage.w + srcx];
+			for (int ix = 0; ix < w; ix++) GlyphRow[ix] = Table[Src[ix] & 0xFF];
+			SetDrawPos(x, y + iy);
+			WriteData(GlyphRow.data(), w);
+		}
+	}
+
 	void Graphics::DrawGlyphXor(int x, int y, uint32_t GlyphUnicode)
 	{
 		if (Verbose)
 		{
 			std::cout << "[INFO] Drawing a glyph U+" << std::hex << GlyphUnicode << std::dec << " at x=" << x << ", y=" << y << " with `XOR` opcode.\n";
 		}
-		ImageBlock GlyphImage = GetGlyph(GlyphUnicode, true);
-		DrawImageXor(GlyphImage, x, y);
+		DrawImageXor(GetGlyph(GlyphUnicode, true), x, y);
 	}
 
 	void Graphics::GetTextMetrics(const std::string& t, int& w, int& h) const
@@ -716,7 +959,7 @@ namespace TVOS
 
 		int maxw = 0;
 
-		for(auto& ch: UTF::Utf8_to_Utf32(t))
+		for (auto ch : UTF::Utf8Decoder(t))
 		{
 			int w_, h_;
 			if (ch == '\t')
@@ -751,7 +994,7 @@ namespace TVOS
 		int y = 0;
 		w = 0;
 		h = 0;
-		for (auto& ch : UTF::Utf8_to_Utf32(t))
+		for (auto ch : UTF::Utf8Decoder(t))
 		{
 			int w_, h_;
 			int LineHeight = 0;
@@ -797,14 +1040,53 @@ namespace TVOS
 		h = y;
 	}
 
+	ImageBlock Graphics::RenderTextStrip(const std::string& t, uint32_t GlyphColor, uint32_t BackColor)
+	{
+		int w = 0, h = 0;
+		for (auto ch : UTF::Utf8Decoder(t))
+		{
+			int w_, h_;
+			GetGlyphMetrics(ch, w_, h_);
+			w += w_;
+			if (h < h_) h = h_;
+		}
+
+		auto ret = ImageBlock(w, h, BackColor);
+		auto Table = GetBlendTable(GlyphColor, BackColor);
+		int x = 0;
+		for (auto ch : UTF::Utf8Decoder(t))
+		{
+			auto& Glyph = GetGlyph(ch, false);
+			if (x + Glyph.w > ret.w || Glyph.h > ret.h) break;
+			for (int iy = 0; iy < Glyph.h; iy++)
+			{
+				auto Src = &Glyph.Pixels[size_t(iy) * Glyph.w];
+				auto Dst = &ret.Pixels[size_t(iy) * ret.w + x];
+				for (int ix = 0; ix < Glyph.w; ix++)
+				{ // 字形图像是白底黑字，抗锯齿字体的边缘是灰色
+					Dst[ix] = Table[Src[ix] & 0xFF];
+				}
+			}
+			x += Glyph.w;
+		}
+		return ret;
+	}
+
 	const ImageBlock& Graphics::GetBackBuffer() const
 	{
 		return *BackBuffer;
 	}
 
+	std::shared_ptr<ImageBlock> Graphics::SwapBackBuffer(std::shared_ptr<ImageBlock> NewBackBuffer)
+	{
+		if (!BackBufferMode || !NewBackBuffer || NewBackBuffer->w != Width || NewBackBuffer->h != Height) return nullptr;
+		std::swap(BackBuffer, NewBackBuffer);
+		return NewBackBuffer;
+	}
+
 	void Graphics::DrawText(int x, int y, const std::string& t, bool Transparent, uint32_t GlyphColor)
 	{
-		for(auto& ch: UTF::Utf8_to_Utf32(t))
+		for (auto ch : UTF::Utf8Decoder(t))
 		{
 			int w, h;
 			GetGlyphMetrics(ch, w, h);
@@ -812,9 +1094,22 @@ namespace TVOS
 			x += w;
 		}
 	}
+	void Graphics::DrawText(int x, int y, const std::string& t, uint32_t GlyphColor, uint32_t BackColor)
+	{
+		// 字形图像是白底黑字，抗锯齿和不抗锯齿的字体都可以用同一张颜色表
+		auto Table = GetBlendTable(GlyphColor, BackColor);
+		for (auto ch : UTF::Utf8Decoder(t))
+		{
+			int w, h;
+			GetGlyphMetrics(ch, w, h);
+			DrawGlyphBlended(x, y, ch, Table);
+			x += w;
+		}
+	}
+
 	void Graphics::DrawTextXor(int x, int y, const std::string& t)
 	{
-		for (auto& ch : UTF::Utf8_to_Utf32(t))
+		for (auto ch : UTF::Utf8Decoder(t))
 		{
 			int w, h;
 			GetGlyphMetrics(ch, w, h);
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <climits>
 #include <cstdint>
 #include <fstream>
 #include <vector>
@@ -13,8 +14,11 @@ namespace TVOS
 		OpenDeviceFailed(const std::string& what) noexcept;
 	};
 	
+	class FontFace;
+
 	uint32_t MakeColor(int cr, int cg, int cb);
 	void GetColor(const uint32_t c, int& cr, int& cg, int& cb);
+	uint32_t BlendColor(uint32_t c1, uint32_t c2, int Alpha); // Alpha 为 0 时得到 c1，为 255 时得到 c2
 
 	struct ImageBlock
 	{
@@ -58,6 +62,8 @@ namespace TVOS
 		bool PreFitXYRB(int& x, int& y, int& r, int& b) const;
 		bool GetWidthHeight(int x, int y, int r, int b, int& width, int& height) const;
 		bool PreFitAreaGetWH(int& x, int& y, int& r, int& b, int& width, int& height) const;
+		bool PreFitClipXYRB(int& x, int& y, int& r, int& b) const; // 同 `PreFitXYRB()`，另外还要裁剪到裁剪区域内，用于写入操作
+		bool ClipImageArea(const ImageBlock& ib, int& x, int& y, int& w, int& h, int& srcx, int& srcy) const;
 
 		bool BackBufferMode = false;
 		std::shared_ptr<ImageBlock> BackBuffer = nullptr;
@@ -66,6 +72,18 @@ namespace TVOS
 		int BBWritePosX = 0;
 		int BBWritePosY = 0;
 
+		bool HasDirtyRect = false;
+		int DirtyX = 0;
+		int DirtyY = 0;
+		int DirtyR = 0;
+		int DirtyB = 0;
+
+		// 裁剪区域，所有的写入操作都只影响这个区域。默认不裁剪（仍受屏幕大小限制）。
+		int ClipX = 0;
+		int ClipY = 0;
+		int ClipR = INT_MAX;
+		int ClipB = INT_MAX;
+
 		// 底层绘图操作
 		void SetReadPos(int x, int y);
 		void SetDrawPos(int x, int y);
@@ -89,6 +107,17 @@ namespace TVOS
 		void SetFrontBufferMode(); // 绘制到前台fb
 		bool IsBackBufferMode(); // 是否在绘制到后台缓冲区的模式里
 		void RefreshFrontBuffer(); // 将后台缓冲区的内容刷新到前台缓冲区
+		void MarkDirty(int x, int y, int r, int b); // 标记后台缓冲区中需要刷新到前台的区域
+		void RefreshDirtyRect(); // 只将标记过的区域刷新到前台缓冲区
+		bool FrontBufferRowDiffers(int y, uint32_t color); // 前台缓冲区第 y 行是否有颜色（不看 Alpha）与 color 不同的像素，用来发现播放器已经开始输出画面
+
+		// 换入另一块与屏幕等大的后台缓冲区，返回原来的后台缓冲区，不复制像素。不在后台缓冲区模式或大小不符时什么都不做，返回 nullptr。
+		std::shared_ptr<ImageBlock> SwapBackBuffer(std::shared_ptr<ImageBlock> NewBackBuffer);
+
+		void SetClipRect(int x, int y, int r, int b); // 之后的绘图操作只影响这个区域
+		bool IntersectClipRect(int x, int y, int r, int b); // 将裁剪区域缩小为与该矩形的交集，返回交集是否非空
+		void ResetClipRect();
+		bool GetClipRect(int& x, int& y, int& r, int& b) const; // 取得与屏幕求交后的裁剪区域，返回是否非空
 
 		void ClearScreen(uint32_t color);
 
@@ -131,12 +160,20 @@ namespace TVOS
 		void DrawImageXor(const ImageBlock& ib, int x, int y);
 
 		void DrawText(int x, int y, const std::string& t, bool Transparent, uint32_t GlyphColor);
+		void DrawText(int x, int y, const std::string& t, uint32_t GlyphColor, uint32_t BackColor); // 底色已知，不读回屏幕
 		void DrawTextXor(int x, int y, const std::string& t);
 		void GetTextMetrics(const std::string& t, int& w, int& h) const;
 		void GetTextMetrics(const std::string& t, int xlimit, int& w, int& h) const;
+		ImageBlock RenderTextStrip(const std::string& t, uint32_t GlyphColor, uint32_t BackColor); // 将单行文本渲染到离屏图像
 
 		const ImageBlock& GetBackBuffer() const;
 
+		bool LoadFont(const std::string& FontFile); // 载入外部字体文件，失败时继续使用内置字体
+		bool LoadFontForResolution(const std::string& FontDir); // 按屏幕分辨率在 FontDir 里选择预先放大好的字体 `font<字高>.tvf`
+		void UseBuiltinFont();
+		void ShareFont(const Graphics& Other); // 使用另一个 `Graphics` 载入的字体，用于离屏绘制
+		int GetFontHeight() const;
+
 	protected:
 		std::string FBDev;
 		std::fstream fs;
@@ -145,10 +182,18 @@ namespace TVOS
 		int Stride;
 
 		std::unordered_map<uint32_t, std::pair<ImageBlock, ImageBlock>> Glyphs;
+		std::shared_ptr<const FontFace> Font = nullptr;
 
+		bool IsFontAntialiased() const;
 		void GetGlyphMetrics(uint32_t GlyphUnicode, int& w, int& h) const;
-		const ImageBlock& GetGlyph(uint32_t GlyphUnicode, bool InvertColor);
+		const ImageBlock& GetGlyph(uint32_t GlyphUnicode, bool InvertColor); // 抗锯齿字体反色的字形按覆盖率一半取成黑白两色，用于 XOR
+		
+		// 按 (字色, 底色) 预先混合好的颜色表，以字形像素的低 8 位（白底黑字的灰度）为下标
+		std::unordered_map<uint64_t, std::vector<uint32_t>> BlendTables;
+		const uint32_t* GetBlendTable(uint32_t GlyphColor, uint32_t BackColor);
+		std::vector<uint32_t> GlyphRow; // 查表得到的一行像素，各个字形共用
 		void DrawGlyph(int x, int y, uint32_t GlyphUnicode, bool Transparent, uint32_t GlyphColor);
+		void DrawGlyphBlended(int x, int y, uint32_t GlyphUnicode, const uint32_t* Table); // 整个字形格子按颜色表写出
 		void DrawGlyphXor(int x, int y, uint32_t GlyphUnicode);
 
 		std::string ReadSimpleFile(const std::string& f);
@@ -157,6 +202,10 @@ namespace TVOS
 
 	public:
 		bool Verbose = false;
+
+		// 绘图开销统计，使用者可以随时清零
+		uint64_t PixelsWritten = 0;
+		uint64_t PixelsRead = 0;
 	};
 }
 
@@ -1,5 +1,7 @@
 ﻿#include "gui.hpp"
 
+#include <algorithm>
+
 
 namespace TVOS
 {
@@ -68,37 +70,246 @@ namespace TVOS
 		}
 	}
 
-	UIElementBase::UIElementBase(Graphics& FB, const std::string& Name) :
-		FB(FB),
-		Name(Name)
+	UIElementArena::UIElementArena(Graphics& FB) :
+		FB(FB)
+	{
+	}
+
+	UIElementArena::~UIElementArena()
+	{
+		Reset();
+	}
+
+	Graphics& UIElementArena::GetGraphics() const
+	{
+		return FB;
+	}
+
+	void* UIElementArena::Allocate(size_t Size, size_t Align)
+	{
+		for (;; CurChunk++)
+		{
+			if (CurChunk == Chunks.size())
+			{ // 比块还大的组件单独占用一块
+				Chunks.emplace_back();
+				auto& NewChunk = Chunks.back();
+				NewChunk.Size = std::max(ChunkSize, Size);
+				NewChunk.Data.reset(new uint8_t[NewChunk.Size]);
+			}
+			auto& Cur = Chunks[CurChunk];
+			size_t Offset = (Cur.Used + Align - 1) / Align * Align;
+			if (Offset <= Cur.Size && Size <= Cur.Size - Offset)
+			{
+				Cur.Used = Offset + Size;
+				return Cur.Data.get() + Offset;
+			}
+		}
+	}
+
+	uint32_t UIElementArena::Register(UIElementBase* Element, const void* TypeTag)
+	{
+		auto Index = uint32_t(Elements.size());
+		Elements.push_back(Element);
+		ElementTypes.push_back(TypeTag);
+		if (ElementByName.size() <= Element->NameId) ElementByName.resize(size_t(Element->NameId) + 1, NoElement);
+		ElementByName[Element->NameId] = Index;
+		return Index;
+	}
+
+	UIElementBase* UIElementArena::GetElement(uint32_t Index, uint32_t HandleGeneration) const
+	{
+		if (HandleGeneration != Generation || Index >= Elements.size()) return nullptr;
+		return Elements[Index];
+	}
+
+	UINameId UIElementArena::Intern(const std::string& Name)
+	{
+		auto Found = NameIds.find(Name);
+		if (Found != NameIds.end()) return Found->second;
+		auto NameId = UINameId(Names.size());
+		Names.push_back(Name);
+		NameIds.emplace(Name, NameId);
+		return NameId;
+	}
+
+	bool UIElementArena::FindName(const std::string& Name, UINameId& NameId) const
+	{
+		auto Found = NameIds.find(Name);
+		if (Found == NameIds.end()) return false;
+		NameId = Found->second;
+		return true;
+	}
+
+	const std::string& UIElementArena::GetName(UINameId NameId) const
+	{
+		return Names.at(NameId);
+	}
+
+	size_t UIElementArena::size() const
+	{
+		return Elements.size();
+	}
+
+	size_t UIElementArena::GetReservedBytes() const
+	{
+		size_t Bytes = 0;
+		for (auto& c : Chunks) Bytes += c.Size;
+		return Bytes;
+	}
+
+	void UIElementArena::Reset()
+	{
+		for (auto Element = Elements.rbegin(); Element != Elements.rend(); ++Element)
+		{
+			(*Element)->~UIElementBase();
+		}
+		Elements.clear();
+		ElementTypes.clear();
+		std::fill(ElementByName.begin(), ElementByName.end(), NoElement);
+		for (auto& c : Chunks) c.Used = 0;
+		CurChunk = 0;
+		Generation++;
+	}
+
+	UIElementBase::UIElementBase(UIElementArena& Arena, const std::string& Name) :
+		Arena(Arena),
+		FB(Arena.GetGraphics()),
+		NameId(Arena.Intern(Name))
 	{
 	}
 
 	const std::string& UIElementBase::GetName() const
 	{
-		return Name;
+		return Arena.GetName(NameId);
 	}
 
-	int UIElementBase::GetMaxScroll() const
+	UINameId UIElementBase::GetNameId() const
 	{
-		int MaxScroll = ArrangedContentsHeight - ArrangedHeight + GetFrameHeight() * 2;
-		if (MaxScroll < 0) MaxScroll = 0;
-		return MaxScroll;
+		return NameId;
+	}
+
+	UIElementArena& UIElementBase::GetArena() const
+	{
+		return Arena;
+	}
+
+	UIElementBase* UIElementBase::GetParent() const
+	{
+		return Parent;
+	}
+
+	UIElementBase* UIElementBase::GetFirstChild() const
+	{
+		return FirstChild;
+	}
+
+	UIElementBase* UIElementBase::GetNextSibling() const
+	{
+		return NextSibling;
+	}
+
+	void UIElementBase::LinkChild(UIElementBase& Element)
+	{
+		Element.Parent = this;
+		Element.PrevSibling = LastChild;
+		Element.NextSibling = nullptr;
+		if (LastChild) LastChild->NextSibling = &Element;
+		else FirstChild = &Element;
+		LastChild = &Element;
+		NumChildren++;
+		Element.NeedReposition = true; // 新链接的子树下次排列时一定要进入
 	}
 
-	std::shared_ptr<UIElementBase> UIElementBase::FindElement(const std::string& Name)
+	void UIElementBase::UnlinkChild(UIElementBase& Element)
 	{
-		if (!SubElements.size()) return nullptr;
-		if (SubElementsMap.count(Name))
+		if (Element.PrevSibling) Element.PrevSibling->NextSibling = Element.NextSibling;
+		else FirstChild = Element.NextSibling;
+		if (Element.NextSibling) Element.NextSibling->PrevSibling = Element.PrevSibling;
+		else LastChild = Element.PrevSibling;
+		Element.Parent = nullptr;
+		Element.PrevSibling = nullptr;
+		Element.NextSibling = nullptr;
+		NumChildren--;
+	}
+
+	void UIElementBase::UnlinkChildren()
+	{
+		for (auto elem = FirstChild; elem;)
 		{
-			return SubElementsMap.at(Name);
+			auto Next = elem->NextSibling;
+			elem->Parent = nullptr;
+			elem->PrevSibling = nullptr;
+			elem->NextSibling = nullptr;
+			elem = Next;
 		}
-		for (auto& elem : SubElements)
+		FirstChild = nullptr;
+		LastChild = nullptr;
+		NumChildren = 0;
+	}
+
+	UIElementBase& UIElementBase::GetRoot()
+	{
+		auto Root = this;
+		while (Root->Parent) Root = Root->Parent;
+		return *Root;
+	}
+
+	UIRect UIElementBase::GetRect() const
+	{
+		return { ArrangedAbsX, ArrangedAbsY, ArrangedAbsX + ArrangedWidth - 1, ArrangedAbsY + ArrangedHeight - 1 };
+	}
+
+	UIRect UIElementBase::GetLayerRect() const
+	{
+		return { ArrangedAbsX + XMargin, ArrangedAbsY + YMargin, ArrangedAbsX + ArrangedWidth - 1 - XMargin, ArrangedAbsY + ArrangedHeight - 1 - YMargin };
+	}
+
+	UIRect UIElementBase::GetFillRect() const
+	{
+		return { ArrangedAbsX + XMargin + XBorder, ArrangedAbsY + YMargin + YBorder, ArrangedAbsX + ArrangedWidth - 1 - XMargin - XBorder, ArrangedAbsY + ArrangedHeight - 1 - YMargin - YBorder };
+	}
+
+	DisplayList& UIElementBase::GetDisplayList()
+	{
+		return GetRoot().Frame;
+	}
+
+	void UIElementBase::InvalidateLayers()
+	{
+		for (auto elem = this; elem; elem = elem->Parent)
 		{
-			auto find = elem->FindElement(Name);
-			if (find) return find;
+			if (elem->CacheAsLayer) elem->LayerDirty = true;
 		}
-		return nullptr;
+	}
+
+	void UIElementBase::Invalidate()
+	{
+		InvalidateLayers();
+		GetRoot().NeedRepaint = true;
+	}
+
+	void UIElementBase::InvalidateScreen()
+	{
+		auto& Root = GetRoot();
+		Root.AddInvalidRect({ 0, 0, FB.GetWidth() - 1, FB.GetHeight() - 1 });
+		Root.NeedRepaint = true; // 顺便重新记录，使直接画到屏幕上的滚动标题等内容与显示列表一致
+	}
+
+	const DisplayList& UIElementBase::GetLastFrame() const
+	{
+		return LastFrame;
+	}
+
+	void UIElementBase::AddInvalidRect(const UIRect& Rect)
+	{
+		AddRectToRegion(InvalidRegion, Rect.Intersect({ 0, 0, FB.GetWidth() - 1, FB.GetHeight() - 1 }), MaxInvalidRects);
+	}
+
+	int UIElementBase::GetMaxScroll() const
+	{
+		int MaxScroll = ArrangedContentsHeight - ArrangedHeight + GetFrameHeight() * 2;
+		if (MaxScroll < 0) MaxScroll = 0;
+		return MaxScroll;
 	}
 
 	int UIElementBase::GetFrameWidth() const
@@ -111,11 +322,35 @@ namespace TVOS
 		return YPadding + YBorder + YMargin;
 	}
 
+	void UIElementBase::Measure(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight)
+	{
+		if (!NeedRearrange && WidthLimit == MeasuredWidthLimit && HeightLimit == MeasuredHeightLimit)
+		{
+			ActualWidth = MeasuredWidth;
+			TotalHeight = MeasuredHeight;
+			return;
+		}
+		GetClientContentsSize(WidthLimit, HeightLimit, ActualWidth, TotalHeight);
+		MeasuredWidthLimit = WidthLimit;
+		MeasuredHeightLimit = HeightLimit;
+		MeasuredWidth = ActualWidth;
+		MeasuredHeight = TotalHeight;
+		NeedRearrange = false;
+		NeedReposition = true; // 子组件的相对位置可能变了
+	}
+
+	void UIElementBase::InvalidateLayout()
+	{
+		for (auto elem = this; elem; elem = elem->Parent)
+		{
+			elem->NeedRearrange = true;
+			if (elem->CacheAsLayer) elem->LayerDirty = true;
+		}
+	}
+
 	void UIElementBase::GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight)
 	{
 		int cx = 0;
-		using ElemRowType = std::vector<std::shared_ptr<UIElementBase>>;
-		std::vector<ElemRowType> RowsOfElements;
 
 		auto WidthSpace = WidthLimit;
 		auto HeightSpace = HeightLimit;
@@ -126,20 +361,52 @@ namespace TVOS
 		if (HeightLimit < 0) HeightLimit = 0;
 
 		int LastRowHeight = 0;
+		TotalHeight = 0;
+		ActualWidth = 0; // 统计宽度
 
-		// 先按照宽度限制将所有的子控件归类到对应的行里
-		RowsOfElements.push_back(ElemRowType());
-		for (auto& elem : SubElements)
+		// 每一行都是子组件链表里连续的一段 [Begin, End)，排完一行就确定这一行的纵向位置
+		auto FinishRow = [&](UIElementBase* Begin, UIElementBase* End)
 		{
-			// 当前行
-			auto& CurRow = RowsOfElements.back();
+			if (Begin == End) return;
+			int RowWidth = 0;
+			int RowHeight = 0;
+
+			// 先统计行高，顺带统计总宽度
+			for (auto elem = Begin; elem != End; elem = elem->NextSibling)
+			{
+				if (RowHeight < elem->ArrangedHeight)
+				{
+					RowHeight = elem->ArrangedHeight;
+				}
+				// 统计当前行宽
+				RowWidth += elem->ArrangedWidth;
+			}
+			// 统计最大行宽
+			if (ActualWidth < RowWidth) ActualWidth = RowWidth;
+
+			// 再设置这行每个控件的位置
+			for (auto elem = Begin; elem != End; elem = elem->NextSibling)
+			{
+				if (!ExpandToParentY)
+				{
+					elem->ArrangedContainerHeight = RowHeight;
+				}
+				elem->ArrangedRelY = TotalHeight + YPadding;
+			}
 
+			TotalHeight += RowHeight;
+		};
+
+		// 按照宽度限制将子控件依次排入行里
+		auto RowBegin = FirstChild;
+		for (auto elem = FirstChild; elem; elem = elem->NextSibling)
+		{
 			bool LineBreak = elem->LineBreak;
 
 			// 取得子控件的宽度和高度
 			int w, h;
 			elem->ArrangedContainerWidth = WidthLimit - cx;
-			elem->GetClientContentsSize(elem->ArrangedContainerWidth, HeightLimit, w, h);
+			elem->Measure(elem->ArrangedContainerWidth, HeightLimit, w, h);
 			elem->ArrangedContentsWidth = w;
 			elem->ArrangedContentsHeight = h;
 
@@ -171,72 +438,33 @@ namespace TVOS
 				cx = 0;
 				HeightLimit -= LastRowHeight;
 				LastRowHeight = 0;
-				if (CurRow.size() == 0)
+				if (RowBegin == elem)
 				{ // 如果当前行没有任何控件就要换行，则强行插入控件。
-					CurRow.push_back(elem);
-					RowsOfElements.push_back(ElemRowType());
 					elem->ArrangedRelX = cx + XPadding;
+					FinishRow(RowBegin, elem->NextSibling);
+					RowBegin = elem->NextSibling;
 				}
 				else
 				{ // 否则换行后，插入控件到新行
-					RowsOfElements.push_back(ElemRowType());
-					RowsOfElements.back().push_back(elem);
+					FinishRow(RowBegin, elem);
+					RowBegin = elem;
 					elem->ArrangedRelX = cx + XPadding;
 					cx += w;
 				}
 			}
 			else
 			{ // 没有超出横向限制，继续向右排布
-				CurRow.push_back(elem);
 				elem->ArrangedRelX = cx + XPadding;
 				cx += w;
 			}
 		}
+		FinishRow(RowBegin, nullptr);
 
-		// 去除末尾的空行
-		while (RowsOfElements.size())
-		{
-			if (RowsOfElements.back().size() == 0) RowsOfElements.pop_back();
-			else break;
-		}
-
-		// 开始纵向排布控件
-		TotalHeight = 0;
-		ActualWidth = 0; // 统计宽度
-		for (auto& Row : RowsOfElements)
-		{
-			int RowWidth = 0;
-			int RowHeight = 0;
-
-			// 先统计行高，顺带统计总宽度
-			for (auto& elem : Row)
-			{
-				if (RowHeight < elem->ArrangedHeight)
-				{
-					RowHeight = elem->ArrangedHeight;
-				}
-				// 统计当前行宽
-				RowWidth += elem->ArrangedWidth;
-			}
-			for (auto& elem : Row)
-			{
-				if (!ExpandToParentY)
-				{
-					elem->ArrangedContainerHeight = RowHeight;
-				}
-			}
-			// 统计最大行宽
-			if (ActualWidth < RowWidth) ActualWidth = RowWidth;
-
-			// 再设置这行每个控件的位置
-			for (auto& elem : Row)
-			{
-				elem->ArrangedRelY = TotalHeight + YPadding;
-			}
-
-			TotalHeight += RowHeight;
-		}
+		SetArrangedSize(WidthSpace, HeightSpace, ActualWidth, TotalHeight);
+	}
 
+	void UIElementBase::SetArrangedSize(int WidthSpace, int HeightSpace, int ActualWidth, int TotalHeight)
+	{
 		ArrangedRelX = 0;
 		ArrangedRelY = 0;
 		ArrangedContentsWidth = ActualWidth;
@@ -255,9 +483,17 @@ namespace TVOS
 
 	void UIElementBase::ArrangeSubElementsAbsPos(int x, int y)
 	{
+		NeedReposition = false;
+		PositionedX = x;
+		PositionedY = y;
+		PositionedContainerWidth = ArrangedContainerWidth;
+		PositionedContainerHeight = ArrangedContainerHeight;
+		PositionedContentsWidth = ArrangedContentsWidth;
+		PositionedContentsHeight = ArrangedContentsHeight;
+
 		int ClientX = GetFrameWidth();
 		int ClientY = GetFrameHeight();
-		for (auto& elem : SubElements)
+		for (auto elem = FirstChild; elem; elem = elem->NextSibling)
 		{
 			if (IsLeft(Alignment))
 			{
@@ -283,91 +519,46 @@ namespace TVOS
 			{
 				elem->ArrangedAbsY = y + ArrangedContainerHeight / 2 - ArrangedContentsHeight / 2 + elem->ArrangedRelY;
 			}
-			elem->ArrangeSubElementsAbsPos(elem->ArrangedAbsX, elem->ArrangedAbsY - Scroll);
+			int ChildX = elem->ArrangedAbsX, ChildY = elem->ArrangedAbsY - elem->Scroll;
+			if (elem->NeedReposition ||
+				ChildX != elem->PositionedX || ChildY != elem->PositionedY ||
+				elem->ArrangedContainerWidth != elem->PositionedContainerWidth || elem->ArrangedContainerHeight != elem->PositionedContainerHeight ||
+				elem->ArrangedContentsWidth != elem->PositionedContentsWidth || elem->ArrangedContentsHeight != elem->PositionedContentsHeight)
+			{
+				elem->ArrangeSubElementsAbsPos(ChildX, ChildY);
+			}
 		}
 	}
 
 	void UIElementBase::ArrangeElements(int x, int y, int w, int h)
 	{
 		int cw, ch;
-		GetClientContentsSize(w, h, cw, ch);
+		Measure(w, h, cw, ch);
 		ArrangeSubElementsAbsPos(x, y);
 	}
 
 	void UIElementBase::Render(int x, int y, int w, int h)
 	{
-		if (NeedRearrange)
+		// 失效会一直传递到根组件，所以只需由根组件重新排列，子组件此时都已经排列好了
+		if (NeedRearrange && !Parent)
 		{
 			ArrangeElements(x, y, w, h);
 			NeedRearrange = false;
 		}
 
+		auto& Root = GetRoot();
+		auto& DL = Root.Frame;
+		Root.LastRenderStats.ElementsVisited++;
+
 		int ArrangedAbsR = ArrangedAbsX + ArrangedWidth - 1;
 		int ArrangedAbsB = ArrangedAbsY + ArrangedHeight - 1;
 
 		if (!Transparent)
 		{
-			int FillX = ArrangedAbsX + XMargin + XBorder;
-			int FillY = ArrangedAbsY + YMargin + YBorder;
-			int FillR = ArrangedAbsR - XMargin - XBorder;
-			int FillB = ArrangedAbsB - YMargin - YBorder;
-			int FillW = FillR + 1 - FillX;
-			int FillH = FillB + 1 - FillY;
-			if (FillW > 0 && FillH > 0)
-			{
-				FB.FillRect(FillX, FillY, FillR, FillB, FillColor);
-			}
+			DL.FillRect(GetFillRect(), FillColor);
 		}
 
-		if (XBorder > 0 || YBorder > 0)
-		{
-			int BorderLX = ArrangedAbsX + XMargin;
-			int BorderLY = ArrangedAbsY + YMargin + YBorder;
-			int BorderLR = BorderLX + XBorder - 1;
-			int BorderLB = ArrangedAbsB - YMargin - YBorder;
-			int BorderRX = ArrangedAbsR - XMargin - XBorder + 1;
-			int BorderRY = BorderLY;
-			int BorderRR = ArrangedAbsR - XMargin;
-			int BorderRB = BorderLB;
-			int BorderLW = BorderLR - BorderLX + 1;
-			int BorderLH = BorderLB - BorderLY + 1;
-			int BorderRW = BorderRR - BorderRX + 1;
-			int BorderRH = BorderRB - BorderRY + 1;
-			if (XBorder > 0)
-			{
-				if (BorderLW > 0 && BorderLH > 0)
-				{
-					FB.FillRect(BorderLX, BorderLY, BorderLR, BorderLB, BorderColor);
-				}
-				if (BorderRW > 0 && BorderRH > 0)
-				{
-					FB.FillRect(BorderRX, BorderRY, BorderRR, BorderRB, BorderColor);
-				}
-			}
-			int BorderTX = BorderLX;
-			int BorderTY = BorderLY - YBorder;
-			int BorderTR = BorderRR;
-			int BorderTB = BorderLY - 1;
-			int BorderBX = BorderLX;
-			int BorderBY = BorderLB + 1;
-			int BorderBR = BorderRR;
-			int BorderBB = BorderRB + YBorder;
-			int BorderTW = BorderTR - BorderTX + 1;
-			int BorderTH = BorderTB - BorderTY + 1;
-			int BorderBW = BorderBR - BorderBX + 1;
-			int BorderBH = BorderBB - BorderBY + 1;
-			if (YBorder > 0)
-			{
-				if (BorderTW > 0 && BorderTH > 0)
-				{
-					FB.FillRect(BorderTX, BorderTY, BorderTR, BorderTB, BorderColor);
-				}
-				if (BorderBW > 0 && BorderBH > 0)
-				{
-					FB.FillRect(BorderBX, BorderBY, BorderBR, BorderBB, BorderColor);
-				}
-			}
-		}
+		DL.Border({ ArrangedAbsX + XMargin, ArrangedAbsY + YMargin, ArrangedAbsR - XMargin, ArrangedAbsB - YMargin }, XBorder, YBorder, BorderColor);
 
 		int ClientX = ArrangedAbsX + GetFrameWidth();
 		int ClientY = ArrangedAbsY + GetFrameHeight();
@@ -380,154 +571,197 @@ namespace TVOS
 		if (ClientW > 0 && ClientH > 0)
 		{
 			if (ClipChildren)
+			{ // 子组件只能画在客户区内
+				DL.PushClip({ ClientX, ClientY, ClientR, ClientB });
+			}
+			for (auto elem = FirstChild; elem; elem = elem->NextSibling)
 			{
-				auto ImageMask = FB.ReadPixels();
-				auto RectAreaImage = ImageBlock(FB.GetWidth(), FB.GetHeight(), 0);
-				for (int y = ClientY; y <= ClientB; y++)
-				{
-					for (int x = ClientX; x <= ClientR; x++)
-					{
-						RectAreaImage.PutPixel(x, y, 0xFFFFFFFF);
-						ImageMask.PutPixel(x, y, 0);
-					}
-				}
-				for (auto& elem : SubElements)
-				{
-					// 向上传递是否需要重新排列控件
-					NeedRearrange = elem->NeedRearrange;
-					elem->NeedRearrange = false;
-					elem->Render(elem->ArrangedAbsX, elem->ArrangedAbsY, elem->ArrangedWidth, elem->ArrangedHeight);
-				}
-				FB.DrawImageAnd(RectAreaImage, 0, 0);
-				FB.DrawImageOr(ImageMask, 0, 0);
+				elem->RenderElement(elem->ArrangedAbsX, elem->ArrangedAbsY, elem->ArrangedWidth, elem->ArrangedHeight);
 			}
-			else
+			if (ClipChildren)
 			{
-				for (auto& elem : SubElements)
-				{
-					// 向上传递是否需要重新排列控件
-					NeedRearrange = elem->NeedRearrange;
-					elem->NeedRearrange = false;
-					elem->Render(elem->ArrangedAbsX, elem->ArrangedAbsY, elem->ArrangedWidth, elem->ArrangedHeight);
-				}
+				DL.PopClip();
 			}
 		}
+	}
 
-		if (NeedRearrange)
+	void UIElementBase::RenderElement(int x, int y, int w, int h)
+	{
+		auto LayerRect = GetLayerRect();
+		if (!CacheAsLayer || Transparent || LayerRect.IsEmpty())
 		{
-			ArrangeElements(x, y, w, h);
-			NeedRearrange = false;
+			Render(x, y, w, h);
+			return;
 		}
-	}
 
-	void UIElementBase::Render()
-	{
-		Render(0, 0, FB.GetWidth(), FB.GetHeight());
+		auto& Root = GetRoot();
+		int LayerW = LayerRect.r + 1 - LayerRect.x;
+		int LayerH = LayerRect.b + 1 - LayerRect.y;
+		if (LayerDirty || !LayerSurface || LayerSurface->w != LayerW || LayerSurface->h != LayerH)
+		{
+			RenderLayer(x, y, w, h, LayerRect);
+			LayerMisses++;
+			Root.LastRenderStats.LayersRendered++;
+		}
+		else
+		{
+			LayerHits++;
+			Root.LastRenderStats.LayersReused++;
+		}
+		GetDisplayList().Image(LayerRect.x, LayerRect.y, LayerW, LayerH, 0, 0, LayerSurface);
 	}
 
-	void UIElementBase::RearrangeElementsAsRoot()
+	void UIElementBase::RenderLayer(int x, int y, int w, int h, const UIRect& LayerRect)
 	{
-		ArrangeElements(0, 0, FB.GetWidth(), FB.GetHeight());
+		auto& Root = GetRoot();
+		int LayerW = LayerRect.r + 1 - LayerRect.x;
+		int LayerH = LayerRect.b + 1 - LayerRect.y;
+		if (!LayerFB || LayerFB->GetWidth() != LayerW || LayerFB->GetHeight() != LayerH)
+		{
+			LayerFB = std::make_unique<Graphics>(nullptr, LayerW, LayerH, false);
+			LayerSurface = nullptr;
+		}
+		LayerFB->ShareFont(FB);
+
+		// 子树的命令记录到图层自己的列表里，嵌套的图层在其中记录为贴图命令
+		LayerCommands.Clear();
+		std::swap(Root.Frame, LayerCommands);
+		Render(x, y, w, h);
+		std::swap(Root.Frame, LayerCommands);
+		LayerCommands.Offset(-LayerRect.x, -LayerRect.y);
+
+		auto PixelsWritten = LayerFB->PixelsWritten;
+		LayerCommands.Rasterize(*LayerFB, { 0, 0, LayerW - 1, LayerH - 1 });
+		Root.LastRenderStats.LayerPixelsWritten += LayerFB->PixelsWritten - PixelsWritten;
+
+		// 画好的图像成为新的缓存，换入旧的缓存供下次绘制。上一帧引用的是旧的缓存，这一帧引用的是新的，互不干扰。
+		auto Previous = LayerSurface ? LayerSurface : std::make_shared<ImageBlock>(LayerW, LayerH);
+		LayerSurface = LayerFB->SwapBackBuffer(Previous);
+		LayerDirty = false;
 	}
 
-	std::shared_ptr<UIElementBase> UIElementBase::GetElementByName(const std::string& Name)
+	void UIElementBase::Render()
 	{
-		return SubElementsMap.at(Name);
+		LastRenderStats = UIRenderStats();
+		auto PixelsWritten = FB.PixelsWritten;
+		auto PixelsRead = FB.PixelsRead;
+
+		if (NeedRearrange)
+		{
+			ArrangeElements(0, 0, FB.GetWidth(), FB.GetHeight());
+			NeedRearrange = false;
+			NeedRepaint = true;
+		}
+		if (!NeedRepaint && InvalidRegion.empty()) return;
+
+		// 重新记录整个界面，与上一帧比较出需要重绘的区域。记录只是填充命令数组，比实际绘制便宜得多。
+		if (NeedRepaint)
+		{
+			Frame.Clear();
+			RenderElement(0, 0, FB.GetWidth(), FB.GetHeight());
+			std::vector<UIRect> Changed;
+			Frame.Diff(LastFrame, Changed, MaxInvalidRects);
+			for (auto& Rect : Changed) AddInvalidRect(Rect);
+			std::swap(Frame, LastFrame);
+			Frame.Clear();
+			NeedRepaint = false;
+			LastRenderStats.Commands = LastFrame.size();
+		}
+
+		// 依次裁剪到每个失效区域，执行与之相交的绘图命令
+		auto Region = std::move(InvalidRegion);
+		InvalidRegion.clear();
+		for (auto& Rect : Region)
+		{
+			LastRenderStats.CommandsRasterized += LastFrame.Rasterize(FB, Rect);
+			FB.MarkDirty(Rect.x, Rect.y, Rect.r, Rect.b);
+			LastRenderStats.Regions++;
+			LastRenderStats.RegionPixels += size_t(Rect.r + 1 - Rect.x) * (Rect.b + 1 - Rect.y);
+		}
+
+		LastRenderStats.PixelsWritten = FB.PixelsWritten - PixelsWritten;
+		LastRenderStats.PixelsRead = FB.PixelsRead - PixelsRead;
 	}
 
-	UIElementBase& UIElementBase::InsertElement(std::shared_ptr<UIElementBase> Element)
+	void UIElementBase::RearrangeElementsAsRoot()
 	{
-		RemoveElement(Element->Name);
-		SubElementsMap[Element->Name] = Element;
-		SubElements.push_back(Element);
-		NeedRearrange = true;
-		return *Element;
+		ArrangeElements(0, 0, FB.GetWidth(), FB.GetHeight());
 	}
 
-	bool UIElementBase::RemoveElement(const std::string& Name)
+	UIElementBase& UIElementBase::InsertElement(UIElementBase& Element)
 	{
-		if (SubElementsMap.count(Name))
-		{
-			bool Removed = false;
-			do
-			{
-				for (auto Element = SubElements.begin(); Element != SubElements.end();)
-				{
-					if (Element->get()->Name == Name)
-					{
-						SubElements.erase(Element);
-						Removed = true;
-						break;
-					}
-					else ++Element;
-				}
-			} while (Removed);
-			SubElementsMap.erase(Name);
-			NeedRearrange = true;
-			return true;
-		}
-		return false;
+		if (Element.Parent) Element.Parent->RemoveElement(Element);
+		LinkChild(Element);
+		Element.InvalidateLayout();
+		Invalidate();
+		return Element;
 	}
 
-	void UIElementBase::ClearElements()
+	bool UIElementBase::RemoveElement(UIElementBase& Element)
 	{
-		SubElementsMap.clear();
-		SubElements.clear();
-		NeedRearrange = true;
+		if (Element.Parent != this) return false;
+		UnlinkChild(Element);
+		InvalidateLayout();
+		Invalidate();
+		return true;
 	}
 
-	decltype(UIElementBase::SubElements.cbegin()) UIElementBase::cbegin() const
+	void UIElementBase::ClearElements()
 	{
-		return SubElements.cbegin();
+		UnlinkChildren();
+		InvalidateLayout();
+		Invalidate();
 	}
 
-	decltype(UIElementBase::SubElements.cend()) UIElementBase::cend() const
+	UIElementBase::ChildIterator::ChildIterator(UIElementBase* Element) :
+		Element(Element)
 	{
-		return SubElements.cend();
 	}
 
-	decltype(UIElementBase::SubElements.begin()) UIElementBase::begin()
+	UIElementBase& UIElementBase::ChildIterator::operator * () const
 	{
-		return SubElements.begin();
+		return *Element;
 	}
 
-	decltype(UIElementBase::SubElements.end()) UIElementBase::end()
+	UIElementBase* UIElementBase::ChildIterator::operator -> () const
 	{
-		return SubElements.end();
+		return Element;
 	}
 
-	decltype(UIElementBase::SubElements.size()) UIElementBase::size() const
+	UIElementBase::ChildIterator& UIElementBase::ChildIterator::operator ++ ()
 	{
-		return SubElements.size();
+		Element = Element->NextSibling;
+		return *this;
 	}
 
-	decltype(UIElementBase::SubElements.front()) UIElementBase::front()
+	bool UIElementBase::ChildIterator::operator == (const ChildIterator& other) const
 	{
-		return SubElements.front();
+		return Element == other.Element;
 	}
 
-	decltype(UIElementBase::SubElements.back()) UIElementBase::back()
+	bool UIElementBase::ChildIterator::operator != (const ChildIterator& other) const
 	{
-		return SubElements.back();
+		return Element != other.Element;
 	}
 
-	decltype(UIElementBase::SubElements.at(size_t(0))) UIElementBase::at(size_t Index)
+	UIElementBase::ChildIterator UIElementBase::begin() const
 	{
-		return SubElements.at(Index);
+		return ChildIterator(FirstChild);
 	}
 
-	decltype(UIElementBase::SubElementsMap.at("")) UIElementBase::at(const std::string& Name)
+	UIElementBase::ChildIterator UIElementBase::end() const
 	{
-		return SubElementsMap.at(Name);
+		return ChildIterator(nullptr);
 	}
 
-	decltype(UIElementBase::SubElementsMap.count("")) UIElementBase::count(const std::string& Name)
+	size_t UIElementBase::size() const
 	{
-		return SubElementsMap.count(Name);
+		return NumChildren;
 	}
 
-	UIElementLabel::UIElementLabel(Graphics& FB, const std::string& Name) :
-		UIElementBase(FB, Name)
+	UIElementLabel::UIElementLabel(UIElementArena& Arena, const std::string& Name) :
+		UIElementBase(Arena, Name),
+		CaptionHeight(FB.GetFontHeight())
 	{
 	}
 
@@ -544,8 +778,13 @@ namespace TVOS
 
 	void UIElementLabel::SetCaption(const std::string& Caption)
 	{
+		int OldWidth = CaptionWidth, OldHeight = CaptionHeight;
 		this->Caption = Caption;
 		FB.GetTextMetrics(Caption, CaptionWidth, CaptionHeight);
+
+		// 标题大小不变时只需重绘，不必重新排列
+		Invalidate();
+		if (CaptionWidth != OldWidth || CaptionHeight != OldHeight) InvalidateLayout();
 	}
 
 	const std::string& UIElementLabel::GetCaption() const
@@ -559,13 +798,10 @@ namespace TVOS
 		h = CaptionHeight;
 	}
 
-	void UIElementLabel::Render(int x, int y, int w, int h)
+	void UIElementLabel::GetCaptionPos(int x, int y, int w, int h, int& tx, int& ty) const
 	{
-		UIElementBase::Render(x, y, w, h);
-
 		int tw = CaptionWidth, th = CaptionHeight;
 
-		int tx, ty;
 		if (IsLeft(Alignment))
 		{
 			tx = x + GetFrameWidth();
@@ -590,37 +826,127 @@ namespace TVOS
 		{
 			ty = y + h / 2 - th / 2;
 		}
-		FB.DrawText(tx, ty, Caption, true, FontColor);
 	}
 
-	void UIElementListView::EnsureSelectedVisible()
+	void UIElementLabel::Render(int x, int y, int w, int h)
 	{
-		auto MaxScroll = GetMaxScroll();
-		if (size() > 1)
-			Scroll = int(Selection * MaxScroll / (size() - 1));
+		UIElementBase::Render(x, y, w, h);
+
+		int tx, ty;
+		GetCaptionPos(x, y, w, h, tx, ty);
+
+		// 不透明的组件边框以内是 FillColor，边框是 BorderColor，标题落在这些范围内时底色已知，
+		// 按颜色表直接写出，不必读回屏幕混合。有子组件或者超出范围时底色未知，透明绘制。
+		auto& DL = GetDisplayList();
+		UIRect CaptionRect = { tx, ty, tx + CaptionWidth - 1, ty + CaptionHeight - 1 };
+		auto LayerRect = GetLayerRect();
+		auto FillRect = GetFillRect();
+		if (Transparent || FirstChild || LayerRect.Intersect(CaptionRect) != CaptionRect)
+		{
+			DL.Text(tx, ty, CaptionWidth, CaptionHeight, Caption, true, FontColor);
+		}
+		else if (FillRect.Intersect(CaptionRect) == CaptionRect || BorderColor == FillColor)
+		{
+			DL.Text(tx, ty, CaptionWidth, CaptionHeight, Caption, false, FontColor, FillColor);
+		}
 		else
-			Scroll = 0;
-		ArrangeSubElementsAbsPos(ArrangedAbsX, ArrangedAbsY - Scroll);
+		{ // 标题压到了颜色不同的边框上，分成几块各按自己的底色画
+			auto TextOn = [&](const UIRect& Rect, uint32_t BackColor)
+			{
+				if (Rect.IsEmpty() || !Rect.Intersects(CaptionRect)) return;
+				DL.PushClip(Rect);
+				DL.Text(tx, ty, CaptionWidth, CaptionHeight, Caption, false, FontColor, BackColor);
+				DL.PopClip();
+			};
+			TextOn(FillRect, FillColor);
+			TextOn({ LayerRect.x, LayerRect.y, LayerRect.r, FillRect.y - 1 }, BorderColor);
+			TextOn({ LayerRect.x, FillRect.b + 1, LayerRect.r, LayerRect.b }, BorderColor);
+			TextOn({ LayerRect.x, FillRect.y, FillRect.x - 1, FillRect.b }, BorderColor);
+			TextOn({ FillRect.r + 1, FillRect.y, LayerRect.r, FillRect.b }, BorderColor);
+		}
 	}
 
-	UIElementListView::UIElementListView(Graphics& FB, const std::string& Name) :
-		UIElementBase(FB, Name)
+	size_t UIListStringSource::GetItemCount() const
 	{
-		ClipChildren = true;
+		return Items.size();
 	}
 
-	void UIElementListView::GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight)
+	std::string UIListStringSource::GetItemKey(size_t Index) const
 	{
-		UIElementBase::GetClientContentsSize(WidthLimit, HeightLimit, ActualWidth, TotalHeight);
+		return Items.at(Index).first;
+	}
 
-		ArrangedContainerWidth = WidthLimit;
-		ArrangedContainerHeight = HeightLimit;
+	std::string UIListStringSource::GetItemCaption(size_t Index) const
+	{
+		return Items.at(Index).second;
 	}
 
-	size_t UIElementListView::AddItem(const std::string& Key, const std::string& Caption)
+	size_t UIListStringSource::Add(const std::string& Key, const std::string& Caption)
+	{
+		Items.emplace_back(Key, Caption);
+		return Items.size();
+	}
+
+	bool UIListStringSource::Remove(size_t Index)
+	{
+		if (Index >= Items.size()) return false;
+		Items.erase(Items.begin() + Index);
+		return true;
+	}
+
+	void UIListStringSource::Clear()
+	{
+		Items.clear();
+	}
+
+	void UIElementListView::EnsureSelectedVisible(bool Animate)
+	{
+		// 只在选中项超出可视区域时滚动，这样移动选中项通常只需重绘两行。
+		// 正在滚动时以动画的终点判断，连续按键会接着滚动而不是从半路重新计算。
+		int ViewHeight = ArrangedHeight - GetFrameHeight() * 2;
+		int Top = int(Selection) * RowHeight;
+		int Target = ScrollAnimation.IsActive() ? ScrollAnimation.GetTarget() : Scroll;
+		if (Top < Target) Target = Top;
+		else if (Top + RowHeight > Target + ViewHeight) Target = Top + RowHeight - ViewHeight;
+		auto MaxScroll = GetMaxScroll();
+		if (Target > MaxScroll) Target = MaxScroll;
+		if (Target < 0) Target = 0;
+
+		if (Animate && Animator && Target != Scroll)
+		{
+			if (!ScrollAnimation.IsActive() || ScrollAnimation.GetTarget() != Target)
+			{
+				ScrollAnimation.Start(*Animator, Scroll, Target, ScrollDuration);
+			}
+		}
+		else
+		{
+			ScrollAnimation.Stop();
+			Scroll = Target;
+		}
+		BindRows();
+		ArrangeSubElementsAbsPos(ArrangedAbsX, ArrangedAbsY - Scroll);
+	}
+
+	UIElementListView::UIElementListView(UIElementArena& Arena, const std::string& Name) :
+		UIElementBase(Arena, Name),
+		Items(std::make_shared<UIListStringSource>()),
+		DataSource(Items)
 	{
-		auto elem = std::make_shared<UIElementListItem>(FB, Key);
-		InsertElement(elem);
+		ClipChildren = true;
+		ScrollAnimation.OnUpdate = [this](int Value)
+		{
+			Scroll = Value;
+			BindRows();
+			ArrangeSubElementsAbsPos(ArrangedAbsX, ArrangedAbsY - Scroll);
+			Invalidate();
+		};
+	}
+
+	UIElementListItem* UIElementListView::CreateRow(size_t RowIndex)
+	{
+		// 列表项由 `BindRows()` 在可见时链接为子组件
+		auto elem = Arena.Create<UIElementListItem>(GetName() + "#" + std::to_string(RowIndex)).get();
 		elem->ExpandToParentX = true;
 		elem->LineBreak = true;
 		elem->XMargin = 0;
@@ -634,71 +960,239 @@ namespace TVOS
 		elem->FillColor = 0xFF000000;
 		elem->FontColor = 0xFFFFFFFF;
 		elem->Alignment = AlignmentType::LeftCenter;
-		elem->SetCaption(Caption);
+		return elem;
+	}
 
-		if (size() == 1)
+	void UIElementListView::BindRowCaption(size_t RowIndex, size_t ItemIndex)
+	{
+		while (RowPool.size() <= RowIndex)
 		{
-			Selection = 0;
-			elem->Selected = true;
+			RowPool.push_back(CreateRow(RowPool.size()));
+			RowPoolItems.push_back(size_t(-1));
 		}
-		return size();
+		if (RowPoolItems[RowIndex] == ItemIndex) return;
+
+		auto Row = RowPool[RowIndex];
+		Row->SetCaption(DataSource->GetItemCaption(ItemIndex));
+		Row->ResetMarquee();
+		RowPoolItems[RowIndex] = ItemIndex;
 	}
 
-	bool UIElementListView::RemoteItem(size_t Index)
+	void UIElementListView::MeasureRowHeight()
 	{
-		if (size() == 0) return false;
-		if (Index >= size()) return false;
-		auto& ElemName = SubElements[Index]->GetName();
-		return RemoveElement(ElemName);
+		// 所有的行等高，用任意一个已经绑定了数据的列表项测量即可
+		RowHeight = 0;
+		if (!GetItemCount()) return;
+		size_t RowIndex = 0;
+		while (RowIndex < RowPoolItems.size() && RowPoolItems[RowIndex] >= GetItemCount()) RowIndex++;
+		if (RowIndex == RowPoolItems.size())
+		{
+			RowIndex = 0;
+			BindRowCaption(0, 0);
+		}
+		auto& Row = RowPool[RowIndex];
+		int w, h;
+		Row->Measure(RowWidthLimit, RowHeightLimit, w, h);
+		RowHeight = h + Row->YPadding * 2;
 	}
 
-	UIElementListItem& UIElementListView::GetItem(size_t Index) const
+	void UIElementListView::BindRows()
 	{
-		if (Index < size())
+		auto Count = GetItemCount();
+		if (!Count || !RowHeight)
+		{
+			if (NumChildren) Invalidate();
+			UnlinkChildren();
+			for (auto& Item : RowPoolItems) Item = size_t(-1);
+			return;
+		}
+
+		// 可见的行数，以屏幕高度为上限
+		int ViewHeight = ArrangedHeight - GetFrameHeight() * 2;
+		if (ViewHeight > FB.GetHeight()) ViewHeight = FB.GetHeight();
+		if (ViewHeight < 0) ViewHeight = 0;
+		auto NewRowSlots = size_t(ViewHeight / RowHeight) + 2;
+		if (NewRowSlots != RowSlots)
+		{
+			// 每一项数据对应的列表项都变了，之前的绑定全部作废。
+			// 否则编号超出新的 RowSlots 的列表项还记着可见的数据，`GetSelectedRow()` 会找到这些没有链接的列表项
+			for (auto& Item : RowPoolItems) Item = size_t(-1);
+			RowSlots = NewRowSlots;
+		}
+
+		size_t First = Scroll > 0 ? size_t(Scroll / RowHeight) : 0;
+		if (First >= Count) First = Count - 1;
+		size_t NumRows = std::min(RowSlots, Count - First);
+
+		for (auto& Item : RowPoolItems)
+		{
+			if (Item < First || Item >= First + NumRows) Item = size_t(-1);
+		}
+		// 边绑定边与当前链接的子组件比较，可见的行没有变化时就不必重新链接
+		bool RowsChanged = false;
+		auto OldRow = FirstChild;
+		for (size_t ItemIndex = First; ItemIndex < First + NumRows; ItemIndex++)
+		{
+			auto RowIndex = ItemIndex % RowSlots;
+			BindRowCaption(RowIndex, ItemIndex);
+			auto Row = RowPool[RowIndex];
+			if (Row->Selected != (ItemIndex == Selection))
+			{
+				Row->Selected = ItemIndex == Selection;
+				Row->Invalidate();
+			}
+
+			int w, h;
+			Row->ArrangedContainerWidth = RowWidthLimit;
+			Row->Measure(RowWidthLimit, RowHeightLimit, w, h);
+			Row->ArrangedContentsWidth = w;
+			Row->ArrangedContentsHeight = h;
+			Row->ArrangedWidth = RowWidthLimit - XPadding * 2;
+			Row->ArrangedHeight = RowHeight;
+			Row->ArrangedContainerHeight = RowHeight;
+			Row->ArrangedRelX = XPadding;
+			Row->ArrangedRelY = int(ItemIndex) * RowHeight + YPadding;
+
+			if (OldRow == Row) OldRow = OldRow->GetNextSibling();
+			else RowsChanged = true;
+		}
+		if (!RowsChanged && !OldRow) return;
+
+		// 可见的行变了，重新链接。重新记录后由显示列表比较出变化的部分
+		UnlinkChildren();
+		for (size_t ItemIndex = First; ItemIndex < First + NumRows; ItemIndex++)
 		{
-			return dynamic_cast<UIElementListItem&>(*SubElements[Index]);
+			LinkChild(*RowPool[ItemIndex % RowSlots]);
 		}
-		throw std::invalid_argument(std::string(__func__) + ": Index out of bound: index=" + std::to_string(Index) + ", bound=" + std::to_string(size()));
+		Invalidate();
 	}
 
-	UIElementListItem& UIElementListView::GetSelectedItem() const
+	void UIElementListView::GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight)
 	{
-		if (Selection < size())
+		RowWidthLimit = WidthLimit - GetFrameWidth() * 2;
+		if (RowWidthLimit < 0) RowWidthLimit = 0;
+		RowHeightLimit = HeightLimit - GetFrameHeight() * 2;
+		if (RowHeightLimit < 0) RowHeightLimit = 0;
+
+		// 行高乘以行数即为内容高度，不需要测量每一行
+		MeasureRowHeight();
+		auto Count = GetItemCount();
+		ActualWidth = Count ? RowWidthLimit - XPadding * 2 : 0;
+		TotalHeight = int(Count) * RowHeight;
+		SetArrangedSize(WidthLimit, HeightLimit, ActualWidth, TotalHeight);
+
+		// 数据变少或者列表变高以后，原来的滚动位置可能超出了内容
+		auto MaxScroll = GetMaxScroll();
+		if (Scroll > MaxScroll)
 		{
-			return dynamic_cast<UIElementListItem&>(*SubElements[Selection]);
+			ScrollAnimation.Stop();
+			Scroll = MaxScroll;
+			Invalidate();
 		}
-		throw std::invalid_argument(std::string(__func__) + ": Index out of bound: index=" + std::to_string(Selection) + ", bound=" + std::to_string(size()));
+		BindRows();
+	}
+
+	void UIElementListView::SetDataSource(std::shared_ptr<UIListDataSource> Source)
+	{
+		DataSource = Source ? Source : Items;
+		ReloadData();
+	}
+
+	void UIElementListView::ReloadData()
+	{
+		ScrollAnimation.Stop();
+		Invalidate();
+		for (auto& Item : RowPoolItems) Item = size_t(-1);
+		auto Count = GetItemCount();
+		if (Selection >= Count) Selection = Count ? Count - 1 : 0;
+		InvalidateLayout();
+	}
+
+	size_t UIElementListView::GetItemCount() const
+	{
+		return DataSource->GetItemCount();
+	}
+
+	std::string UIElementListView::GetItemKey(size_t Index) const
+	{
+		if (Index < GetItemCount())
+		{
+			return DataSource->GetItemKey(Index);
+		}
+		throw std::invalid_argument(std::string(__func__) + ": Index out of bound: index=" + std::to_string(Index) + ", bound=" + std::to_string(GetItemCount()));
+	}
+
+	std::string UIElementListView::GetItemCaption(size_t Index) const
+	{
+		if (Index < GetItemCount())
+		{
+			return DataSource->GetItemCaption(Index);
+		}
+		throw std::invalid_argument(std::string(__func__) + ": Index out of bound: index=" + std::to_string(Index) + ", bound=" + std::to_string(GetItemCount()));
+	}
+
+	std::string UIElementListView::GetSelectedKey() const
+	{
+		return GetItemKey(Selection);
+	}
+
+	size_t UIElementListView::AddItem(const std::string& Key, const std::string& Caption)
+	{
+		auto Count = Items->Add(Key, Caption);
+		if (Count == 1) Selection = 0;
+		if (DataSource == Items) InvalidateLayout();
+		return Count;
+	}
+
+	bool UIElementListView::RemoteItem(size_t Index)
+	{
+		if (!Items->Remove(Index)) return false;
+		if (DataSource == Items) ReloadData();
+		return true;
+	}
+
+	void UIElementListView::ClearItems()
+	{
+		Items->Clear();
+		if (DataSource != Items) return;
+		Scroll = 0;
+		ReloadData();
+	}
+
+	UIElementListItem* UIElementListView::GetSelectedRow() const
+	{
+		for (size_t i = 0; i < RowPoolItems.size(); i++)
+		{
+			if (RowPoolItems[i] == Selection) return RowPool[i];
+		}
+		return nullptr;
 	}
 
 	void UIElementListView::SelectNext()
 	{
-		if (!size()) return;
-		GetSelectedItem().Selected = false;
-		auto Prev = Selection++;
-		if (Selection >= size()) Selection = 0;
-		GetSelectedItem().Selected = true;
-		EnsureSelectedVisible();
+		auto Count = GetItemCount();
+		if (!Count) return;
+		Selection++;
+		if (Selection >= Count) Selection = 0;
+		EnsureSelectedVisible(true);
 	}
 
 	void UIElementListView::SelectPrev()
 	{
-		if (!size()) return;
-		GetSelectedItem().Selected = false;
-		auto Prev = Selection;
-		if (Selection == 0) Selection = size();
+		auto Count = GetItemCount();
+		if (!Count) return;
+		if (Selection == 0) Selection = Count;
 		Selection--;
-		GetSelectedItem().Selected = true;
-		EnsureSelectedVisible();
+		EnsureSelectedVisible(true);
 	}
 
 	void UIElementListView::SelectByIndex(size_t Index)
 	{
-		if (!size()) return;
-		GetSelectedItem().Selected = false;
+		auto Count = GetItemCount();
+		if (!Count) return;
 		Selection = Index;
-		if (Selection >= size()) Selection = size() - 1;
-		GetSelectedItem().Selected = true;
-		EnsureSelectedVisible();
+		if (Selection >= Count) Selection = Count - 1;
+		EnsureSelectedVisible(false);
 	}
 
 	size_t UIElementListView::GetSelectionIndex() const
@@ -711,8 +1205,26 @@ namespace TVOS
 		UIElementBase::Render(x, y, w, h);
 	}
 
-	UIElementListItem::UIElementListItem(Graphics& FB, const std::string& Name) :
-		UIElementLabel(FB, Name)
+	bool UIElementListView::AnimateMarquee()
+	{
+		auto Row = GetSelectedRow();
+		if (!Row) return false;
+		int ClientX = ArrangedAbsX + GetFrameWidth();
+		int ClientY = ArrangedAbsY + GetFrameHeight();
+		int ClientR = ArrangedAbsX + ArrangedWidth - 1 - GetFrameWidth();
+		int ClientB = ArrangedAbsY + ArrangedHeight - 1 - GetFrameHeight();
+		return Row->AdvanceMarquee(ClientX, ClientY, ClientR, ClientB);
+	}
+
+	bool UIElementListView::HasMarquee() const
+	{
+		auto Row = GetSelectedRow();
+		return Row && Row->IsMarqueeActive();
+	}
+
+	UIElementListItem::UIElementListItem(UIElementArena& Arena, const std::string& Name) :
+		UIElementLabel(Arena, Name),
+		MarqueeDelay(MarqueeHoldFrames)
 	{
 	}
 
@@ -729,7 +1241,396 @@ namespace TVOS
 			BorderColor = 0xFF000000;
 			FillColor = 0xFF000000;
 			FontColor = 0xFFFFFFFF;
+			ResetMarquee();
+		}
+		if (Selected && NeedMarquee())
+		{
+			UIElementBase::Render(x, y, w, h);
+			PrepareMarqueeStrip();
+			int WinX, WinY, WinR, WinB;
+			GetMarqueeWindow(WinX, WinY, WinR, WinB);
+			GetDisplayList().Image(WinX, WinY, WinR + 1 - WinX, WinB + 1 - WinY, MarqueeOffset, 0, MarqueeStrip);
+		}
+		else
+		{
+			UIElementLabel::Render(x, y, w, h);
+		}
+	}
+
+	void UIElementListItem::ResetMarquee()
+	{
+		MarqueeOffset = 0;
+		MarqueeDelay = MarqueeHoldFrames;
+	}
+
+	bool UIElementListItem::NeedMarquee() const
+	{
+		return CaptionWidth > ArrangedWidth - GetFrameWidth() * 2;
+	}
+
+	void UIElementListItem::PrepareMarqueeStrip()
+	{
+		if (MarqueeCaption == Caption && MarqueeFontColor == FontColor && MarqueeFillColor == FillColor && MarqueeStrip) return;
+
+		auto Text = FB.RenderTextStrip(Caption, FontColor, FillColor);
+		MarqueeStrip = std::make_shared<ImageBlock>(Text.w * 2 + MarqueeGap, Text.h, FillColor);
+		for (int y = 0; y < Text.h; y++)
+		{
+			auto Src = &Text.Pixels[size_t(y) * Text.w];
+			auto Dst = &MarqueeStrip->Pixels[size_t(y) * MarqueeStrip->w];
+			std::copy(Src, Src + Text.w, Dst);
+			std::copy(Src, Src + Text.w, Dst + Text.w + MarqueeGap);
+		}
+		MarqueeCaption = Caption;
+		MarqueeFontColor = FontColor;
+		MarqueeFillColor = FillColor;
+	}
+
+	void UIElementListItem::GetMarqueeWindow(int& WinX, int& WinY, int& WinR, int& WinB) const
+	{
+		int tx, ty;
+		GetCaptionPos(ArrangedAbsX, ArrangedAbsY, ArrangedWidth, ArrangedHeight, tx, ty);
+		WinX = ArrangedAbsX + GetFrameWidth();
+		WinR = ArrangedAbsX + ArrangedWidth - 1 - GetFrameWidth();
+		WinY = ty;
+		WinB = ty + MarqueeStrip->h - 1;
+	}
+
+	// 显示列表之外的快速路径：只有偏移量变了，直接画到屏幕上。下次 `Render()` 记录的偏移量与上一帧不同，会再画一遍这个区域。
+	void UIElementListItem::DrawMarqueeWindow(int ClipX, int ClipY, int ClipR, int ClipB)
+	{
+		PrepareMarqueeStrip();
+
+		int WinX, WinY, WinR, WinB;
+		GetMarqueeWindow(WinX, WinY, WinR, WinB);
+
+		int x = WinX > ClipX ? WinX : ClipX;
+		int y = WinY > ClipY ? WinY : ClipY;
+		int r = WinR < ClipR ? WinR : ClipR;
+		int b = WinB < ClipB ? WinB : ClipB;
+		if (r < x || b < y) return;
+
+		FB.DrawImage(*MarqueeStrip, x, y, r + 1 - x, b + 1 - y, MarqueeOffset + x - WinX, y - WinY);
+		FB.MarkDirty(x, y, r, b);
+	}
+
+	bool UIElementListItem::IsMarqueeActive() const
+	{
+		return Selected && NeedMarquee();
+	}
+
+	bool UIElementListItem::AdvanceMarquee(int ClipX, int ClipY, int ClipR, int ClipB)
+	{
+		if (!Selected || !NeedMarquee()) return false;
+		if (MarqueeDelay > 0)
+		{
+			MarqueeDelay--;
+			return false;
+		}
+
+		PrepareMarqueeStrip();
+		MarqueeOffset += MarqueeStep;
+		if (MarqueeOffset >= (MarqueeStrip->w + MarqueeGap) / 2)
+		{
+			MarqueeOffset = 0;
+			MarqueeDelay = MarqueeHoldFrames;
+		}
+		DrawMarqueeWindow(ClipX, ClipY, ClipR, ClipB);
+		InvalidateLayers(); // 直接画到了屏幕上，所在图层的缓存已经过时
+		return true;
+	}
+
+	UIElementThumbnailGrid::UIElementThumbnailGrid(UIElementArena& Arena, const std::string& Name) :
+		UIElementBase(Arena, Name)
+	{
+		ClipChildren = true;
+	}
+
+	int UIElementThumbnailGrid::GetCellWidth() const
+	{
+		return ThumbnailWidth + SelectionBorder * 2;
+	}
+
+	int UIElementThumbnailGrid::GetCellHeight() const
+	{
+		return ThumbnailHeight + SelectionBorder * 2 + FB.GetFontHeight();
+	}
+
+	void UIElementThumbnailGrid::GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight)
+	{
+		// 格子等大，列数由宽度决定，内容高度由行数算出，不需要测量每一项
+		if (CaptionFontHeight != FB.GetFontHeight())
+		{
+			for (auto& Item : Items) MeasureCaption(Item);
+			CaptionFontHeight = FB.GetFontHeight();
+		}
+		int ClientWidth = WidthLimit - GetFrameWidth() * 2;
+		Columns = (ClientWidth + CellSpacing) / (GetCellWidth() + CellSpacing);
+		if (Columns < 1) Columns = 1;
+		int Rows = int((Items.size() + Columns - 1) / Columns);
+		ActualWidth = Items.size() ? Columns * (GetCellWidth() + CellSpacing) - CellSpacing : 0;
+		TotalHeight = Rows ? Rows * (GetCellHeight() + CellSpacing) - CellSpacing : 0;
+		SetArrangedSize(WidthLimit, HeightLimit, ActualWidth, TotalHeight);
+		EnsureSelectedVisible();
+	}
+
+	void UIElementThumbnailGrid::EnsureSelectedVisible()
+	{
+		if (Items.empty() || ArrangedHeight <= 0) return;
+		int ViewHeight = ArrangedHeight - GetFrameHeight() * 2;
+		int PitchY = GetCellHeight() + CellSpacing;
+		int Top = int(Selection / Columns) * PitchY;
+		int OldScroll = Scroll;
+		if (Top < Scroll) Scroll = Top;
+		else if (Top + GetCellHeight() > Scroll + ViewHeight) Scroll = Top + GetCellHeight() - ViewHeight;
+		auto MaxScroll = GetMaxScroll();
+		if (Scroll > MaxScroll) Scroll = MaxScroll;
+		if (Scroll < 0) Scroll = 0;
+		if (Scroll != OldScroll) Invalidate();
+		RequestVisibleThumbnails();
+	}
+
+	void UIElementThumbnailGrid::MeasureCaption(GridItem& Item)
+	{
+		FB.GetTextMetrics(Item.Caption, Item.CaptionW, Item.CaptionH);
+	}
+
+	void UIElementThumbnailGrid::RequestVisibleThumbnails()
+	{
+		if (!OnThumbnailNeeded || Items.empty() || ArrangedHeight <= 0) return;
+		int ViewHeight = ArrangedHeight - GetFrameHeight() * 2;
+		int PitchY = GetCellHeight() + CellSpacing;
+		size_t First = size_t(Scroll / PitchY) * Columns;
+		size_t Last = std::min(Items.size(), (size_t((Scroll + ViewHeight - 1) / PitchY) + 1) * Columns);
+		for (size_t i = First; i < Last; i++)
+		{
+			if (Items[i].State != ThumbnailState::None) continue;
+			Items[i].State = ThumbnailState::Requested;
+			OnThumbnailNeeded(Items[i].Key);
+		}
+	}
+
+	void UIElementThumbnailGrid::Render(int x, int y, int w, int h)
+	{
+		UIElementBase::Render(x, y, w, h);
+
+		int ClientX = ArrangedAbsX + GetFrameWidth();
+		int ClientY = ArrangedAbsY + GetFrameHeight();
+		int ClientR = ArrangedAbsX + ArrangedWidth - 1 - GetFrameWidth();
+		int ClientB = ArrangedAbsY + ArrangedHeight - 1 - GetFrameHeight();
+		if (ClientR < ClientX || ClientB < ClientY || Items.empty()) return;
+
+		// 只记录与可视区域相交的行
+		auto& DL = GetDisplayList();
+		DL.PushClip({ ClientX, ClientY, ClientR, ClientB });
+		int CellW = GetCellWidth(), CellH = GetCellHeight();
+		int PitchX = CellW + CellSpacing, PitchY = CellH + CellSpacing;
+		size_t FirstRow = size_t(Scroll / PitchY);
+		size_t LastRow = size_t((Scroll + ClientB - ClientY) / PitchY);
+		for (size_t Row = FirstRow; Row <= LastRow; Row++)
+		{
+			for (int Col = 0; Col < Columns; Col++)
+			{
+				size_t i = Row * Columns + Col;
+				if (i >= Items.size()) break;
+				const auto& Item = Items[i];
+				int cx = ClientX + Col * PitchX;
+				int cy = ClientY + int(Row) * PitchY - Scroll;
+				int tx = cx + SelectionBorder, ty = cy + SelectionBorder;
+
+				if (i == Selection)
+				{
+					DL.Border({ cx, cy, cx + CellW - 1, ty + ThumbnailHeight + SelectionBorder - 1 }, SelectionBorder, SelectionBorder, SelectionColor);
+				}
+				if (Item.State == ThumbnailState::Ready)
+				{
+					DL.Image(tx, ty, std::min(ThumbnailWidth, Item.Thumbnail->w), std::min(ThumbnailHeight, Item.Thumbnail->h), 0, 0, Item.Thumbnail);
+				}
+				else
+				{
+					DL.FillRect({ tx, ty, tx + ThumbnailWidth - 1, ty + ThumbnailHeight - 1 }, Item.State == ThumbnailState::Failed ? FailedColor : PlaceholderColor);
+				}
+
+				// 标题居中，超出格子宽度的部分被裁掉
+				int CaptionX = Item.CaptionW < CellW ? cx + (CellW - Item.CaptionW) / 2 : cx;
+				int CaptionY = ty + ThumbnailHeight + SelectionBorder;
+				DL.PushClip({ cx, CaptionY, cx + CellW - 1, cy + CellH - 1 });
+				DL.Text(CaptionX, CaptionY, Item.CaptionW, Item.CaptionH, Item.Caption, true, FontColor);
+				DL.PopClip();
+			}
 		}
-		UIElementLabel::Render(x, y, w, h);
+		DL.PopClip();
+	}
+
+	bool UIElementThumbnailGrid::SetThumbnail(const std::string& Key, std::shared_ptr<const ImageBlock> Thumbnail)
+	{
+		auto it = ItemByKey.find(Key);
+		if (it == ItemByKey.end()) return false;
+		auto& Item = Items[it->second];
+		Item.Thumbnail = std::move(Thumbnail);
+		Item.State = Item.Thumbnail ? ThumbnailState::Ready : ThumbnailState::Failed;
+		Invalidate();
+		return true;
+	}
+
+	size_t UIElementThumbnailGrid::AddItem(const std::string& Key, const std::string& Caption)
+	{
+		ItemByKey[Key] = Items.size();
+		Items.emplace_back();
+		Items.back().Key = Key;
+		Items.back().Caption = Caption;
+		if (CaptionFontHeight == FB.GetFontHeight()) MeasureCaption(Items.back()); // 否则排版时全部重新测量
+		if (Items.size() == 1) Selection = 0;
+		InvalidateLayout();
+		return Items.size();
+	}
+
+	void UIElementThumbnailGrid::ClearItems()
+	{
+		Items.clear();
+		ItemByKey.clear();
+		Selection = 0;
+		Scroll = 0;
+		Invalidate();
+		InvalidateLayout();
+	}
+
+	size_t UIElementThumbnailGrid::GetItemCount() const
+	{
+		return Items.size();
+	}
+
+	std::string UIElementThumbnailGrid::GetSelectedKey() const
+	{
+		if (Selection < Items.size()) return Items[Selection].Key;
+		throw std::invalid_argument(std::string(__func__) + ": Index out of bound: index=" + std::to_string(Selection) + ", bound=" + std::to_string(Items.size()));
+	}
+
+	void UIElementThumbnailGrid::SelectNext()
+	{
+		if (Items.empty()) return;
+		Selection++;
+		if (Selection >= Items.size()) Selection = 0;
+		Invalidate();
+		EnsureSelectedVisible();
+	}
+
+	void UIElementThumbnailGrid::SelectPrev()
+	{
+		if (Items.empty()) return;
+		if (Selection == 0) Selection = Items.size();
+		Selection--;
+		Invalidate();
+		EnsureSelectedVisible();
+	}
+
+	void UIElementThumbnailGrid::SelectByIndex(size_t Index)
+	{
+		if (Items.empty()) return;
+		Selection = Index < Items.size() ? Index : Items.size() - 1;
+		Invalidate();
+		EnsureSelectedVisible();
+	}
+
+	size_t UIElementThumbnailGrid::GetSelectionIndex() const
+	{
+		return Selection;
+	}
+
+	UIScreen::UIScreen(Graphics& FB, const std::string& Name) :
+		Name(Name),
+		Arena(FB),
+		Root(Arena.Create<UIElementBase>("root"))
+	{
+	}
+
+	const std::string& UIScreen::GetName() const
+	{
+		return Name;
+	}
+
+	UIElementArena& UIScreen::GetArena()
+	{
+		return Arena;
+	}
+
+	UIElementBase& UIScreen::GetRoot() const
+	{
+		return *Root;
+	}
+
+	bool UIScreen::HasSurface() const
+	{
+		return Surface != nullptr;
+	}
+
+	UIScreenManager::UIScreenManager(Graphics& FB) :
+		FB(FB)
+	{
+	}
+
+	UIScreen& UIScreenManager::CreateScreen(const std::string& Name)
+	{
+		Screens.push_back(std::make_unique<UIScreen>(FB, Name));
+		return *Screens.back();
+	}
+
+	UIScreen* UIScreenManager::FindScreen(const std::string& Name) const
+	{
+		for (auto& Screen : Screens)
+		{
+			if (Screen->Name == Name) return Screen.get();
+		}
+		return nullptr;
+	}
+
+	UIScreen* UIScreenManager::GetActive() const
+	{
+		return Active;
+	}
+
+	bool UIScreenManager::SwitchTo(UIScreen& Screen)
+	{
+		if (Active == &Screen) return true;
+
+		// 目标界面的缓存换入作为后台缓冲区，换出来的就是当前界面最后的画面。
+		// 目标界面没有缓存时换入一块新的缓冲区，当前界面的画面同样留作缓存。
+		std::shared_ptr<ImageBlock> OldBackBuffer;
+		bool UsedSurface = false;
+		if (Screen.Surface)
+		{
+			OldBackBuffer = FB.SwapBackBuffer(Screen.Surface);
+			UsedSurface = OldBackBuffer != nullptr;
+		}
+		else if (Active)
+		{
+			OldBackBuffer = FB.SwapBackBuffer(std::make_shared<ImageBlock>(FB.GetWidth(), FB.GetHeight()));
+		}
+		Screen.Surface = nullptr;
+		if (Active) Active->Surface = OldBackBuffer;
+
+		if (UsedSurface)
+		{
+			SurfaceHits++;
+		}
+		else
+		{ // 新换入的缓冲区已经是黑色的，没能换入时清空当前的缓冲区
+			if (!OldBackBuffer) FB.ClearScreen(0);
+			Screen.GetRoot().InvalidateScreen();
+			SurfaceMisses++;
+		}
+		FB.MarkDirty(0, 0, FB.GetWidth() - 1, FB.GetHeight() - 1);
+		Active = &Screen;
+		return UsedSurface;
+	}
+
+	void UIScreenManager::Render()
+	{
+		if (Active) Active->GetRoot().Render();
+	}
+
+	void UIScreenManager::InvalidateScreen()
+	{
+		if (Active) Active->GetRoot().InvalidateScreen();
 	}
 }
@@ -1,9 +1,15 @@
 ﻿#pragma once
 #include "graphics.hpp"
+#include "displaylist.hpp"
+#include "animation.hpp"
 
-#include <map>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 
 namespace TVOS
 {
@@ -20,6 +26,55 @@ namespace TVOS
 		RightBottom = 10,
 	};
 
+	// 一次 `UIElementBase::Render()` 的开销统计
+	struct UIRenderStats
+	{
+		size_t Regions = 0; // 重绘的区域数
+		size_t RegionPixels = 0; // 重绘区域的总面积
+		size_t ElementsVisited = 0;
+		size_t Commands = 0; // 记录下来的绘图命令数，没有记录新的一帧时为 0
+		size_t CommandsRasterized = 0; // 与重绘区域相交而被执行的绘图命令数
+		uint64_t PixelsWritten = 0;
+		uint64_t PixelsRead = 0;
+		size_t LayersReused = 0; // 直接使用了缓存图像的图层数
+		size_t LayersRendered = 0; // 重新绘制了缓存图像的图层数
+		uint64_t LayerPixelsWritten = 0; // 绘制到图层缓存图像里的像素数，不计入 `PixelsWritten`
+	};
+
+	class UIElementBase;
+	class UIElementArena;
+
+	// 驻留后的组件名字的编号，同一个竞技场里相同的名字编号相同
+	using UINameId = uint32_t;
+
+	// 组件的句柄。组件归 `UIElementArena` 所有，句柄记录组件的编号与创建时竞技场的代数，
+	// 竞技场 `Reset()` 之后旧的句柄自动失效，`get()` 返回 nullptr。
+	template<typename T>
+	class UIHandle
+	{
+		template<typename U> friend class UIHandle;
+		friend class UIElementArena;
+
+	protected:
+		UIElementArena* Arena = nullptr;
+		uint32_t Index = 0;
+		uint32_t Generation = 0;
+
+		UIHandle(UIElementArena* Arena, uint32_t Index, uint32_t Generation);
+
+	public:
+		UIHandle() = default;
+
+		// 派生类的句柄可以当作基类的句柄使用
+		template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+		UIHandle(const UIHandle<U>& other);
+
+		T* get() const;
+		T* operator -> () const;
+		T& operator * () const;
+		explicit operator bool() const;
+	};
+
 	bool IsLeft(AlignmentType alignment);
 	bool IsTop(AlignmentType alignment);
 	bool IsRight(AlignmentType alignment);
@@ -28,13 +83,79 @@ namespace TVOS
 
 	class UIElementBase
 	{
+		friend class UIElementArena;
+
 	protected:
+		UIElementArena& Arena;
 		Graphics& FB;
-		std::string Name;
+		UINameId NameId;
+
+		// 组件树直接链接在组件里：子组件是一个双向链表，组件的内存由竞技场管理，不会移动。
+		UIElementBase* Parent = nullptr;
+		UIElementBase* FirstChild = nullptr;
+		UIElementBase* LastChild = nullptr;
+		UIElementBase* PrevSibling = nullptr;
+		UIElementBase* NextSibling = nullptr;
+		size_t NumChildren = 0;
+
+		// 只修改链表，不使布局失效。由 `InsertElement()` 等接口以及自己管理子组件的列表框使用。
+		void LinkChild(UIElementBase& Element);
+		void UnlinkChild(UIElementBase& Element);
+		void UnlinkChildren();
+
+		// 上次测量的结果，以测量时的宽高限制为键，`NeedRearrange` 为 false 且限制相同时直接使用。
+		int MeasuredWidthLimit = -1;
+		int MeasuredHeightLimit = -1;
+		int MeasuredWidth = 0;
+		int MeasuredHeight = 0;
+
+		// 上次排列子组件位置时的输入。没有变化、自身也没有重新测量过时，子组件的位置都不会变，不必进入这个子树
+		bool NeedReposition = true;
+		int PositionedX = 0;
+		int PositionedY = 0;
+		int PositionedContainerWidth = 0;
+		int PositionedContainerHeight = 0;
+		int PositionedContentsWidth = 0;
+		int PositionedContentsHeight = 0;
+
+		// 根组件上的状态：界面是否需要重新记录，以及除了显示列表的差异以外还需要重绘的区域
+		bool NeedRepaint = true;
+		std::vector<UIRect> InvalidRegion;
+		static constexpr size_t MaxInvalidRects = 8;
+
+		// 根组件上记录的显示列表。`Render(x, y, w, h)` 将绘图命令记录到 `Frame`，与 `LastFrame` 比较后交换。
+		DisplayList Frame;
+		DisplayList LastFrame;
+
+		// 图层的缓存：子树的绘图命令平移后执行到 `LayerFB` 的后台缓冲区里，显示列表中只记录一条贴图命令。
+		// 两块图像交替使用，重新绘制后指针改变，比较显示列表时就能发现。
+		bool LayerDirty = true;
+		DisplayList LayerCommands;
+		std::unique_ptr<Graphics> LayerFB;
+		std::shared_ptr<ImageBlock> LayerSurface;
+
+		UIRect GetRect() const;
+		UIRect GetLayerRect() const; // 图层缓存的范围：去掉外边距后的区域
+		UIRect GetFillRect() const; // 不透明时用 `FillColor` 填充的范围：边框以内的区域
+		UIElementBase& GetRoot();
+		DisplayList& GetDisplayList(); // 正在记录的显示列表
+		void AddInvalidRect(const UIRect& Rect);
+		void InvalidateLayers(); // 使自身及上级组件中的图层缓存失效
+		void RenderLayer(int x, int y, int w, int h, const UIRect& LayerRect);
 
 	public:
-		UIElementBase(Graphics& FB, const std::string& Name);
+		// 组件只能由 `UIElementArena::Create()` 创建
+		UIElementBase(UIElementArena& Arena, const std::string& Name);
+		virtual ~UIElementBase() = default;
+		UIElementBase(const UIElementBase&) = delete;
+		UIElementBase& operator = (const UIElementBase&) = delete;
+
 		const std::string& GetName() const;
+		UINameId GetNameId() const;
+		UIElementArena& GetArena() const;
+		UIElementBase* GetParent() const;
+		UIElementBase* GetFirstChild() const;
+		UIElementBase* GetNextSibling() const;
 
 		int ArrangedRelX = 0;
 		int ArrangedRelY = 0;
@@ -46,7 +167,7 @@ namespace TVOS
 		int ArrangedContainerHeight = 0;
 		int ArrangedAbsX = 0;
 		int ArrangedAbsY = 0;
-		bool NeedRearrange = true;
+		bool NeedRearrange = true; // 自身或子组件的大小可能变了，测量结果不能再用。请使用 `InvalidateLayout()` 设置
 
 		int XPadding = 0;
 		int YPadding = 0;
@@ -63,11 +184,16 @@ namespace TVOS
 		bool ExpandToParentY = false;
 		bool LineBreak = false;
 
+		// 将自身及子组件绘制到离屏图像中缓存起来，没有失效时直接贴图，适合标题栏等很少变化的区域。
+		// 子树里任何组件 `Invalidate()` 或 `InvalidateLayout()` 都会使缓存失效，重新绘制整个图层。
+		// 缓存只包括外边距以内的部分，所以组件必须不透明；`Transparent` 的组件忽略这个选项。
+		bool CacheAsLayer = false;
+		size_t LayerHits = 0;
+		size_t LayerMisses = 0;
+
 		int Scroll = 0;
 		int GetMaxScroll() const;
 
-		std::shared_ptr<UIElementBase> FindElement(const std::string& Name);
-
 		int GetFrameWidth() const;
 		int GetFrameHeight() const;
 
@@ -75,36 +201,68 @@ namespace TVOS
 		// 子组件的 `ArrangedRelX` `ArrangedRelY` `ArrangedWidth` `ArrangedHeight` `ArrangedContainerWidth` `ArrangedContainerHeight` 会被修改。
 		virtual void GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight);
 
+		// 带缓存的 `GetClientContentsSize()`，父组件排列子组件时使用。
+		void Measure(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight);
+
+		// 按测量结果与可用空间设置自身的 `Arranged*` 大小，供 `GetClientContentsSize()` 的实现使用。
+		void SetArrangedSize(int WidthSpace, int HeightSpace, int ActualWidth, int TotalHeight);
+
+		// 自身的大小可能发生了变化：使自身以及所有上级组件的测量结果失效，下次渲染时由根组件重新排列。
+		// 没有失效的兄弟组件及其子组件会直接使用缓存的测量结果。
+		void InvalidateLayout();
+
+		// 以 (x, y) 为客户区原点计算子组件的绝对位置。只进入测量结果或位置变了的子树，标题变化时只排列标题和它的上级组件。
 		void ArrangeSubElementsAbsPos(int x, int y);
 
 		// 使自身和所有子组件进行顺序位置的排列。
 		void ArrangeElements(int x, int y, int w, int h);
 	 
 		virtual void Render(int x, int y, int w, int h);
+
+		// 父组件记录子组件时使用：`CacheAsLayer` 的组件记录为一条贴图命令，否则直接 `Render()`。
+		void RenderElement(int x, int y, int w, int h);
+
+		// 作为根组件绘制：重新记录显示列表并与上一帧比较，只重绘有差异的区域，并将这些区域标记为脏区域。
+		// 没有组件失效时什么都不做。
 		void Render();
 		void RearrangeElementsAsRoot();
 
-	protected:
-		std::map<std::string, std::shared_ptr<UIElementBase>> SubElementsMap;
-		std::vector<std::shared_ptr<UIElementBase>> SubElements;
+		// 自身的外观变了，下次 `Render()` 时重新记录显示列表。具体哪里需要重绘由比较显示列表得出。
+		// 重新排列后位置或大小发生变化的组件也会被比较出来，不需要调用。
+		void Invalidate();
 
-	public:
-		std::shared_ptr<UIElementBase> GetElementByName(const std::string& Name);
+		// 屏幕内容被别的程序破坏了（例如 `ClearScreen()`），下次 `Render()` 时整个重绘。
+		void InvalidateScreen();
+
+		// 根组件上一次记录的显示列表，可用 `Serialize()` 输出比较
+		const DisplayList& GetLastFrame() const;
 
-		UIElementBase& InsertElement(std::shared_ptr<UIElementBase> Element);
-		bool RemoveElement(const std::string& Name);
+		UIRenderStats LastRenderStats; // 根组件上一次 `Render()` 的开销
+
+		// 将组件加为最后一个子组件，组件原来有父组件的话先从那里移除。组件必须属于同一个竞技场。
+		UIElementBase& InsertElement(UIElementBase& Element);
+
+		// 从子组件中移除，组件本身仍然存在，直到竞技场 `Reset()`。
+		bool RemoveElement(UIElementBase& Element);
 		void ClearElements();
 
-		decltype(SubElements.cbegin()) cbegin() const;
-		decltype(SubElements.cend()) cend() const;
-		decltype(SubElements.begin()) begin();
-		decltype(SubElements.end()) end();
-		decltype(SubElements.size()) size() const;
-		decltype(SubElements.front()) front();
-		decltype(SubElements.back()) back();
-		decltype(SubElements.at(size_t(0))) at(size_t Index);
-		decltype(SubElementsMap.at("")) at(const std::string& Name);
-		decltype(SubElementsMap.count("")) count(const std::string& Name);
+		class ChildIterator
+		{
+		protected:
+			UIElementBase* Element;
+
+		public:
+			ChildIterator(UIElementBase* Element);
+			UIElementBase& operator * () const;
+			UIElementBase* operator -> () const;
+			ChildIterator& operator ++ ();
+			bool operator == (const ChildIterator& other) const;
+			bool operator != (const ChildIterator& other) const;
+		};
+
+		ChildIterator begin() const;
+		ChildIterator end() const;
+		size_t size() const;
 	};
 
 	class UIElementLabel : public UIElementBase
@@ -112,10 +270,10 @@ namespace TVOS
 	protected:
 		std::string Caption;
 		int CaptionWidth = 0;
-		int CaptionHeight = 22;
+		int CaptionHeight = 0; // 没有标题时也按当前字体的字高占位
 
 	public:
-		UIElementLabel(Graphics& FB, const std::string& Name);
+		UIElementLabel(UIElementArena& Arena, const std::string& Name);
 
 		uint32_t FontColor = 0xFFFFFFFF;
 
@@ -124,46 +282,407 @@ namespace TVOS
 		void SetCaption(const std::string& Caption);
 		const std::string& GetCaption() const;
 		void GetCaptionSize(int& w, int& h) const;
+		void GetCaptionPos(int x, int y, int w, int h, int& tx, int& ty) const;
 
 		virtual void Render(int x, int y, int w, int h);
 	};
 
 	class UIElementListItem : public UIElementLabel
 	{
+	protected:
+		// 选中且标题超出宽度时横向滚动显示标题。
+		// 标题只渲染一次到离屏图像（标题 + 空白 + 标题），之后每帧只从中复制一段到标题区域。
+		// 内容变化时换一个新的图像，这样显示列表按指针比较就能知道图像变了。
+		std::shared_ptr<ImageBlock> MarqueeStrip;
+		std::string MarqueeCaption;
+		uint32_t MarqueeFontColor = 0;
+		uint32_t MarqueeFillColor = 0;
+		int MarqueeOffset = 0;
+		int MarqueeDelay = 0;
+
+		bool NeedMarquee() const;
+		void PrepareMarqueeStrip();
+		void GetMarqueeWindow(int& WinX, int& WinY, int& WinR, int& WinB) const;
+		void DrawMarqueeWindow(int ClipX, int ClipY, int ClipR, int ClipB);
+
 	public:
-		UIElementListItem(Graphics& FB, const std::string& Name);
+		UIElementListItem(UIElementArena& Arena, const std::string& Name);
+
+		static constexpr int MarqueeGap = 40; // 滚动时首尾之间的空白宽度
+		static constexpr int MarqueeStep = 2; // 每帧滚动的像素数
+		static constexpr int MarqueeHoldFrames = 20; // 滚动开始前以及每滚完一轮后停留的帧数
 
 		bool Selected = false;
 		virtual void Render(int x, int y, int w, int h);
+
+		// 滚动一帧，只重绘标题区域并标记其为脏区域，返回是否进行了绘制。
+		bool AdvanceMarquee(int ClipX, int ClipY, int ClipR, int ClipB);
+		void ResetMarquee();
+		bool IsMarqueeActive() const; // 选中且标题放不下
+	};
+
+	// 列表框的数据源，列表框只在某一项需要显示时才读取它。
+	class UIListDataSource
+	{
+	public:
+		virtual ~UIListDataSource() = default;
+		virtual size_t GetItemCount() const = 0;
+		virtual std::string GetItemKey(size_t Index) const = 0;
+		virtual std::string GetItemCaption(size_t Index) const = 0;
 	};
 
-	class UIElementListView : public UIElementBase
+	// 用字符串数组保存的数据源，`UIElementListView::AddItem()` 默认使用它。
+	class UIListStringSource : public UIListDataSource
 	{
 	protected:
-		void EnsureSelectedVisible();
+		std::vector<std::pair<std::string, std::string>> Items;
+
+	public:
+		virtual size_t GetItemCount() const;
+		virtual std::string GetItemKey(size_t Index) const;
+		virtual std::string GetItemCaption(size_t Index) const;
+
+		size_t Add(const std::string& Key, const std::string& Caption);
+		bool Remove(size_t Index);
+		void Clear();
+	};
+
+	// 浏览文件一类的选择组件的公共操作，列表框与缩略图网格都实现它，主程序可以任选其一。
+	class UIItemBrowser
+	{
+	public:
+		virtual ~UIItemBrowser() = default;
+
+		virtual size_t AddItem(const std::string& Key, const std::string& Caption) = 0;
+		virtual void ClearItems() = 0;
+		virtual size_t GetItemCount() const = 0;
+		virtual std::string GetSelectedKey() const = 0;
+
+		virtual void SelectNext() = 0;
+		virtual void SelectPrev() = 0;
+		virtual void SelectByIndex(size_t Index) = 0;
+		virtual size_t GetSelectionIndex() const = 0;
+	};
+
+	// 虚拟化的列表框：只为与可视区域相交的行创建列表项，滚动时重复利用这些列表项显示别的数据。
+	// 所有的行等高，只有当前可见的行链接为子组件。
+	class UIElementListView : public UIElementBase, public UIItemBrowser
+	{
+	protected:
+		void EnsureSelectedVisible(bool Animate);
+		UIElementListItem* CreateRow(size_t RowIndex);
+		void BindRows();
 
 		size_t Selection = 0;
+		std::shared_ptr<UIListStringSource> Items;
+		std::shared_ptr<UIListDataSource> DataSource;
+
+		// 创建过的列表项，滚动时循环使用。第 n 项数据总是由 `RowPool[n % RowSlots]` 显示，
+		// 这样滚动一行只需要重新绑定一个列表项。`RowPoolItems` 记录每个列表项当前显示的是哪一项数据。
+		std::vector<UIElementListItem*> RowPool;
+		std::vector<size_t> RowPoolItems;
+		size_t RowSlots = 0;
+		int RowHeight = 0;
+		int RowWidthLimit = 0;
+		int RowHeightLimit = 0;
+
+		// 选中项移出可视区域时的滚动动画，每一帧改变 `Scroll` 并重新绑定可见的行
+		UIAnimation ScrollAnimation;
+
+		void BindRowCaption(size_t RowIndex, size_t ItemIndex);
+		void MeasureRowHeight();
+		UIElementListItem* GetSelectedRow() const;
 
 	public:
-		UIElementListView(Graphics& FB, const std::string& Name);
+		UIElementListView(UIElementArena& Arena, const std::string& Name);
 
 		uint32_t FontColor = 0xFFFFFFFF;
 
+		// 设置后 `SelectNext()` `SelectPrev()` 平滑滚动，否则直接跳到目标位置
+		UIAnimationScheduler* Animator = nullptr;
+		UIAnimation::Clock::duration ScrollDuration = std::chrono::milliseconds(120);
+
 		virtual void GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight);
 
-		size_t AddItem(const std::string& Key, const std::string& Caption);
+		// 设置数据源，传入 nullptr 则恢复使用内置的字符串数据源。数据源的内容变化后需调用 `ReloadData()`。
+		void SetDataSource(std::shared_ptr<UIListDataSource> Source);
+		void ReloadData();
+		virtual size_t GetItemCount() const;
+		std::string GetItemKey(size_t Index) const;
+		std::string GetItemCaption(size_t Index) const;
+		virtual std::string GetSelectedKey() const;
+
+		// 以下操作内置的字符串数据源
+		virtual size_t AddItem(const std::string& Key, const std::string& Caption);
 		bool RemoteItem(size_t Index);
-		UIElementListItem& GetItem(size_t Index) const;
-		UIElementListItem& GetSelectedItem() const;
+		virtual void ClearItems();
+
+		virtual void SelectNext();
+		virtual void SelectPrev();
+		virtual void SelectByIndex(size_t Index);
+		virtual size_t GetSelectionIndex() const;
+
+		virtual void Render(int x, int y, int w, int h);
+
+		// 推进选中项标题的滚动动画，返回是否进行了绘制。
+		bool AnimateMarquee();
+
+		// 选中项的标题是否放不下需要滚动，不需要时主循环不用为它定时醒来
+		bool HasMarquee() const;
+	};
+
+	// 缩略图网格：每一项是一张缩略图加上标题，按行排列，只记录与可视区域相交的格子。
+	// 缩略图由外部异步提供：格子第一次可见时调用 `OnThumbnailNeeded`，先画占位框，`SetThumbnail()` 之后再画图。
+	class UIElementThumbnailGrid : public UIElementBase, public UIItemBrowser
+	{
+	protected:
+		enum class ThumbnailState : uint8_t
+		{
+			None,
+			Requested,
+			Ready,
+			Failed,
+		};
+
+		struct GridItem
+		{
+			std::string Key;
+			std::string Caption;
+			int CaptionW = 0; // 加入时测量，字体变了在排版时重新测量
+			int CaptionH = 0;
+			ThumbnailState State = ThumbnailState::None;
+			std::shared_ptr<const ImageBlock> Thumbnail;
+		};
+
+		std::vector<GridItem> Items;
+		std::unordered_map<std::string, size_t> ItemByKey;
+		size_t Selection = 0;
+		int Columns = 1;
+		int CaptionFontHeight = 0; // 测量标题时的字体高度，与当前字体不同时排版时全部重新测量
+
+		int GetCellWidth() const;
+		int GetCellHeight() const;
+		void MeasureCaption(GridItem& Item);
+		void EnsureSelectedVisible(); // 滚动后为新出现的格子请求缩略图
+		void RequestVisibleThumbnails();
+
+	public:
+		UIElementThumbnailGrid(UIElementArena& Arena, const std::string& Name);
+
+		int ThumbnailWidth = 96;
+		int ThumbnailHeight = 54;
+		int CellSpacing = 6;
+		int SelectionBorder = 2; // 选中框的宽度，缩略图四周总是留出这么宽的空间
+		uint32_t FontColor = 0xFFFFFFFF;
+		uint32_t SelectionColor = 0xFFFFFFFF;
+		uint32_t PlaceholderColor = 0xFF303030;
+		uint32_t FailedColor = 0xFF602020;
 
-		void SelectNext();
-		void SelectPrev();
-		void SelectByIndex(size_t Index);
-		size_t GetSelectionIndex() const;
+		std::function<void(const std::string& Key)> OnThumbnailNeeded;
 
+		virtual void GetClientContentsSize(int WidthLimit, int HeightLimit, int& ActualWidth, int& TotalHeight);
 		virtual void Render(int x, int y, int w, int h);
+
+		// 提供某一项的缩略图，nullptr 表示提取失败。返回是否找到了这一项。
+		bool SetThumbnail(const std::string& Key, std::shared_ptr<const ImageBlock> Thumbnail);
+
+		virtual size_t AddItem(const std::string& Key, const std::string& Caption);
+		virtual void ClearItems();
+		virtual size_t GetItemCount() const;
+		virtual std::string GetSelectedKey() const;
+
+		virtual void SelectNext();
+		virtual void SelectPrev();
+		virtual void SelectByIndex(size_t Index);
+		virtual size_t GetSelectionIndex() const;
+	};
+
+	// 组件的竞技场：所有组件按创建顺序放在几块连续的大内存里，由竞技场统一析构。
+	// 一个界面的组件放在同一个竞技场里，换界面时 `Reset()` 一次释放全部组件，之前的句柄随之失效。
+	class UIElementArena
+	{
+		template<typename T> friend class UIHandle;
+
+	protected:
+		Graphics& FB;
+
+		struct Chunk
+		{
+			std::unique_ptr<uint8_t[]> Data;
+			size_t Size = 0;
+			size_t Used = 0;
+		};
+		static constexpr size_t ChunkSize = 16384;
+		std::vector<Chunk> Chunks;
+		size_t CurChunk = 0;
+
+		// 按编号排列的组件以及它们的实际类型，句柄与按名字查找都使用这个编号
+		std::vector<UIElementBase*> Elements;
+		std::vector<const void*> ElementTypes;
+		uint32_t Generation = 0;
+
+		// 驻留的名字在 `Reset()` 之后保留，重建同样的界面时不需要再分配
+		std::unordered_map<std::string, UINameId> NameIds;
+		std::vector<std::string> Names;
+		std::vector<uint32_t> ElementByName; // 名字编号 -> 最后创建的同名组件的编号
+		static constexpr uint32_t NoElement = uint32_t(-1);
+
+		void* Allocate(size_t Size, size_t Align);
+		uint32_t Register(UIElementBase* Element, const void* TypeTag);
+		UIElementBase* GetElement(uint32_t Index, uint32_t HandleGeneration) const;
+
+		// 每个类型一个唯一的地址，用来代替 `dynamic_cast` 检查组件的类型
+		template<typename T>
+		static const void* GetTypeTag()
+		{
+			static const char Tag = 0;
+			return &Tag;
+		}
+
+	public:
+		UIElementArena(Graphics& FB);
+		~UIElementArena();
+		UIElementArena(const UIElementArena&) = delete;
+		UIElementArena& operator = (const UIElementArena&) = delete;
+
+		Graphics& GetGraphics() const;
+
+		template<typename T>
+		UIHandle<T> Create(const std::string& Name);
+
+		// 按名字查找，类型不符或找不到时返回空句柄。查找 `UIElementBase` 时不检查类型。
+		template<typename T>
+		UIHandle<T> Find(const std::string& Name) const;
+		template<typename T>
+		UIHandle<T> Find(UINameId NameId) const;
+
+		UINameId Intern(const std::string& Name);
+		bool FindName(const std::string& Name, UINameId& NameId) const;
+		const std::string& GetName(UINameId NameId) const;
+
+		size_t size() const;
+		size_t GetReservedBytes() const;
+
+		// 按创建的逆序析构所有组件，保留已分配的内存供之后使用
+		void Reset();
 	};
 
+	template<typename T>
+	UIHandle<T>::UIHandle(UIElementArena* Arena, uint32_t Index, uint32_t Generation) :
+		Arena(Arena),
+		Index(Index),
+		Generation(Generation)
+	{
+	}
+
+	template<typename T>
+	template<typename U, typename>
+	UIHandle<T>::UIHandle(const UIHandle<U>& other) :
+		Arena(other.Arena),
+		Index(other.Index),
+		Generation(other.Generation)
+	{
+	}
+
+	template<typename T>
+	T* UIHandle<T>::get() const
+	{
+		if (!Arena) return nullptr;
+		return static_cast<T*>(Arena->GetElement(Index, Generation));
+	}
+
+	template<typename T>
+	T* UIHandle<T>::operator -> () const
+	{
+		return get();
+	}
+
+	template<typename T>
+	T& UIHandle<T>::operator * () const
+	{
+		return *get();
+	}
+
+	template<typename T>
+	UIHandle<T>::operator bool() const
+	{
+		return get() != nullptr;
+	}
+
+	template<typename T>
+	UIHandle<T> UIElementArena::Create(const std::string& Name)
+	{
+		static_assert(std::is_base_of<UIElementBase, T>::value, "Only UI elements can be created in the arena.");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned UI elements are not supported.");
+		auto Element = new (Allocate(sizeof(T), alignof(T))) T(*this, Name);
+		return UIHandle<T>(this, Register(Element, GetTypeTag<T>()), Generation);
+	}
+
+	template<typename T>
+	UIHandle<T> UIElementArena::Find(UINameId NameId) const
+	{
+		if (NameId >= ElementByName.size()) return UIHandle<T>();
+		auto Index = ElementByName[NameId];
+		if (Index == NoElement) return UIHandle<T>();
+		if (!std::is_same<T, UIElementBase>::value && ElementTypes[Index] != GetTypeTag<T>()) return UIHandle<T>();
+		return UIHandle<T>(const_cast<UIElementArena*>(this), Index, Generation);
+	}
+
+	template<typename T>
+	UIHandle<T> UIElementArena::Find(const std::string& Name) const
+	{
+		UINameId NameId;
+		if (!FindName(Name, NameId)) return UIHandle<T>();
+		return Find<T>(NameId);
+	}
+
+	// 一个界面：组件都在自己的竞技场里，只建立一次。不显示时保存它最后一帧的画面，切换回来时直接换入。
+	class UIScreen
+	{
+		friend class UIScreenManager;
+
+	protected:
+		std::string Name;
+		UIElementArena Arena;
+		UIHandle<UIElementBase> Root;
+		std::shared_ptr<ImageBlock> Surface; // 不是当前界面时保存的画面，与根组件上一次记录的显示列表一致
+
+	public:
+		UIScreen(Graphics& FB, const std::string& Name);
+
+		const std::string& GetName() const;
+		UIElementArena& GetArena();
+		UIElementBase& GetRoot() const;
+		bool HasSurface() const;
+	};
+
+	// 界面管理器：切换当前界面，并把切换走的界面的后台缓冲区留作它的缓存。
+	// 切换到有缓存的界面只需换入它的后台缓冲区并整屏刷新一次，之后 `Render()` 只重绘数据变了的部分。
+	class UIScreenManager
+	{
+	protected:
+		Graphics& FB;
+		std::vector<std::unique_ptr<UIScreen>> Screens;
+		UIScreen* Active = nullptr;
+
+	public:
+		UIScreenManager(Graphics& FB);
+
+		UIScreen& CreateScreen(const std::string& Name);
+		UIScreen* FindScreen(const std::string& Name) const;
+		UIScreen* GetActive() const;
+
+		// 返回是否使用了缓存的画面。没有缓存时（第一次显示，或不在后台缓冲区模式）整个重绘。
+		bool SwitchTo(UIScreen& Screen);
+
+		void Render(); // 绘制当前界面
+
+		// 当前界面的画面被别的程序破坏了（例如 `ClearScreen()`），下次 `Render()` 时整个重绘
+		void InvalidateScreen();
+
+		size_t SurfaceHits = 0; // 切换时使用了缓存画面的次数
+		size_t SurfaceMisses = 0;
+	};
 }
 
 
@@ -0,0 +1,182 @@
+﻿#include "hotplug.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#if !defined(_MSC_VER)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+namespace TVOS
+{
+	std::string UEvent::Get(const std::string& Key) const
+	{
+		auto it = Vars.find(Key);
+		return it == Vars.end() ? "" : it->second;
+	}
+
+	bool ParseUEvent(const char* Data, size_t Size, UEvent& Event)
+	{
+		Event = UEvent();
+		size_t Pos = 0;
+		bool First = true;
+		while (Pos < Size)
+		{
+			auto Length = strnlen(Data + Pos, Size - Pos);
+			std::string Field(Data + Pos, Length);
+			Pos += Length + 1;
+			if (First)
+			{ // 内核消息以 "ACTION@DEVPATH" 开头
+				auto At = Field.find('@');
+				if (At == std::string::npos) return false;
+				Event.Action = Field.substr(0, At);
+				Event.DevPath = Field.substr(At + 1);
+				First = false;
+				continue;
+			}
+			auto Eq = Field.find('=');
+			if (Eq != std::string::npos) Event.Vars[Field.substr(0, Eq)] = Field.substr(Eq + 1);
+		}
+		if (First) return false;
+		auto Action = Event.Get("ACTION");
+		if (Action.size()) Event.Action = Action;
+		return true;
+	}
+
+	BlockHotplugMonitor::BlockHotplugMonitor(const std::string& DeviceName) :
+		DeviceName(DeviceName),
+		DevicePath("/dev/" + DeviceName)
+	{
+	}
+
+	BlockHotplugMonitor::~BlockHotplugMonitor()
+	{
+#if !defined(_MSC_VER)
+		if (FD != -1) close(FD);
+#endif
+	}
+
+	bool BlockHotplugMonitor::Open()
+	{
+		// 先读当前状态，之后只靠消息更新
+		std::error_code ec;
+		Present = std::filesystem::exists(DevicePath, ec);
+#if !defined(_MSC_VER)
+		int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+		if (fd == -1)
+		{
+			perror("socket(NETLINK_KOBJECT_UEVENT)");
+			return false;
+		}
+		sockaddr_nl Addr;
+		memset(&Addr, 0, sizeof Addr);
+		Addr.nl_family = AF_NETLINK;
+		Addr.nl_groups = 1; // 内核发出的 uevent
+		if (bind(fd, reinterpret_cast<sockaddr*>(&Addr), sizeof Addr) == -1)
+		{
+			perror("bind(NETLINK_KOBJECT_UEVENT)");
+			close(fd);
+			return false;
+		}
+		if (this->FD != -1) close(this->FD);
+		this->FD = fd;
+		FromKernel = true;
+
+		// 绑定之前的插拔没有消息，再确认一次
+		Present = std::filesystem::exists(DevicePath, ec);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool BlockHotplugMonitor::OpenFD(int FD)
+	{
+#if !defined(_MSC_VER)
+		if (this->FD != -1) close(this->FD);
+#endif
+		this->FD = FD;
+		FromKernel = false;
+		return FD != -1;
+	}
+
+	int BlockHotplugMonitor::GetFD() const
+	{
+		return FD;
+	}
+
+	bool BlockHotplugMonitor::IsPolling() const
+	{
+		return FD == -1;
+	}
+
+	bool BlockHotplugMonitor::IsPresent() const
+	{
+		return Present;
+	}
+
+	const std::string& BlockHotplugMonitor::GetDevicePath() const
+	{
+		return DevicePath;
+	}
+
+	void BlockHotplugMonitor::SetPresent(bool Present)
+	{
+		if (this->Present == Present) return;
+		this->Present = Present;
+		if (OnChange) OnChange(Present);
+	}
+
+	void BlockHotplugMonitor::HandleEvent(const UEvent& Event)
+	{
+		if (Event.Action == "add") SetPresent(true);
+		else if (Event.Action == "remove") SetPresent(false);
+	}
+
+	size_t BlockHotplugMonitor::ReadEvents()
+	{
+		size_t Count = 0;
+#if !defined(_MSC_VER)
+		if (FD == -1) return 0;
+		char Buffer[8192];
+		while (true)
+		{
+			sockaddr_nl Sender;
+			socklen_t SenderLength = sizeof Sender;
+			memset(&Sender, 0, sizeof Sender);
+			auto Bytes = recvfrom(FD, Buffer, sizeof Buffer, MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&Sender), &SenderLength);
+			if (Bytes < 0)
+			{
+				if (errno == ENOBUFS)
+				{ // 消息太多被内核丢弃了，不知道丢了什么，直接检查设备文件
+					std::error_code ec;
+					SetPresent(std::filesystem::exists(DevicePath, ec));
+					continue;
+				}
+				break;
+			}
+			if (Bytes == 0) break;
+			if (FromKernel && Sender.nl_pid != 0) continue; // 只接受内核的消息，用户进程也能向这个组发送
+
+			UEvent Event;
+			if (!ParseUEvent(Buffer, size_t(Bytes), Event)) continue;
+			if (Event.Get("SUBSYSTEM") != "block" || Event.Get("DEVNAME") != DeviceName) continue;
+			HandleEvent(Event);
+			Count++;
+		}
+#endif
+		return Count;
+	}
+
+	bool BlockHotplugMonitor::Poll()
+	{
+		auto Old = Present;
+		std::error_code ec;
+		SetPresent(std::filesystem::exists(DevicePath, ec));
+		return Old != Present;
+	}
+}
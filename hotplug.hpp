@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace TVOS
+{
+	// 内核 uevent 消息："ACTION@DEVPATH" 之后是若干个以 '\0' 分隔的 "KEY=VALUE"
+	struct UEvent
+	{
+		std::string Action; // add、remove、change 等
+		std::string DevPath;
+		std::unordered_map<std::string, std::string> Vars; // SUBSYSTEM、DEVNAME、DEVTYPE 等
+
+		std::string Get(const std::string& Key) const;
+	};
+
+	// 解析一条 uevent 消息，不是内核格式（例如 udev 转发的 "libudev" 消息）时返回 false
+	bool ParseUEvent(const char* Data, size_t Size, UEvent& Event);
+
+	// 监视一个块设备（例如 SD 卡的分区 mmcblk0p1）的插入与拔出。
+	// 平时在 NETLINK_KOBJECT_UEVENT 套接字上等待内核的 add/remove 消息，插拔时立即得到通知；
+	// 不能建立 netlink 套接字时退回到定时检查设备文件是否存在。
+	// 测试时可以用 `OpenFD()` 接管一个数据报套接字（例如 socketpair 的一端），向另一端写入 uevent 消息。
+	class BlockHotplugMonitor
+	{
+	protected:
+		std::string DeviceName;
+		std::string DevicePath;
+		int FD = -1;
+		bool FromKernel = false; // 是真正的 netlink 套接字，只接受内核发出的消息
+		bool Present = false;
+
+		void SetPresent(bool Present);
+		void HandleEvent(const UEvent& Event);
+
+	public:
+		// DeviceName 为 /dev 下的设备名，不带路径
+		BlockHotplugMonitor(const std::string& DeviceName);
+		~BlockHotplugMonitor();
+		BlockHotplugMonitor(const BlockHotplugMonitor&) = delete;
+		BlockHotplugMonitor& operator = (const BlockHotplugMonitor&) = delete;
+
+		// 状态变化时调用，参数为设备是否存在
+		std::function<void(bool Present)> OnChange;
+
+		// 建立 netlink 套接字并读取当前状态。失败时返回 false，之后需要定时调用 `Poll()`。
+		bool Open();
+
+		// 接管一个已打开的数据报套接字代替 netlink，不检查发送者
+		bool OpenFD(int FD);
+
+		int GetFD() const; // 可读时调用 `ReadEvents()`
+		bool IsPolling() const;
+		bool IsPresent() const;
+		const std::string& GetDevicePath() const;
+
+		// 读取所有已到达的消息，返回其中与这个设备有关的个数
+		size_t ReadEvents();
+
+		// 检查设备文件是否存在，返回状态是否变化
+		bool Poll();
+	};
+}
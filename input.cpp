@@ -0,0 +1,486 @@
+﻿#include "input.hpp"
+#include "gpio.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <linux/input.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace TVOS
+{
+	bool ParseInputKey(const std::string& Name, InputKey& Key)
+	{
+		if (Name == "play") Key = InputKey::Play;
+		else if (Name == "next") Key = InputKey::Next;
+		else if (Name == "prev") Key = InputKey::Prev;
+		else if (Name == "volume") Key = InputKey::Volume;
+		else return false;
+		return true;
+	}
+
+	const char* GetInputKeyName(InputKey Key)
+	{
+		switch (Key)
+		{
+		case InputKey::Play: return "play";
+		case InputKey::Next: return "next";
+		case InputKey::Prev: return "prev";
+		case InputKey::Volume: return "volume";
+		}
+		return "unknown";
+	}
+
+	uint64_t GetInputTimeNs()
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	std::chrono::steady_clock::time_point GetInputTimePoint(uint64_t TimestampNs)
+	{
+		using Clock = std::chrono::steady_clock;
+		if (TimestampNs == UINT64_MAX) return Clock::time_point::max();
+		return Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(TimestampNs)));
+	}
+
+	void InputSource::Emit(std::vector<KeyEvent>& Events, InputKey Key, bool Pressed, uint64_t TimestampNs)
+	{
+		auto Bit = KeyBit(Key);
+		if (bool(HeldKeys & Bit) == Pressed) return;
+		if (Pressed) HeldKeys |= Bit;
+		else HeldKeys &= ~Bit;
+		KeyEvent Event;
+		Event.Key = Key;
+		Event.Pressed = Pressed;
+		Event.TimestampNs = TimestampNs;
+		Events.push_back(Event);
+	}
+
+	uint32_t InputSource::GetHeldKeys() const
+	{
+		return HeldKeys;
+	}
+
+	GPIOPollInput::GPIOPollInput(std::chrono::milliseconds Interval)
+	{
+#if !defined(_MSC_VER)
+		TimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (TimerFD == -1)
+		{
+			perror("timerfd_create()");
+			return;
+		}
+		itimerspec Spec;
+		memset(&Spec, 0, sizeof Spec);
+		Spec.it_interval.tv_sec = time_t(Interval.count() / 1000);
+		Spec.it_interval.tv_nsec = long(Interval.count() % 1000) * 1000000;
+		Spec.it_value = Spec.it_interval;
+		timerfd_settime(TimerFD, 0, &Spec, nullptr);
+#else
+		(void)Interval;
+#endif
+	}
+
+	GPIOPollInput::~GPIOPollInput()
+	{
+#if !defined(_MSC_VER)
+		if (TimerFD != -1) close(TimerFD);
+#endif
+	}
+
+	int GPIOPollInput::GetFD() const
+	{
+		return TimerFD;
+	}
+
+	size_t GPIOPollInput::ReadEvents(std::vector<KeyEvent>& Events)
+	{
+#if !defined(_MSC_VER)
+		uint64_t Expirations;
+		if (TimerFD != -1 && read(TimerFD, &Expirations, sizeof Expirations) != sizeof Expirations) return 0;
+#endif
+		// 四个按键在同一个端口上，读一次寄存器就够了
+		auto Bits = ReadGPIOPins(GPIO_E, KeyBit(InputKey::Play) | KeyBit(InputKey::Next) | KeyBit(InputKey::Prev) | KeyBit(InputKey::Volume));
+		auto Changed = Bits ^ LastBits;
+		LastBits = Bits;
+		if (!Changed) return 0;
+
+		auto Count = Events.size();
+		auto Now = GetInputTimeNs();
+		for (auto Key : { InputKey::Play, InputKey::Next, InputKey::Prev, InputKey::Volume })
+		{
+			if (Changed & KeyBit(Key)) Emit(Events, Key, (Bits & KeyBit(Key)) != 0, Now);
+		}
+		return Events.size() - Count;
+	}
+
+	bool GPIOChipInput::Open(const std::string& ChipPath, const std::vector<uint32_t>& Offsets)
+	{
+		if (Offsets.size() != 4) return false;
+		if (!Lines.Open(ChipPath, Offsets)) return false;
+
+		// 打开时已经按住的键也记下来，之后只靠边沿事件更新
+		auto Values = Lines.ReadValues();
+		std::vector<KeyEvent> Ignored;
+		for (int i = 0; i < 4; i++)
+		{
+			if (Values & (1 << i)) Emit(Ignored, InputKey(i + 1), true, GetInputTimeNs());
+		}
+		return true;
+	}
+
+	bool GPIOChipInput::IsOpen() const
+	{
+		return Lines.IsOpen();
+	}
+
+	int GPIOChipInput::GetFD() const
+	{
+		return Lines.GetFD();
+	}
+
+	size_t GPIOChipInput::ReadEvents(std::vector<KeyEvent>& Events)
+	{
+		LineEvents.clear();
+		Lines.ReadEvents(LineEvents);
+		auto Count = Events.size();
+		for (auto& LineEvent : LineEvents)
+		{
+			Emit(Events, InputKey(LineEvent.Index + 1), LineEvent.Rising, LineEvent.TimestampNs);
+		}
+		return Events.size() - Count;
+	}
+
+	EvdevInput::EvdevInput()
+	{
+#if !defined(_MSC_VER)
+		MapKey(KEY_ENTER, InputKey::Play);
+		MapKey(KEY_SPACE, InputKey::Play);
+		MapKey(KEY_PLAYPAUSE, InputKey::Play);
+		MapKey(KEY_OK, InputKey::Play);
+		MapKey(KEY_DOWN, InputKey::Next);
+		MapKey(KEY_RIGHT, InputKey::Next);
+		MapKey(KEY_NEXTSONG, InputKey::Next);
+		MapKey(KEY_UP, InputKey::Prev);
+		MapKey(KEY_LEFT, InputKey::Prev);
+		MapKey(KEY_PREVIOUSSONG, InputKey::Prev);
+		MapKey(KEY_VOLUMEUP, InputKey::Volume);
+		MapKey(KEY_VOLUMEDOWN, InputKey::Volume);
+#endif
+	}
+
+	EvdevInput::~EvdevInput()
+	{
+#if !defined(_MSC_VER)
+		if (FD != -1) close(FD);
+#endif
+	}
+
+	void EvdevInput::MapKey(uint16_t KeyCode, InputKey Key)
+	{
+		KeyMap[KeyCode] = Key;
+	}
+
+	void EvdevInput::ClearKeyMap()
+	{
+		KeyMap.clear();
+	}
+
+	bool EvdevInput::Open(const std::string& DevicePath)
+	{
+#if !defined(_MSC_VER)
+		if (FD != -1) close(FD);
+		FD = open(DevicePath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (FD == -1)
+		{
+			perror(("open(" + DevicePath + ")").c_str());
+			return false;
+		}
+		// 默认的事件时间是 CLOCK_REALTIME，换成与其它来源一致的 CLOCK_MONOTONIC
+		int ClockID = CLOCK_MONOTONIC;
+		ioctl(FD, EVIOCSCLOCKID, &ClockID);
+		return true;
+#else
+		(void)DevicePath;
+		return false;
+#endif
+	}
+
+	bool EvdevInput::IsOpen() const
+	{
+		return FD != -1;
+	}
+
+	int EvdevInput::GetFD() const
+	{
+		return FD;
+	}
+
+	size_t EvdevInput::ReadEvents(std::vector<KeyEvent>& Events)
+	{
+		auto Count = Events.size();
+#if !defined(_MSC_VER)
+		if (FD == -1) return 0;
+		input_event Buffer[32];
+		while (true)
+		{
+			auto Bytes = read(FD, Buffer, sizeof Buffer);
+			if (Bytes <= 0)
+			{
+				if (Bytes == -1 && errno == ENODEV)
+				{ // 设备被拔掉了
+					close(FD);
+					FD = -1;
+				}
+				break;
+			}
+			for (size_t i = 0; i < size_t(Bytes) / sizeof Buffer[0]; i++)
+			{
+				auto& Event = Buffer[i];
+				auto TimestampNs = uint64_t(Event.input_event_sec) * 1000000000 + uint64_t(Event.input_event_usec) * 1000;
+				if (Event.type == EV_SYN)
+				{
+					if (Event.code == SYN_DROPPED) Dropped = true;
+					else if (Event.code == SYN_REPORT && Dropped)
+					{
+						Dropped = false;
+						Resync(Events, TimestampNs);
+					}
+					continue;
+				}
+				if (Dropped || Event.type != EV_KEY || Event.value == 2) continue;
+				auto it = KeyMap.find(Event.code);
+				if (it == KeyMap.end()) continue;
+				Emit(Events, it->second, Event.value != 0, TimestampNs);
+			}
+		}
+#else
+		(void)Events;
+#endif
+		return Events.size() - Count;
+	}
+
+	void EvdevInput::Resync(std::vector<KeyEvent>& Events, uint64_t TimestampNs)
+	{
+#if !defined(_MSC_VER)
+		uint8_t Bits[KEY_MAX / 8 + 1];
+		memset(Bits, 0, sizeof Bits);
+		if (ioctl(FD, EVIOCGKEY(sizeof Bits), Bits) == -1) return;
+
+		// 映射到同一个按键的键码有一个按着就算按着
+		uint32_t Held = 0, Mapped = 0;
+		for (auto& it : KeyMap)
+		{
+			auto Bit = KeyBit(it.second);
+			Mapped |= Bit;
+			if (Bits[it.first / 8] & (1 << (it.first % 8))) Held |= Bit;
+		}
+		for (int i = 1; i <= 4; i++)
+		{
+			auto Key = InputKey(i);
+			if (Mapped & KeyBit(Key)) Emit(Events, Key, (Held & KeyBit(Key)) != 0, TimestampNs);
+		}
+#else
+		(void)Events; (void)TimestampNs;
+#endif
+	}
+
+	ScriptedInput::~ScriptedInput()
+	{
+#if !defined(_MSC_VER)
+		if (FD != -1) close(FD);
+#endif
+	}
+
+	bool ScriptedInput::Open(const std::string& Path)
+	{
+#if !defined(_MSC_VER)
+		struct stat st;
+		bool IsFIFO = stat(Path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+		// 命名管道用读写方式打开，自己也算一个写端，测试程序关闭写端后不会一直读到文件结束
+		int fd = open(Path.c_str(), (IsFIFO ? O_RDWR : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+		if (fd == -1)
+		{
+			perror(("open(" + Path + ")").c_str());
+			return false;
+		}
+		return OpenFD(fd, Path);
+#else
+		(void)Path;
+		return false;
+#endif
+	}
+
+	bool ScriptedInput::OpenFD(int FD, const std::string& Name)
+	{
+#if !defined(_MSC_VER)
+		if (this->FD != -1) close(this->FD);
+		fcntl(FD, F_SETFL, fcntl(FD, F_GETFL) | O_NONBLOCK);
+#endif
+		this->FD = FD;
+		this->Name = Name;
+		Buffer.clear();
+		LineNumber = 0;
+		return FD != -1;
+	}
+
+	bool ScriptedInput::IsOpen() const
+	{
+		return FD != -1;
+	}
+
+	int ScriptedInput::GetFD() const
+	{
+		return FD;
+	}
+
+	void ScriptedInput::ParseLine(const std::string& Line, std::vector<KeyEvent>& Events)
+	{
+		LineNumber++;
+		std::stringstream ss(Line);
+		std::string KeyName, Action;
+		ss >> KeyName >> Action;
+		if (KeyName.empty() || KeyName[0] == '#') return;
+
+		InputKey Key;
+		if (!ParseInputKey(KeyName, Key) || (Action != "" && Action != "down" && Action != "up"))
+		{
+			std::cerr << "[WARN] " << Name << ":" << LineNumber << ": Unrecognized input `" << Line << "`.\n";
+			return;
+		}
+		auto Now = GetInputTimeNs();
+		if (Action != "up") Emit(Events, Key, true, Now);
+		if (Action != "down") Emit(Events, Key, false, Now);
+	}
+
+	size_t ScriptedInput::ReadEvents(std::vector<KeyEvent>& Events)
+	{
+		auto Count = Events.size();
+#if !defined(_MSC_VER)
+		if (FD == -1) return 0;
+		char Chunk[512];
+		while (true)
+		{
+			auto Bytes = read(FD, Chunk, sizeof Chunk);
+			if (Bytes > 0)
+			{
+				Buffer.append(Chunk, size_t(Bytes));
+				continue;
+			}
+			if (Bytes == 0)
+			{ // 普通文件读完了，最后一行可能没有换行符
+				if (!Buffer.empty()) Buffer += '\n';
+				close(FD);
+				FD = -1;
+			}
+			break;
+		}
+		size_t Start = 0, End;
+		while ((End = Buffer.find('\n', Start)) != std::string::npos)
+		{
+			ParseLine(Buffer.substr(Start, End - Start), Events);
+			Start = End + 1;
+		}
+		Buffer.erase(0, Start);
+#else
+		(void)Events;
+#endif
+		return Events.size() - Count;
+	}
+
+#if defined(_MSC_VER)
+	int KeyboardInput::GetFD() const
+	{
+		return -1;
+	}
+
+	size_t KeyboardInput::ReadEvents(std::vector<KeyEvent>& Events)
+	{
+		auto Count = Events.size();
+		auto Now = GetInputTimeNs();
+		Emit(Events, InputKey::Play, GetAsyncKeyState('V') != 0, Now);
+		Emit(Events, InputKey::Next, GetAsyncKeyState('C') != 0, Now);
+		Emit(Events, InputKey::Prev, GetAsyncKeyState('X') != 0, Now);
+		Emit(Events, InputKey::Volume, GetAsyncKeyState('Z') != 0, Now);
+		return Events.size() - Count;
+	}
+#endif
+
+	InputSet::InputSet()
+	{
+#if !defined(_MSC_VER)
+		EpollFD = epoll_create1(EPOLL_CLOEXEC);
+		if (EpollFD == -1) perror("epoll_create1()");
+#endif
+	}
+
+	InputSet::~InputSet()
+	{
+#if !defined(_MSC_VER)
+		if (EpollFD != -1) close(EpollFD);
+#endif
+	}
+
+	void InputSet::Add(std::unique_ptr<InputSource> Source)
+	{
+		auto fd = Source->GetFD();
+#if !defined(_MSC_VER)
+		epoll_event Event;
+		memset(&Event, 0, sizeof Event);
+		Event.events = EPOLLIN;
+		Event.data.ptr = Source.get();
+		if (fd == -1 || EpollFD == -1 || epoll_ctl(EpollFD, EPOLL_CTL_ADD, fd, &Event) == -1)
+		{
+			// 普通文件不能加入 epoll（EPERM），它总是可读的，与没有描述符的来源一样定时读取
+			HasUnpollable = true;
+		}
+#else
+		(void)fd;
+		HasUnpollable = true;
+#endif
+		Sources.push_back(std::move(Source));
+	}
+
+	size_t InputSet::GetSourceCount() const
+	{
+		return Sources.size();
+	}
+
+	size_t InputSet::Poll(std::vector<KeyEvent>& Events)
+	{
+		size_t Count = 0;
+		for (auto& Source : Sources) Count += Source->ReadEvents(Events);
+		return Count;
+	}
+
+	int InputSet::GetFD() const
+	{
+		return EpollFD;
+	}
+
+	bool InputSet::NeedsPolling() const
+	{
+		return HasUnpollable || EpollFD == -1;
+	}
+
+	uint32_t InputSet::GetHeldKeys() const
+	{
+		uint32_t Keys = 0;
+		for (auto& Source : Sources) Keys |= Source->GetHeldKeys();
+		return Keys;
+	}
+}
@@ -0,0 +1,197 @@
+﻿#pragma once
+#include "gpiochip.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace TVOS
+{
+	// 小电视的四个按键
+	enum class InputKey
+	{
+		Play = 1,
+		Next = 2,
+		Prev = 3,
+		Volume = 4,
+	};
+
+	// 把按键转成位掩码，数值与按键在 GPIO_E 上的引脚号相同
+	constexpr uint32_t KeyBit(InputKey Key)
+	{
+		return uint32_t(1) << int(Key);
+	}
+
+	// 解析 "play"、"next"、"prev"、"volume"，不认识时返回 false
+	bool ParseInputKey(const std::string& Name, InputKey& Key);
+	const char* GetInputKeyName(InputKey Key);
+
+	struct KeyEvent
+	{
+		InputKey Key = InputKey::Play;
+		bool Pressed = false; // 按下为 true，松开为 false
+		uint64_t TimestampNs = 0; // CLOCK_MONOTONIC，尽量使用设备报告的时间
+	};
+
+	// 当前的 CLOCK_MONOTONIC 时间，与 `std::chrono::steady_clock` 相同
+	uint64_t GetInputTimeNs();
+
+	// 把事件的时间转换成 `std::chrono::steady_clock` 的时间点，UINT64_MAX 转换成最大的时间点
+	std::chrono::steady_clock::time_point GetInputTimePoint(uint64_t TimestampNs);
+
+	// 按键输入来源。每个来源提供一个可读时表示有新事件的文件描述符，主循环用一个 epoll 等待所有来源。
+	class InputSource
+	{
+	protected:
+		uint32_t HeldKeys = 0;
+
+		// 记录按键状态并产生事件，状态没有变化时忽略
+		void Emit(std::vector<KeyEvent>& Events, InputKey Key, bool Pressed, uint64_t TimestampNs);
+
+	public:
+		virtual ~InputSource() = default;
+
+		// 可读时调用 `ReadEvents()`。返回 -1 表示不能等待，只能定时调用 `ReadEvents()`。
+		virtual int GetFD() const = 0;
+
+		// 读取已经到达的事件追加到 Events，不等待，返回读到的个数
+		virtual size_t ReadEvents(std::vector<KeyEvent>& Events) = 0;
+
+		// 按住的键，由已读取的事件得出
+		uint32_t GetHeldKeys() const;
+	};
+
+	// 定时读取映射的 GPIO 寄存器，比较前后两次的电平产生事件。用 timerfd 定时，所以也能放进 epoll。
+	class GPIOPollInput : public InputSource
+	{
+	protected:
+		int TimerFD = -1;
+		uint32_t LastBits = 0;
+
+	public:
+		GPIOPollInput(std::chrono::milliseconds Interval = std::chrono::milliseconds(20));
+		~GPIOPollInput() override;
+		GPIOPollInput(const GPIOPollInput&) = delete;
+		GPIOPollInput& operator = (const GPIOPollInput&) = delete;
+
+		int GetFD() const override;
+		size_t ReadEvents(std::vector<KeyEvent>& Events) override;
+	};
+
+	// GPIO 字符设备上请求的四条线，依次为 播放、下一个、上一个、音量，由内核记录边沿事件和时间
+	class GPIOChipInput : public InputSource
+	{
+	protected:
+		GPIO_ChipLines Lines;
+		std::vector<GPIO_LineEvent> LineEvents;
+
+	public:
+		bool Open(const std::string& ChipPath, const std::vector<uint32_t>& Offsets);
+		bool IsOpen() const;
+
+		int GetFD() const override;
+		size_t ReadEvents(std::vector<KeyEvent>& Events) override;
+	};
+
+	// Linux 输入子系统的设备 /dev/input/eventX，例如使用 gpio-keys 驱动的按键、USB 键盘或遥控器。
+	// 内核的自动重复（value 为 2）被忽略，重复由上层决定。
+	// 读得慢、内核的缓冲区溢出时（SYN_DROPPED）丢弃到下一个 SYN_REPORT 为止的事件，再按设备当前的按键状态补上漏掉的按下和松开。
+	class EvdevInput : public InputSource
+	{
+	protected:
+		int FD = -1;
+		std::unordered_map<uint16_t, InputKey> KeyMap;
+		bool Dropped = false;
+
+		void Resync(std::vector<KeyEvent>& Events, uint64_t TimestampNs);
+
+	public:
+		EvdevInput();
+		~EvdevInput() override;
+		EvdevInput(const EvdevInput&) = delete;
+		EvdevInput& operator = (const EvdevInput&) = delete;
+
+		// 默认映射：回车、空格、播放键为播放，下、右、下一曲为下一个，上、左、上一曲为上一个，音量键为音量
+		void MapKey(uint16_t KeyCode, InputKey Key);
+		void ClearKeyMap();
+
+		bool Open(const std::string& DevicePath);
+		bool IsOpen() const;
+
+		int GetFD() const override;
+		size_t ReadEvents(std::vector<KeyEvent>& Events) override;
+	};
+
+	// 从文件或命名管道读取按键脚本，用于自动测试真实的界面。每行一条：
+	//   next          按下再松开
+	//   play down     只按下
+	//   play up       只松开
+	//   # 注释
+	// 命名管道以读写方式打开，测试程序可以多次打开写入，不会读到文件结束。普通文件读完后不再产生事件。
+	class ScriptedInput : public InputSource
+	{
+	protected:
+		int FD = -1;
+		std::string Buffer;
+		std::string Name;
+		int LineNumber = 0;
+
+		void ParseLine(const std::string& Line, std::vector<KeyEvent>& Events);
+
+	public:
+		ScriptedInput() = default;
+		~ScriptedInput() override;
+		ScriptedInput(const ScriptedInput&) = delete;
+		ScriptedInput& operator = (const ScriptedInput&) = delete;
+
+		bool Open(const std::string& Path);
+		bool OpenFD(int FD, const std::string& Name); // 接管已打开的描述符，例如管道的读端
+		bool IsOpen() const;
+
+		int GetFD() const override;
+		size_t ReadEvents(std::vector<KeyEvent>& Events) override;
+	};
+
+#if defined(_MSC_VER)
+	// 调试用：键盘的 V、C、X、Z 键对应 播放、下一个、上一个、音量
+	class KeyboardInput : public InputSource
+	{
+	public:
+		int GetFD() const override;
+		size_t ReadEvents(std::vector<KeyEvent>& Events) override;
+	};
+#endif
+
+	// 一组输入来源，可等待的来源合在一个 epoll 中，由主循环等待
+	class InputSet
+	{
+	protected:
+		std::vector<std::unique_ptr<InputSource>> Sources;
+		int EpollFD = -1;
+		bool HasUnpollable = false;
+
+	public:
+		InputSet();
+		~InputSet();
+		InputSet(const InputSet&) = delete;
+		InputSet& operator = (const InputSet&) = delete;
+
+		void Add(std::unique_ptr<InputSource> Source);
+		size_t GetSourceCount() const;
+
+		// 读取已经到达的事件，不等待
+		size_t Poll(std::vector<KeyEvent>& Events);
+
+		// 所有来源中按住的键
+		uint32_t GetHeldKeys() const;
+
+		// 所有可等待的来源合在一起的 epoll 描述符，可以再放进主循环的 epoll
+		int GetFD() const;
+
+		// 有不能等待的来源，需要定时调用 `Poll()`
+		bool NeedsPolling() const;
+	};
+}
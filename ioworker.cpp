@@ -0,0 +1,87 @@
+﻿#include "ioworker.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace TVOS
+{
+	IOWorker::IOWorker() :
+		Worker(&IOWorker::WorkerProc, this)
+	{
+	}
+
+	IOWorker::~IOWorker()
+	{
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Quit = true;
+		}
+		Wakeup.notify_all();
+		Worker.join();
+	}
+
+	bool IOWorker::Post(Job Work, Job Done)
+	{
+		if (!Requests.Push(Request{ std::move(Work), std::move(Done) }))
+		{
+			std::cerr << "[WARN] I/O request queue is full.\n";
+			return false;
+		}
+		// 在锁内通知一下，I/O 线程检查完队列、还没开始等待时也不会错过
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+		}
+		Wakeup.notify_one();
+		return true;
+	}
+
+	size_t IOWorker::RunCompleted()
+	{
+		size_t Count = 0;
+		Job Done;
+		while (Results.Pop(Done))
+		{
+			Done();
+			Count++;
+		}
+		return Count;
+	}
+
+	void IOWorker::WorkerProc()
+	{
+		while (true)
+		{
+			Request Req;
+			if (!Requests.Pop(Req))
+			{
+				std::unique_lock<std::mutex> Lock(Mutex);
+				if (Quit) return;
+				Wakeup.wait(Lock, [this]() { return Quit || !Requests.IsEmpty(); });
+				continue;
+			}
+
+			try
+			{
+				Req.Work();
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "[WARN] I/O request failed: " << e.what() << "\n";
+			}
+			// Work 捕获的资源（例如要在卸载前销毁的缩略图缓存）在这个线程释放
+			Req.Work = nullptr;
+			if (!Req.Done) continue;
+
+			// 界面线程很久没有取结果时等它，退出时丢弃
+			while (!Results.Push(std::move(Req.Done)))
+			{
+				if (OnCompleted) OnCompleted();
+				std::unique_lock<std::mutex> Lock(Mutex);
+				if (Wakeup.wait_for(Lock, std::chrono::milliseconds(10), [this]() { return Quit; })) break;
+			}
+			if (OnCompleted) OnCompleted();
+		}
+	}
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include "spscqueue.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace TVOS
+{
+	// 在单独的线程中执行会阻塞的文件系统与进程操作：挂载、卸载、扫描目录、设置声卡、预读视频文件等。
+	// 界面线程提交请求 `Post()`，I/O 线程按提交的顺序执行 Work，之后把 Done 交回界面线程，由 `RunCompleted()` 执行。
+	// 请求和结果各用一个有界的单生产者单消费者队列传递，界面线程不会因为 SD 卡慢而等待。
+	// 只有 I/O 线程没有事情做、需要睡眠时才用到锁。
+	class IOWorker
+	{
+	public:
+		using Job = std::function<void()>;
+
+	protected:
+		struct Request
+		{
+			Job Work; // 在 I/O 线程执行
+			Job Done; // 在界面线程执行，可以为空
+		};
+		SPSCQueue<Request, 32> Requests; // 界面线程 -> I/O 线程
+		SPSCQueue<Job, 32> Results; // I/O 线程 -> 界面线程
+
+		std::mutex Mutex;
+		std::condition_variable Wakeup;
+		bool Quit = false;
+		std::thread Worker;
+
+		void WorkerProc();
+
+	public:
+		IOWorker();
+		~IOWorker(); // 执行完已经提交的请求再退出，不再执行它们的 Done
+		IOWorker(const IOWorker&) = delete;
+		IOWorker& operator = (const IOWorker&) = delete;
+
+		// 请求完成时在 I/O 线程中调用，用于唤醒主循环。需在第一次 `Post()` 之前设置。
+		std::function<void()> OnCompleted;
+
+		// 只能在界面线程调用。队列满时返回 false，请求没有提交。
+		bool Post(Job Work, Job Done = nullptr);
+
+		// 在界面线程执行已完成的请求的 Done，返回执行了几个
+		size_t RunCompleted();
+	};
+}
@@ -0,0 +1,119 @@
+﻿#include "keystate.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace TVOS
+{
+	KeyStateMachine::KeyStateMachine(KeyActionQueue& Queue) :
+		Queue(Queue)
+	{
+		SetRepeat(InputKey::Next, true);
+		SetRepeat(InputKey::Prev, true);
+	}
+
+	void KeyStateMachine::SetRepeat(InputKey Key, bool Repeat)
+	{
+		Keys[int(Key)].Repeat = Repeat;
+	}
+
+	void KeyStateMachine::Post(InputKey Key, KeyAction Action, uint64_t TimestampNs, int RepeatCount)
+	{
+		KeyActionEvent Event;
+		Event.Key = Key;
+		Event.Action = Action;
+		Event.TimestampNs = TimestampNs;
+		Event.RepeatCount = RepeatCount;
+		if (!Queue.Push(Event)) Dropped++;
+	}
+
+	void KeyStateMachine::Change(InputKey Key, bool Pressed, uint64_t TimestampNs)
+	{
+		auto& k = Keys[int(Key)];
+		k.Pressed = Pressed;
+		k.LastChangeNs = TimestampNs;
+		if (Pressed)
+		{
+			k.PressNs = TimestampNs;
+			k.NextRepeatNs = TimestampNs + RepeatDelayNs;
+			k.IntervalNs = RepeatIntervalNs;
+			k.RepeatCount = 0;
+			k.LongPressSent = false;
+			Post(Key, KeyAction::Press, TimestampNs, 0);
+		}
+		else
+		{
+			Post(Key, KeyAction::Release, TimestampNs, k.RepeatCount);
+		}
+	}
+
+	void KeyStateMachine::Settle(InputKey Key, uint64_t NowNs)
+	{
+		auto& k = Keys[int(Key)];
+		if (k.RawPressed == k.Pressed) return;
+		auto WindowEnd = k.LastChangeNs + DebounceNs;
+		if (k.LastChangeNs && NowNs < WindowEnd) return; // 还在消抖窗口内，等窗口结束再看
+		Change(Key, k.RawPressed, std::max(k.RawNs, k.LastChangeNs ? WindowEnd : 0));
+	}
+
+	void KeyStateMachine::Feed(const KeyEvent& Event)
+	{
+		auto& k = Keys[int(Event.Key)];
+		k.RawPressed = Event.Pressed;
+		k.RawNs = Event.TimestampNs;
+		Settle(Event.Key, Event.TimestampNs);
+	}
+
+	void KeyStateMachine::Advance(uint64_t NowNs)
+	{
+		for (auto Key : { InputKey::Play, InputKey::Next, InputKey::Prev, InputKey::Volume })
+		{
+			Settle(Key, NowNs);
+			auto& k = Keys[int(Key)];
+			if (!k.Pressed) continue;
+			if (k.Repeat)
+			{
+				if (NowNs < k.NextRepeatNs) continue;
+				Post(Key, KeyAction::Repeat, k.NextRepeatNs, ++k.RepeatCount);
+				k.NextRepeatNs += k.IntervalNs;
+				k.IntervalNs = std::max(MinRepeatIntervalNs, k.IntervalNs * uint64_t(RepeatAcceleration) / 100);
+				// 主循环被耽误时不补发，从现在开始重新计时，按住的效果不会突然跳一大段
+				if (k.NextRepeatNs <= NowNs) k.NextRepeatNs = NowNs + k.IntervalNs;
+			}
+			else if (!k.LongPressSent && NowNs >= k.PressNs + LongPressNs)
+			{
+				k.LongPressSent = true;
+				Post(Key, KeyAction::LongPress, k.PressNs + LongPressNs, 0);
+			}
+		}
+	}
+
+	uint64_t KeyStateMachine::GetNextDeadlineNs() const
+	{
+		uint64_t Deadline = UINT64_MAX;
+		for (auto Key : { InputKey::Play, InputKey::Next, InputKey::Prev, InputKey::Volume })
+		{
+			auto& k = Keys[int(Key)];
+			if (k.RawPressed != k.Pressed) Deadline = std::min(Deadline, k.LastChangeNs + DebounceNs);
+			if (!k.Pressed) continue;
+			if (k.Repeat) Deadline = std::min(Deadline, k.NextRepeatNs);
+			else if (!k.LongPressSent) Deadline = std::min(Deadline, k.PressNs + LongPressNs);
+		}
+		return Deadline;
+	}
+
+	size_t KeyStateMachine::GetDroppedCount() const
+	{
+		return Dropped;
+	}
+
+	void KeyStateMachine::Reset()
+	{
+		for (auto& k : Keys)
+		{
+			auto Repeat = k.Repeat;
+			k = KeyState();
+			k.Repeat = Repeat;
+		}
+	}
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+#include "input.hpp"
+#include "spscqueue.hpp"
+
+#include <cstdint>
+
+namespace TVOS
+{
+	enum class KeyAction
+	{
+		Press,
+		Release,
+		Repeat, // 按住不放时按间隔重复，间隔逐渐缩短
+		LongPress, // 不重复的键按住超过一定时间，只产生一次
+	};
+
+	struct KeyActionEvent
+	{
+		InputKey Key = InputKey::Play;
+		KeyAction Action = KeyAction::Press;
+		uint64_t TimestampNs = 0;
+		int RepeatCount = 0; // 第几次重复，按下时为 0
+	};
+
+	using KeyActionQueue = SPSCQueue<KeyActionEvent, 64>;
+
+	// 把输入来源报告的电平变化变成离散的按键动作，放进队列。全部由时间戳驱动，与主循环多久调用一次无关。
+	// 消抖采用前沿方式：第一次变化立即生效，之后 `DebounceNs` 内的抖动只记下最后的电平，窗口结束时仍不同才生效。
+	class KeyStateMachine
+	{
+	public:
+		uint64_t DebounceNs = 20000000;
+		uint64_t RepeatDelayNs = 400000000; // 按下后多久开始重复
+		uint64_t RepeatIntervalNs = 150000000; // 第一次重复的间隔
+		uint64_t MinRepeatIntervalNs = 40000000; // 间隔缩短到这里为止
+		int RepeatAcceleration = 80; // 每次重复后间隔变为原来的百分之几
+		uint64_t LongPressNs = 800000000;
+
+	protected:
+		struct KeyState
+		{
+			bool Pressed = false; // 消抖后的状态
+			bool RawPressed = false; // 最后报告的电平
+			uint64_t RawNs = 0;
+			uint64_t LastChangeNs = 0; // 上次状态生效的时间，消抖窗口从这里开始
+			bool Repeat = false;
+			uint64_t PressNs = 0;
+			uint64_t NextRepeatNs = 0;
+			uint64_t IntervalNs = 0;
+			int RepeatCount = 0;
+			bool LongPressSent = false;
+		};
+		KeyState Keys[5]; // 以 `InputKey` 的值为下标
+		KeyActionQueue& Queue;
+		size_t Dropped = 0;
+
+		void Settle(InputKey Key, uint64_t NowNs);
+		void Change(InputKey Key, bool Pressed, uint64_t TimestampNs);
+		void Post(InputKey Key, KeyAction Action, uint64_t TimestampNs, int RepeatCount);
+
+	public:
+		// 默认 下一个、上一个 会重复，播放、音量 有长按
+		KeyStateMachine(KeyActionQueue& Queue);
+
+		void SetRepeat(InputKey Key, bool Repeat);
+
+		// 输入来源的事件，需要按时间顺序送入
+		void Feed(const KeyEvent& Event);
+
+		// 推进到 NowNs，产生到期的重复和长按
+		void Advance(uint64_t NowNs);
+
+		// 下一次需要调用 `Advance()` 的时间，没有按住的键时为 UINT64_MAX
+		uint64_t GetNextDeadlineNs() const;
+
+		// 队列满而丢掉的事件数
+		size_t GetDroppedCount() const;
+
+		// 清除所有状态，之后按住的键要松开再按下才有效
+		void Reset();
+	};
+}
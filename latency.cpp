@@ -0,0 +1,137 @@
+﻿#include "latency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace TVOS
+{
+	int LatencyHistogram::GetBucketIndex(uint32_t Us)
+	{
+		if (Us < uint32_t(SubBuckets)) return int(Us);
+		int Exponent = 31;
+		while (!(Us & (uint32_t(1) << Exponent))) Exponent--;
+		int Shift = Exponent - SubBucketBits;
+		return (Shift + 1) * SubBuckets + int(Us >> Shift) - SubBuckets;
+	}
+
+	uint32_t LatencyHistogram::GetBucketUpperBound(int Index)
+	{
+		if (Index < SubBuckets) return uint32_t(Index);
+		int Shift = Index / SubBuckets - 1;
+		uint64_t Lower = uint64_t(Index % SubBuckets + SubBuckets) << Shift;
+		return uint32_t(std::min<uint64_t>(Lower + (uint64_t(1) << Shift) - 1, UINT32_MAX));
+	}
+
+	void LatencyHistogram::Record(uint64_t LatencyNs)
+	{
+		auto Us = uint32_t(std::min<uint64_t>(LatencyNs / 1000, UINT32_MAX));
+		Buckets[GetBucketIndex(Us)]++;
+		Count++;
+		SumUs += Us;
+		MinUs = std::min(MinUs, Us);
+		MaxUs = std::max(MaxUs, Us);
+	}
+
+	void LatencyHistogram::Reset()
+	{
+		*this = LatencyHistogram();
+	}
+
+	uint64_t LatencyHistogram::GetCount() const
+	{
+		return Count;
+	}
+
+	uint32_t LatencyHistogram::GetMinUs() const
+	{
+		return Count ? MinUs : 0;
+	}
+
+	uint32_t LatencyHistogram::GetMaxUs() const
+	{
+		return MaxUs;
+	}
+
+	uint32_t LatencyHistogram::GetMeanUs() const
+	{
+		return Count ? uint32_t(SumUs / Count) : 0;
+	}
+
+	uint32_t LatencyHistogram::GetPercentileUs(double Percentile) const
+	{
+		if (!Count) return 0;
+		auto Target = uint64_t(std::ceil(std::clamp(Percentile, 0.0, 100.0) / 100.0 * double(Count)));
+		if (Target < 1) Target = 1;
+		uint64_t Seen = 0;
+		for (int i = 0; i < BucketCount; i++)
+		{
+			Seen += Buckets[i];
+			if (Seen >= Target) return std::min(GetBucketUpperBound(i), MaxUs);
+		}
+		return MaxUs;
+	}
+
+	void LatencyRecorder::Handled(const std::string& Type, uint64_t InputNs, uint64_t NowNs)
+	{
+		Entries[Type].Handled.Record(NowNs > InputNs ? NowNs - InputNs : 0);
+		Pending.emplace_back(Type, InputNs);
+	}
+
+	void LatencyRecorder::Presented(uint64_t NowNs)
+	{
+		for (auto& p : Pending)
+		{
+			Entries[p.first].Presented.Record(NowNs > p.second ? NowNs - p.second : 0);
+		}
+		Pending.clear();
+	}
+
+	void LatencyRecorder::Duration(const std::string& Type, uint64_t StartNs, uint64_t EndNs)
+	{
+		Durations[Type].Record(EndNs > StartNs ? EndNs - StartNs : 0);
+	}
+
+	bool LatencyRecorder::HasPending() const
+	{
+		return !Pending.empty();
+	}
+
+	void LatencyRecorder::Reset()
+	{
+		Entries.clear();
+		Durations.clear();
+		Pending.clear();
+	}
+
+	void LatencyRecorder::Dump(std::ostream& os) const
+	{
+		char buf[256];
+		snprintf(buf, sizeof buf, "%-20s %7s | %-31s | %-31s\n", "action", "count", "handled p50/p95/p99/max ms", "presented p50/p95/p99/max ms");
+		os << buf;
+		for (auto& it : Entries)
+		{
+			auto& h = it.second.Handled;
+			auto& p = it.second.Presented;
+			snprintf(buf, sizeof buf, "%-20s %7llu | %7.2f %7.2f %7.2f %7.2f | %7.2f %7.2f %7.2f %7.2f\n",
+				it.first.c_str(), static_cast<unsigned long long>(h.GetCount()),
+				h.GetPercentileUs(50) / 1000.0, h.GetPercentileUs(95) / 1000.0, h.GetPercentileUs(99) / 1000.0, h.GetMaxUs() / 1000.0,
+				p.GetPercentileUs(50) / 1000.0, p.GetPercentileUs(95) / 1000.0, p.GetPercentileUs(99) / 1000.0, p.GetMaxUs() / 1000.0);
+			os << buf;
+		}
+		if (!Durations.empty())
+		{
+			snprintf(buf, sizeof buf, "%-20s %7s | %-31s\n", "step", "count", "duration p50/p95/p99/max ms");
+			os << buf;
+		}
+		for (auto& it : Durations)
+		{
+			auto& d = it.second;
+			snprintf(buf, sizeof buf, "%-20s %7llu | %7.2f %7.2f %7.2f %7.2f\n",
+				it.first.c_str(), static_cast<unsigned long long>(d.GetCount()),
+				d.GetPercentileUs(50) / 1000.0, d.GetPercentileUs(95) / 1000.0, d.GetPercentileUs(99) / 1000.0, d.GetMaxUs() / 1000.0);
+			os << buf;
+		}
+		os.flush();
+	}
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace TVOS
+{
+	// 延迟的直方图，以微秒为单位。每个 2 的幂的区间再分成 16 格，相对误差不超过 1/16，占用固定的内存。
+	class LatencyHistogram
+	{
+	protected:
+		static constexpr int SubBucketBits = 4;
+		static constexpr int SubBuckets = 1 << SubBucketBits;
+		static constexpr int BucketCount = (32 - SubBucketBits + 1) * SubBuckets;
+
+		uint32_t Buckets[BucketCount] = {};
+		uint64_t Count = 0;
+		uint64_t SumUs = 0;
+		uint32_t MinUs = UINT32_MAX;
+		uint32_t MaxUs = 0;
+
+		static int GetBucketIndex(uint32_t Us);
+		static uint32_t GetBucketUpperBound(int Index);
+
+	public:
+		void Record(uint64_t LatencyNs);
+		void Reset();
+
+		uint64_t GetCount() const;
+		uint32_t GetMinUs() const;
+		uint32_t GetMaxUs() const;
+		uint32_t GetMeanUs() const;
+
+		// Percentile 为 0 到 100，返回所在格的上界，不超过记录过的最大值
+		uint32_t GetPercentileUs(double Percentile) const;
+	};
+
+	// 从按键发生（内核或采样的时间）到界面处理，以及到第一次把结果送上屏幕的延迟，按动作分类统计。
+	// 每个按键动作处理时调用 `Handled()`，之后第一次刷新屏幕时调用 `Presented()`。
+	class LatencyRecorder
+	{
+	protected:
+		struct Entry
+		{
+			LatencyHistogram Handled;
+			LatencyHistogram Presented;
+		};
+		std::map<std::string, Entry> Entries;
+		std::map<std::string, LatencyHistogram> Durations; // 与按键无关的一段过程的耗时，例如切换视频的各个步骤
+		std::vector<std::pair<std::string, uint64_t>> Pending; // 已处理、还没有上屏的动作和按键时间
+
+	public:
+		// Type 为动作的名字，例如 "list.next"。InputNs 与 NowNs 都是 CLOCK_MONOTONIC 的纳秒。
+		void Handled(const std::string& Type, uint64_t InputNs, uint64_t NowNs);
+		void Presented(uint64_t NowNs);
+
+		// 记录一段过程从 StartNs 到 EndNs 的耗时，Type 例如 "playback.stop"
+		void Duration(const std::string& Type, uint64_t StartNs, uint64_t EndNs);
+
+		bool HasPending() const;
+		void Reset();
+
+		// 每种动作一行：次数以及两段延迟的 p50、p95、p99、最大值（毫秒），之后是每种过程的耗时
+		void Dump(std::ostream& os) const;
+	};
+}
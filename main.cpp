@@ -1,11 +1,19 @@
 
 #include "graphics.hpp"
 #include "gui.hpp"
+#include "childproc.hpp"
+#include "eventloop.hpp"
 #include "gpio.hpp"
+#include "hotplug.hpp"
+#include "input.hpp"
+#include "ioworker.hpp"
+#include "keystate.hpp"
+#include "latency.hpp"
+#include "playback.hpp"
+#include "thumbnail.hpp"
 
 #if !defined(_MSC_VER)
 #include <sys/mount.h>
-#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
@@ -15,6 +23,8 @@
 #include <csignal>
 #include <iostream>
 #include <filesystem>
+#include <sstream>
+#include <algorithm>
 
 #include <chrono>
 #include <thread>
@@ -23,28 +33,6 @@
 #if defined(_MSC_VER)
 #include "tvos.hpp"
 #include <Windows.h>
-std::string GetLastErrorAsString()
-{
-	DWORD errorMessageID = GetLastError();
-	if (errorMessageID == 0) return "";
-
-	LPSTR messageBuffer = nullptr;
-
-	size_t size = FormatMessageA
-	(
-		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-		NULL,
-		errorMessageID,
-		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-		(LPSTR)&messageBuffer,
-		0,
-		NULL
-	);
-
-	auto ret = std::string(messageBuffer, size);
-	LocalFree(messageBuffer);
-	return ret;
-}
 #endif
 
 void DbgPrintf(const char* format, ...)
@@ -55,204 +43,156 @@ void DbgPrintf(const char* format, ...)
 	va_end(ap);
 }
 
-#if defined(_MSC_VER)
-using pid_t = int;
-#endif
+using namespace TVOS;
 
-#if !defined(_MSC_VER)
-int RunPipedCommand(const char* CmdPipeWriter, const char* CmdPipeReader, int& PidVideo, int& PidAudio)
+std::set<std::string> IterateDirectory(const std::string& media_path)
 {
-	int pipefd[2];
-	PidVideo = -1;
-	PidAudio = -1;
-	if (pipe(pipefd) == -1)
-	{
-		perror("pipe");
-		return -1;
-	}
-
-	PidVideo = fork();
-	if (PidVideo < 0) goto FailExit;
-
-	if (PidVideo == 0)
-	{
-		close(pipefd[0]);
-		dup2(pipefd[1], STDOUT_FILENO);
-
-		execl("/bin/sh", "sh", "-c", CmdPipeWriter, NULL);
-		perror("execl()");
-		exit(-1);
-	}
-
-	PidAudio = fork();
-	if (PidAudio < 0) goto FailExit;
-
-	if (PidAudio == 0)
+	auto Files = std::set<std::string>();
+	for (auto& directory : std::filesystem::directory_iterator(media_path))
 	{
-		dup2(pipefd[0], STDIN_FILENO);
-		close(pipefd[1]);
+		// 跳过文件夹
+		if (directory.is_directory()) continue;
 
-		execl("/bin/sh", "sh", "-c", CmdPipeReader, NULL);
-		perror("execl()");
-		exit(-1);
+		auto p = directory.path();
+		auto FileNameString = p.filename().string();
+		if (FileNameString == ThumbnailCache::CacheFileName) continue;
+		Files.insert(FileNameString);
 	}
 
-	return 0;
-FailExit:
-	close(pipefd[0]);
-	close(pipefd[1]);
-	if (PidVideo > 0) exit(-1);
-	if (PidAudio > 0) exit(-1);
-	return -1;
+	return Files;
 }
-#else
-pid_t RunCommand(const char* command)
+
+const char* GetVolumeCaption(int Volume)
 {
-	PROCESS_INFORMATION ProcInfo;
-	STARTUPINFOA StartupInfo =
+	switch (Volume)
 	{
-		sizeof(STARTUPINFOA), NULL, NULL, NULL, 0, 0, 0, 0, 0, 0, 0,
-		STARTF_USESTDHANDLES,
-		0,
-		0,
-		NULL,
-		GetStdHandle(STD_INPUT_HANDLE),
-		GetStdHandle(STD_OUTPUT_HANDLE),
-		GetStdHandle(STD_ERROR_HANDLE)
-	};
-	if (CreateProcessA(NULL, const_cast<char*>(command), NULL, NULL, TRUE, 0, 0, NULL, &StartupInfo, &ProcInfo))
-	{
-		CloseHandle(ProcInfo.hThread);
-		CloseHandle(ProcInfo.hProcess);
-		return pid_t(ProcInfo.dwProcessId);
-	}
-	else
-	{
-		std::cerr << GetLastErrorAsString();
-		return -1;
+	case 63: return "请选择要播放的曲目（200% 音量）";
+	case 56: return "请选择要播放的曲目（100% 音量）";
+	case 48: return "请选择要播放的曲目（50% 音量）";
+	case 0: return "请选择要播放的曲目（0% 音量）";
+	default: return "请选择要播放的曲目";
 	}
 }
-#endif
-
-using namespace TVOS;
 
-size_t GetFileSize(const std::string& File)
+// 每个界面的根组件样式相同
+void InitRootElement(UIElementBase& GUI)
 {
-	FILE* fp = fopen(File.c_str(), "rb");
-	if (fp)
-	{
-		fseek(fp, 0, SEEK_END);
-		auto size = ftell(fp);
-		fclose(fp);
-		return size;
-	}
-	return 0;
+	GUI.XMargin = 2;
+	GUI.YMargin = 2;
+	GUI.XBorder = 2;
+	GUI.YBorder = 2;
+	GUI.XPadding = 0;
+	GUI.YPadding = 0;
+	GUI.BorderColor = 0xFFFFFFFF;
+	GUI.FillColor = 0;
+	GUI.Transparent = false; // 局部重绘时由根组件填充背景，颜色与 `ClearScreen(0)` 相同
+	GUI.ExpandToParentX = true;
+	GUI.ExpandToParentY = true;
 }
 
-int PlayVideo(const std::string& VideoFile, int& PidVideo, int& PidAudio, int volume, int start_sec)
+UIHandle<UIElementLabel> CreateTitle(UIElementArena& Arena, UIElementBase& Parent, const std::string& Caption)
 {
-	char buf[4096];
-
-#ifndef _MSC_VER
-	snprintf(buf, sizeof buf, "tinymix set 1 %d", volume);
-	system(buf);
-	system("tinymix set 2 1");
-	system("tinymix set 13 0");
-
-	auto FileSize = GetFileSize(VideoFile);
-	if (FileSize > 0 && FileSize <= 16384 * 1024)
-	{
-		snprintf(buf, sizeof buf, "cat %s > /dev/null", VideoFile.c_str());
-		system(buf);
-	}
-#endif
-
-#ifndef _MSC_VER
-	snprintf(buf, sizeof buf, "ffmpeg -hide_banner -ss %d -i \"%s\" -an -pix_fmt bgra -f fbdev /dev/fb0 -vn -f wav pipe:1 -ar 44100 -ac 1 | tinyplay stdin -r 44100 -c 1", start_sec, VideoFile.c_str());
-	DbgPrintf("%s\n", buf);
-	snprintf(buf, sizeof buf, "ffmpeg -hide_banner -ss %d -i \"%s\" -an -pix_fmt bgra -f fbdev /dev/fb0 -vn -f wav pipe:1 -ar 44100 -ac 1", start_sec, VideoFile.c_str());
-	RunPipedCommand(buf, "tinyplay stdin -r 44100 -c 1", PidVideo, PidAudio);
-#else
-	snprintf(buf, sizeof buf, "ffplay %s", VideoFile.c_str());
-	DbgPrintf("%s\n", buf);
-	PidVideo = RunCommand(buf);
-	PidAudio = PidVideo;
-#endif
-	DbgPrintf("Video Player PID: %d\n", PidVideo);
-	DbgPrintf("Audio Player PID: %d\n", PidAudio);
-	return 0;
+	auto Sub = Arena.Create<UIElementLabel>("Title");
+	Parent.InsertElement(*Sub);
+	Sub->XMargin = 0;
+	Sub->YMargin = 0;
+	Sub->XBorder = 0;
+	Sub->YBorder = 1;
+	Sub->XPadding = 2;
+	Sub->YPadding = 2;
+	Sub->BorderColor = 0xFFFFFFFF;
+	Sub->FillColor = 0xFF000000;
+	Sub->FontColor = 0xFFFFFFFF;
+	Sub->ExpandToParentX = true;
+	Sub->LineBreak = false;
+	Sub->Transparent = false;
+	Sub->CacheAsLayer = true; // 标题只在音量变化时改变，平时直接贴缓存的图像
+	Sub->Alignment = AlignmentType::CenterTop;
+	Sub->SetCaption(Caption);
+	return Sub;
 }
 
-void StopPlay(pid_t& VideoPlayerPID, pid_t& AudioPlayerPID)
+UIHandle<UIElementLabel> CreatePrompt(UIElementArena& Arena, UIElementBase& Parent, const std::string& Caption)
 {
-	if (VideoPlayerPID == -1 && AudioPlayerPID == -1) return;
-
-#ifndef _MSC_VER
-	if (VideoPlayerPID != -1)
-	{
-		DbgPrintf("Killing video player PID: %u\n", VideoPlayerPID);
-		kill(VideoPlayerPID, SIGINT);
-		VideoPlayerPID = -1;
-	}
-	if (AudioPlayerPID != -1)
-	{
-		DbgPrintf("Killing audio player PID: %u\n", AudioPlayerPID);
-		kill(AudioPlayerPID, SIGINT);
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
-		kill(AudioPlayerPID, SIGTERM);
-		AudioPlayerPID = -1;
-	}
-#else
-	const auto player = OpenProcess(PROCESS_TERMINATE, false, DWORD(VideoPlayerPID));
-	TerminateProcess(player, 1);
-	CloseHandle(player);
-	VideoPlayerPID = -1;
-	AudioPlayerPID = -1;
-#endif
+	auto Prompt = Arena.Create<UIElementLabel>("Prompt");
+	Parent.InsertElement(*Prompt);
+	Prompt->XMargin = 0;
+	Prompt->YMargin = 0;
+	Prompt->XBorder = 0;
+	Prompt->YBorder = 0;
+	Prompt->XPadding = 0;
+	Prompt->YPadding = 0;
+	Prompt->BorderColor = 0xFFFFFFFF;
+	Prompt->ExpandToParentX = true;
+	Prompt->ExpandToParentY = true;
+	Prompt->LineBreak = false;
+	Prompt->Transparent = true;
+	Prompt->Alignment = AlignmentType::CenterCenter;
+	Prompt->SetCaption(Caption);
+	return Prompt;
 }
 
-bool IsPlaying(pid_t pid)
+UIHandle<UIElementListView> CreateListView(UIElementArena& Arena, UIElementBase& Parent)
 {
-#ifdef _MSC_VER
-	const auto player = OpenProcess(PROCESS_QUERY_INFORMATION, false, DWORD(pid));
-	DWORD ExitCode = 0;
-	GetExitCodeProcess(player, &ExitCode);
-	CloseHandle(player);
-	return ExitCode == STILL_ACTIVE;
-#else
-	int wstatus;
-	auto wpid = waitpid(pid, &wstatus, WNOHANG);
-	if (wpid == pid)
-	{
-		if (WIFEXITED(wstatus)) return false;
-		printf("Exit code: %d\n", WEXITSTATUS(wstatus));
-	}
-	return true;
-#endif
+	auto ListView = Arena.Create<UIElementListView>("ListView");
+	Parent.InsertElement(*ListView);
+	ListView->XMargin = 10;
+	ListView->YMargin = 10;
+	ListView->XBorder = 1;
+	ListView->YBorder = 1;
+	ListView->XPadding = 1;
+	ListView->YPadding = 1;
+	ListView->BorderColor = 0xFFC0C0C0;
+	ListView->ExpandToParentX = true;
+	ListView->ExpandToParentY = true;
+	ListView->LineBreak = false;
+	ListView->Transparent = true;
+	ListView->Alignment = AlignmentType::LeftTop;
+	return ListView;
 }
 
-std::set<std::string> IterateDirectory(const std::string& media_path)
+UIHandle<UIElementThumbnailGrid> CreateThumbnailGrid(UIElementArena& Arena, UIElementBase& Parent)
 {
-	auto Files = std::set<std::string>();
-	for (auto& directory : std::filesystem::directory_iterator(media_path))
-	{
-		// 跳过文件夹
-		if (directory.is_directory()) continue;
-
-		auto p = directory.path();
-		auto FileNameString = p.filename().string();
-		Files.insert(FileNameString);
-	}
-
-	return Files;
+	auto Grid = Arena.Create<UIElementThumbnailGrid>("ThumbnailGrid");
+	Parent.InsertElement(*Grid);
+	Grid->XMargin = 10;
+	Grid->YMargin = 10;
+	Grid->XBorder = 1;
+	Grid->YBorder = 1;
+	Grid->XPadding = 4;
+	Grid->YPadding = 4;
+	Grid->BorderColor = 0xFFC0C0C0;
+	Grid->ExpandToParentX = true;
+	Grid->ExpandToParentY = true;
+	Grid->LineBreak = false;
+	Grid->Transparent = true;
+	Grid->Alignment = AlignmentType::LeftTop;
+	return Grid;
 }
 
 int main(int argc, char** argv, char** envp)
 {
-	const int ResoW = 480;
-	const int ResoH = 272;
-
 	bool Mounted = false;
+	bool UseThumbnailGrid = false;
+	std::string ButtonChip = "/dev/gpiochip0";
+	std::vector<uint32_t> ButtonLines = { 4 * 32 + 1, 4 * 32 + 2, 4 * 32 + 3, 4 * 32 + 4 }; // PE1 ~ PE4
+	std::vector<std::string> EvdevDevices;
+	std::vector<std::string> InputScripts;
+	for (int i = 1; i < argc; i++)
+	{
+		auto Arg = std::string(argv[i]);
+		if (Arg == "--grid") UseThumbnailGrid = true;
+		else if (Arg == "--gpiochip" && i + 1 < argc) ButtonChip = argv[++i];
+		else if (Arg == "--gpio-lines" && i + 1 < argc)
+		{ // 逗号分隔的四个线号，依次为 播放、下一个、上一个、音量
+			ButtonLines.clear();
+			std::stringstream ss(argv[++i]);
+			std::string Line;
+			while (std::getline(ss, Line, ',')) ButtonLines.push_back(uint32_t(std::stoul(Line)));
+		}
+		else if (Arg == "--evdev" && i + 1 < argc) EvdevDevices.push_back(argv[++i]);
+		else if (Arg == "--input-script" && i + 1 < argc) InputScripts.push_back(argv[++i]);
+	}
 
 	WriteGPIOE(0, true);
 	GPIO_Periph[GPIO_E].SetModeIn(1);
@@ -260,377 +200,409 @@ int main(int argc, char** argv, char** envp)
 	GPIO_Periph[GPIO_E].SetModeIn(3);
 	GPIO_Periph[GPIO_E].SetModeIn(4);
 
+	// 板上的按键优先用 GPIO 字符设备由内核报告边沿事件，打不开时定时读寄存器。
+	// 另外可以加上输入子系统的设备（`--evdev`）和按键脚本（`--input-script`，文件或命名管道）。
+	InputSet Inputs;
+	std::vector<KeyEvent> KeyEvents;
+	// 电平变化经过消抖、重复、长按处理后变成按键动作，界面按顺序处理，短按不会丢
+	KeyActionQueue KeyActions;
+	KeyStateMachine KeyMachine(KeyActions);
+
+	// 主循环只在有事情发生时醒来：按键、插拔 SD 卡、播放器退出（SIGCHLD）、缩略图完成、动画的下一帧
+	EventLoop Loop;
+	ChildProcessManager Children(Loop); // 播放器退出时立即回收，结束播放器不等待
+
+	// SD 卡的插拔由内核的 uevent 通知，收不到 uevent 时每秒检查一次设备文件
+	BlockHotplugMonitor CardMonitor("mmcblk0p1");
+#if !defined(_MSC_VER)
+	if (CardMonitor.Open())
+	{
+		Loop.AddFD(CardMonitor.GetFD(), EventLoop::Readable, [&](uint32_t) { CardMonitor.ReadEvents(); });
+	}
+	else
+	{
+		CardMonitor.Poll();
+		Loop.AddTimer(std::chrono::steady_clock::now(), [&]() { CardMonitor.Poll(); }, std::chrono::seconds(1));
+	}
+#endif
+	// 按键到界面处理、到上屏的延迟以及切换视频各步骤的耗时，`kill -USR1` 时输出
+	LatencyRecorder Latency;
+#if !defined(_MSC_VER)
+	Loop.AddSignal(SIGUSR1, [&](int) { Latency.Dump(std::cout); });
+#endif
+	// 挂载、卸载、扫描目录、设置声卡等会阻塞的操作都在 I/O 线程中执行，本线程只负责界面和按键。
+	// 在注册完信号之后创建，I/O 线程继承同样的信号屏蔽。
+	IOWorker IO;
+	IO.OnCompleted = [&Loop]() { Loop.Wakeup(); };
+
+	const auto MarqueeInterval = std::chrono::milliseconds(50);
+	auto NextMarquee = std::chrono::steady_clock::now();
+#if !defined(_MSC_VER)
+	auto ChipInput = std::make_unique<GPIOChipInput>();
+	if (ChipInput->Open(ButtonChip, ButtonLines))
+	{
+		DbgPrintf("Buttons: waiting for edge events on %s.\n", ButtonChip.c_str());
+		Inputs.Add(std::move(ChipInput));
+	}
+	else
+	{
+		Inputs.Add(std::make_unique<GPIOPollInput>());
+	}
+	for (auto& Device : EvdevDevices)
+	{
+		auto Evdev = std::make_unique<EvdevInput>();
+		if (Evdev->Open(Device)) Inputs.Add(std::move(Evdev));
+	}
+	for (auto& Script : InputScripts)
+	{
+		auto Scripted = std::make_unique<ScriptedInput>();
+		if (Scripted->Open(Script)) Inputs.Add(std::move(Scripted));
+	}
+#else
+	Inputs.Add(std::make_unique<KeyboardInput>());
+#endif
+	// 所有输入源都加进来之后才知道有没有不能等待、需要定时读取的
+	if (Inputs.GetFD() != -1) Loop.AddFD(Inputs.GetFD(), EventLoop::Readable, [&](uint32_t) { Inputs.Poll(KeyEvents); });
+	if (Inputs.NeedsPolling())
+	{
+		Loop.AddTimer(std::chrono::steady_clock::now(), [&]() { Inputs.Poll(KeyEvents); }, std::chrono::milliseconds(10));
+	}
 	bool NeedRedraw = true;
 	bool NeedRelist = true;
 
+	bool Mounting = false; // 挂载请求已交给 I/O 线程，还没有结果
+	uint64_t CardGeneration = 0; // 每次拔卡加一，之前提交的挂载、扫描的结果作废
+	auto NextMountTime = std::chrono::steady_clock::now();
+
 	int Volume = 48;
 	int StartSec = 0;
 
-	pid_t VideoPlayerPID = -1;
-	pid_t AudioPlayerPID = -1;
-
 #if !defined(_MSC_VER)
 	std::string media_path = "/mnt/sdcard";
+	std::string font_dir = "/usr/share/tvos";
 #else
 	std::string media_path = "testsdcard";
+	std::string font_dir = ".";
 #endif
 
 #if !defined(_MSC_VER)
-	auto FB = Graphics(ResoW, ResoH, false);
+	// 分辨率取自 `/sys/class/graphics/fb0/virtual_size`，字体按实际的行数选择
+	auto FB = Graphics(false);
 	FB.SetBackBufferMode();
 #else
 	auto FB = MyTestApp(false);
 #endif
+	FB.LoadFontForResolution(font_dir);
 	FB.ClearScreen(0);
-	auto GUI = UIElementBase(FB, "root");
 
-	GUI.XMargin = 2;
-	GUI.YMargin = 2;
-	GUI.XBorder = 2;
-	GUI.YBorder = 2;
-	GUI.XPadding = 0;
-	GUI.YPadding = 0;
-	GUI.BorderColor = 0xFFFFFFFF;
-	GUI.FillColor = 0;
-	GUI.Transparent = true;
-	GUI.ExpandToParentX = true;
-	GUI.ExpandToParentY = true;
+	// 按屏幕刷新率推进滚动等动画，主循环只在有动画时按帧的时刻醒来
+	auto Animations = UIAnimationScheduler(60);
+
+	// 两个界面都只建立一次，插拔 SD 卡时切换。列表界面在每次挂载后更新列表内容。
+	auto Screens = UIScreenManager(FB);
+
+	auto& InsertCardScreen = Screens.CreateScreen("InsertCard");
+	InitRootElement(InsertCardScreen.GetRoot());
+	CreateTitle(InsertCardScreen.GetArena(), InsertCardScreen.GetRoot(), "A5-MiniTV 小电视");
+	CreatePrompt(InsertCardScreen.GetArena(), InsertCardScreen.GetRoot(), "请插入 SD 卡。可在播放时随时拔出 SD 卡。\n");
+
+	auto& ListScreen = Screens.CreateScreen("List");
+	InitRootElement(ListScreen.GetRoot());
+	auto Title = CreateTitle(ListScreen.GetArena(), ListScreen.GetRoot(), GetVolumeCaption(Volume));
 
-	do
+	// 列表界面用文件名列表或者缩略图网格（`--grid`）浏览，之后都通过 `Browser` 操作
+	UIHandle<UIElementListView> ListView;
+	UIHandle<UIElementThumbnailGrid> Grid;
+	UIItemBrowser* Browser = nullptr;
+	std::unique_ptr<ThumbnailCache> Thumbnails; // 挂载期间存在，缓存文件在 SD 卡上
+	if (UseThumbnailGrid)
 	{
-		auto Sub = std::make_shared<UIElementLabel>(FB, "Title");
-		GUI.InsertElement(Sub);
-		Sub->XMargin = 0;
-		Sub->YMargin = 0;
-		Sub->XBorder = 0;
-		Sub->YBorder = 1;
-		Sub->XPadding = 2;
-		Sub->YPadding = 2;
-		Sub->BorderColor = 0xFFFFFFFF;
-		Sub->FillColor = 0xFF000000;
-		Sub->FontColor = 0xFFFFFFFF;
-		Sub->ExpandToParentX = true;
-		Sub->LineBreak = false;
-		Sub->Transparent = false;
-		Sub->Alignment = AlignmentType::CenterTop;
-		Sub->SetCaption("A5-MiniTV 小电视");
-
-		auto Prompt = std::make_shared<UIElementLabel>(FB, "Prompt");
-		GUI.InsertElement(Prompt);
-		Prompt->XMargin = 0;
-		Prompt->YMargin = 0;
-		Prompt->XBorder = 0;
-		Prompt->YBorder = 0;
-		Prompt->XPadding = 0;
-		Prompt->YPadding = 0;
-		Prompt->BorderColor = 0xFFFFFFFF;
-		Sub->FillColor = 0xFF000000;
-		Sub->FontColor = 0xFFFFFFFF;
-		Prompt->ExpandToParentX = true;
-		Prompt->ExpandToParentY = true;
-		Prompt->LineBreak = false;
-		Prompt->Transparent = true;
-		Prompt->Alignment = AlignmentType::CenterCenter;
-		Prompt->SetCaption("请插入 SD 卡。可在播放时随时拔出 SD 卡。\n");
+		Grid = CreateThumbnailGrid(ListScreen.GetArena(), ListScreen.GetRoot());
+		Grid->OnThumbnailNeeded = [&Thumbnails](const std::string& Key)
+		{
+			if (Thumbnails) Thumbnails->Request(Key);
+		};
+		Browser = Grid.get();
+	}
+	else
+	{
+		ListView = CreateListView(ListScreen.GetArena(), ListScreen.GetRoot());
+		ListView->Animator = &Animations;
+		Browser = ListView.get();
+	}
+
+	Screens.SwitchTo(InsertCardScreen);
+	NeedRedraw = true;
 
+	// 切换视频的每一步都在主循环中等待，期间照常处理按键和插拔
+	PlaybackController Playback(Loop, Children, IO);
+	Playback.Stats = &Latency;
+	Playback.OnClearScreen = [&]()
+	{
+		FB.ClearScreen(0);
+		Screens.InvalidateScreen(); // 列表界面的画面被清空了，播放中拔卡切换界面时不能再当作缓存
+		FB.RefreshFrontBuffer();
 		NeedRedraw = true;
-	} while (false);
+	};
+	Playback.IsFirstFrameShown = [&]() { return FB.FrontBufferRowDiffers(FB.GetHeight() / 2, 0); };
+	Playback.OnFinished = [&]()
+	{
+		StartSec = 0;
+		FB.ClearScreen(0);
+		Screens.InvalidateScreen(); // 屏幕被清空了，下次需要整个重绘
+		NeedRelist = true;
+	};
+
+	// 用扫描的结果重建列表，选中第 Selection 项
+	auto FillList = [&](const std::set<std::string>& Files, size_t Selection)
+	{
+		Browser->ClearItems();
+		for (auto& filename : Files)
+		{
+			Browser->AddItem(filename, filename);
+		}
+		ListScreen.GetRoot().RearrangeElementsAsRoot();
+		Browser->SelectByIndex(Selection);
+	};
 
 	while (true)
 	{
+		IO.RunCompleted();
+		// 按键由 `Loop` 中注册的描述符或定时器读入 KeyEvents
+		for (auto& Event : KeyEvents) KeyMachine.Feed(Event);
+		KeyEvents.clear();
+		KeyMachine.Advance(GetInputTimeNs());
 #if !defined(_MSC_VER)
-		if (!std::filesystem::exists(std::filesystem::path("/dev/mmcblk0p1")))
+		if (!CardMonitor.IsPresent())
 #else
 		if (GetAsyncKeyState(VK_SPACE))
 #endif
 		{
-			if (Mounted)
+			if (Mounted || Mounting)
 			{
-				StopPlay(VideoPlayerPID, AudioPlayerPID);
+				Playback.Stop();
+				CardGeneration++;
 
+				// 缩略图缓存在 I/O 线程中销毁（要等正在提取的缩略图结束），之后再卸载，都不在本线程等待。
+				// 缓存只能由请求持有，不能在本线程留下引用。
+				IO.Post([OldThumbnails = std::shared_ptr<ThumbnailCache>(std::move(Thumbnails)), media_path]() mutable
+				{
+					OldThumbnails.reset();
 #if !defined(_MSC_VER)
-				umount2("/mnt/sdcard", MNT_FORCE);
+					umount2(media_path.c_str(), MNT_FORCE);
 #endif
+				});
 				Mounted = false;
+				Mounting = false;
 
-				GUI.ClearElements();
-				FB.ClearScreen(0);
-
-				auto Sub = std::make_shared<UIElementLabel>(FB, "Title");
-				GUI.InsertElement(Sub);
-				Sub->XMargin = 0;
-				Sub->YMargin = 0;
-				Sub->XBorder = 0;
-				Sub->YBorder = 1;
-				Sub->XPadding = 2;
-				Sub->YPadding = 2;
-				Sub->BorderColor = 0xFFFFFFFF;
-				Sub->FillColor = 0xFF000000;
-				Sub->FontColor = 0xFFFFFFFF;
-				Sub->ExpandToParentX = true;
-				Sub->LineBreak = false;
-				Sub->Transparent = false;
-				Sub->Alignment = AlignmentType::CenterTop;
-				Sub->SetCaption("A5-MiniTV 小电视");
-
-				auto Prompt = std::make_shared<UIElementLabel>(FB, "Prompt");
-				GUI.InsertElement(Prompt);
-				Prompt->XMargin = 0;
-				Prompt->YMargin = 0;
-				Prompt->XBorder = 0;
-				Prompt->YBorder = 0;
-				Prompt->XPadding = 0;
-				Prompt->YPadding = 0;
-				Prompt->BorderColor = 0xFFFFFFFF;
-				Sub->FillColor = 0xFF000000;
-				Sub->FontColor = 0xFFFFFFFF;
-				Prompt->ExpandToParentX = true;
-				Prompt->ExpandToParentY = true;
-				Prompt->LineBreak = false;
-				Prompt->Transparent = true;
-				Prompt->Alignment = AlignmentType::CenterCenter;
-				Prompt->SetCaption("请插入 SD 卡。可在播放时随时拔出 SD 卡。\n");
-
+				Screens.SwitchTo(InsertCardScreen);
 				NeedRedraw = true;
 			}
 		}
 		else
 		{
 			auto SDCardPath = std::filesystem::path(media_path);
-			if (!std::filesystem::exists(SDCardPath))
-			{
-				std::filesystem::create_directories(SDCardPath);
-			}
 
-			if (!Mounted)
+			if (!Mounted && !Mounting && std::chrono::steady_clock::now() >= NextMountTime)
 			{
-#if !defined(_MSC_VER)
-				int m = mount("/dev/mmcblk0p1", media_path.c_str(), "vfat", 0, "");
-				if (m != 0)
+				struct MountResult
+				{
+					bool Succeeded = false;
+					std::set<std::string> Files;
+				};
+				auto Result = std::make_shared<MountResult>();
+				auto DevicePath = CardMonitor.GetDevicePath();
+				auto Gen = CardGeneration;
+				Mounting = IO.Post([Result, DevicePath, media_path]()
 				{
-					perror("mount()");
-					if (errno == EBUSY) m = mount("/dev/mmcblk0p1", media_path.c_str(), "vfat", MS_REMOUNT, "");
+					auto SDCardPath = std::filesystem::path(media_path);
+					if (!std::filesystem::exists(SDCardPath))
+					{
+						std::filesystem::create_directories(SDCardPath);
+					}
+#if !defined(_MSC_VER)
+					int m = mount(DevicePath.c_str(), media_path.c_str(), "vfat", 0, "");
 					if (m != 0)
 					{
 						perror("mount()");
+						if (errno == EBUSY) m = mount(DevicePath.c_str(), media_path.c_str(), "vfat", MS_REMOUNT, "");
+						if (m != 0)
+						{
+							perror("mount()");
+						}
 					}
-				}
-				if (m == 0)
+					if (m != 0) return;
 #else
-				if (1)
+					(void)DevicePath;
 #endif
+					Result->Succeeded = true;
+					Result->Files = IterateDirectory(media_path);
+				}, [&, Result, Gen]()
 				{
-					Mounted = true;
-					FB.ClearScreen(0);
-					GUI.ClearElements();
-
-					auto Sub = std::make_shared<UIElementLabel>(FB, "Title");
-					GUI.InsertElement(Sub);
-					Sub->XMargin = 0;
-					Sub->YMargin = 0;
-					Sub->XBorder = 0;
-					Sub->YBorder = 1;
-					Sub->XPadding = 2;
-					Sub->YPadding = 2;
-					Sub->BorderColor = 0xFFFFFFFF;
-					Sub->FillColor = 0xFF000000;
-					Sub->FontColor = 0xFFFFFFFF;
-					Sub->ExpandToParentX = true;
-					Sub->LineBreak = false;
-					Sub->Transparent = false;
-					Sub->Alignment = AlignmentType::CenterTop;
-					switch (Volume)
+					if (Gen != CardGeneration) return; // 挂载期间卡被拔出了，卸载已经排在后面
+					Mounting = false;
+					if (!Result->Succeeded)
 					{
-					case 63:
-						Sub->SetCaption("请选择要播放的曲目（200% 音量）");
-						break;
-					case 56:
-						Sub->SetCaption("请选择要播放的曲目（100% 音量）");
-						break;
-					case 48:
-						Sub->SetCaption("请选择要播放的曲目（50% 音量）");
-						break;
-					case 0:
-						Sub->SetCaption("请选择要播放的曲目（0% 音量）");
-						break;
-					default:
-						Sub->SetCaption("请选择要播放的曲目");
-						break;
+						// 设备刚出现时可能还不能挂载，稍后再试
+						NextMountTime = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+						Loop.AddTimer(NextMountTime, []() {});
+						return;
 					}
-
-					auto ListView = std::make_shared<UIElementListView>(FB, "ListView");
-					GUI.InsertElement(ListView);
-					ListView->XMargin = 10;
-					ListView->YMargin = 10;
-					ListView->XBorder = 1;
-					ListView->YBorder = 1;
-					ListView->XPadding = 1;
-					ListView->YPadding = 1;
-					ListView->BorderColor = 0xFFC0C0C0;
-					ListView->ExpandToParentX = true;
-					ListView->ExpandToParentY = true;
-					ListView->LineBreak = false;
-					ListView->Transparent = true;
-					ListView->Alignment = AlignmentType::LeftTop;
-
-					ListView->ClearElements();
-					for (auto& filename : IterateDirectory(media_path))
+					Mounted = true;
+					if (UseThumbnailGrid)
 					{
-						auto ListItem = std::make_shared<UIElementListItem>(FB, filename);
-						ListView->AddItem(filename, filename);
+						Thumbnails = std::make_unique<ThumbnailCache>(media_path, Grid->ThumbnailWidth, Grid->ThumbnailHeight);
+						Thumbnails->OnCompleted = [&Loop]() { Loop.Wakeup(); };
 					}
+					FillList(Result->Files, 0);
 
+					// 换入上次的画面，`Render()` 时只重绘列表中变了的行
+					Screens.SwitchTo(ListScreen);
 					NeedRedraw = true;
-				}
-				else
-				{
-#if !defined(_MSC_VER)
-					perror("mount()");
-#endif
-				}
+				});
 			}
 
-			if (GUI.count("ListView"))
+			if (Mounted)
 			{
-				auto& Title = dynamic_cast<UIElementLabel&>(*GUI.at("Title"));
-				auto& ListView = dynamic_cast<UIElementListView&>(*GUI.at("ListView"));
-				if (VideoPlayerPID == -1 && AudioPlayerPID == -1)
+				KeyActionEvent Event;
+				while (KeyActions.Pop(Event))
 				{
-					if (GPIO_Periph[GPIO_E].ReadBit(1))
-					{
-						auto VideoFile = (SDCardPath / ListView.GetSelectedItem().GetCaption()).string();
-						StopPlay(VideoPlayerPID, AudioPlayerPID);
-						FB.ClearScreen(0);
-						FB.RefreshFrontBuffer();
-						PlayVideo(VideoFile, VideoPlayerPID, AudioPlayerPID, Volume, StartSec);
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(2))
-					{
-						ListView.SelectNext();
-						NeedRedraw = true;
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(3))
-					{
-						ListView.SelectPrev();
-						NeedRedraw = true;
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(4))
+					if (Event.Action == KeyAction::Release || Event.Action == KeyAction::LongPress) continue;
+					auto LatencyType = std::string(Playback.IsActive() ? "play." : "list.") + GetInputKeyName(Event.Key);
+					if (Event.Action == KeyAction::Repeat) LatencyType += ".repeat";
+					if (!Playback.IsActive())
 					{
-						switch (Volume)
+						// 按住 下一个、上一个 时按重复的节奏移动选择，其它键只在按下时有效
+						if (Event.Action == KeyAction::Repeat && Event.Key != InputKey::Next && Event.Key != InputKey::Prev) continue;
+						switch (Event.Key)
 						{
-						case 63: Volume = 0; break;
-						case 56: Volume = 63; break;
-						case 48: Volume = 56; break;
-						default: Volume = 48; break;
-						}
-						switch (Volume)
+						case InputKey::Play:
 						{
-						case 63:
-							Title.SetCaption("请选择要播放的曲目（200% 音量）");
-							break;
-						case 56:
-							Title.SetCaption("请选择要播放的曲目（100% 音量）");
+							auto VideoFile = (SDCardPath / Browser->GetSelectedKey()).string();
+							Playback.Play(VideoFile, Volume, StartSec, Event.TimestampNs);
 							break;
-						case 48:
-							Title.SetCaption("请选择要播放的曲目（50% 音量）");
+						}
+						case InputKey::Next:
+							Browser->SelectNext();
+							NeedRedraw = true;
 							break;
-						case 0:
-							Title.SetCaption("请选择要播放的曲目（0% 音量）");
+						case InputKey::Prev:
+							Browser->SelectPrev();
+							NeedRedraw = true;
 							break;
-						default:
-							Title.SetCaption("请选择要播放的曲目");
+						case InputKey::Volume:
+							switch (Volume)
+							{
+							case 63: Volume = 0; break;
+							case 56: Volume = 63; break;
+							case 48: Volume = 56; break;
+							default: Volume = 48; break;
+							}
+							Title->SetCaption(GetVolumeCaption(Volume));
+							NeedRedraw = true;
 							break;
 						}
-						NeedRelist = true;
 					}
-				}
-				else
-				{
-					if (GPIO_Periph[GPIO_E].ReadBit(1))
+					else
 					{
-						StopPlay(VideoPlayerPID, AudioPlayerPID);
-						StartSec += 60;
-						auto VideoFile = (SDCardPath / ListView.GetSelectedItem().GetCaption()).string();
-						PlayVideo(VideoFile, VideoPlayerPID, AudioPlayerPID, Volume, StartSec);
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(2))
-					{
-						StopPlay(VideoPlayerPID, AudioPlayerPID);
-						StartSec = 0;
-						ListView.SelectNext();
-						auto VideoFile = (SDCardPath / ListView.GetSelectedItem().GetCaption()).string();
-						PlayVideo(VideoFile, VideoPlayerPID, AudioPlayerPID, Volume, StartSec);
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(3))
-					{
-						StopPlay(VideoPlayerPID, AudioPlayerPID);
-						StartSec = 0;
-						ListView.SelectPrev();
-						auto VideoFile = (SDCardPath / ListView.GetSelectedItem().GetCaption()).string();
-						PlayVideo(VideoFile, VideoPlayerPID, AudioPlayerPID, Volume, StartSec);
-					}
-					if (GPIO_Periph[GPIO_E].ReadBit(4))
-					{
-						StopPlay(VideoPlayerPID, AudioPlayerPID);
-						StartSec = 0;
-						std::this_thread::sleep_for(std::chrono::milliseconds(100));
-						FB.ClearScreen(0);
-						NeedRelist = true;
+						if (Event.Action != KeyAction::Press) continue; // 播放时按住不放不会反复重新开始播放
+						switch (Event.Key)
+						{
+						case InputKey::Play:
+						{
+							StartSec += 60;
+							auto VideoFile = (SDCardPath / Browser->GetSelectedKey()).string();
+							Playback.Play(VideoFile, Volume, StartSec, Event.TimestampNs);
+							break;
+						}
+						case InputKey::Next:
+						{
+							StartSec = 0;
+							Browser->SelectNext();
+							auto VideoFile = (SDCardPath / Browser->GetSelectedKey()).string();
+							Playback.Play(VideoFile, Volume, StartSec, Event.TimestampNs);
+							break;
+						}
+						case InputKey::Prev:
+						{
+							StartSec = 0;
+							Browser->SelectPrev();
+							auto VideoFile = (SDCardPath / Browser->GetSelectedKey()).string();
+							Playback.Play(VideoFile, Volume, StartSec, Event.TimestampNs);
+							break;
+						}
+						case InputKey::Volume:
+							Playback.Stop(); // 播放器退出后回到列表
+							break;
+						}
 					}
+					Latency.Handled(LatencyType, Event.TimestampNs, GetInputTimeNs());
 				}
-			}
-
-			if ((VideoPlayerPID != -1 || AudioPlayerPID != -1) && (!IsPlaying(VideoPlayerPID) || !IsPlaying(AudioPlayerPID)))
-			{
-				StopPlay(VideoPlayerPID, AudioPlayerPID);
-				StartSec = 0;
-				FB.ClearScreen(0);
-				NeedRelist = true;
+				// 播放中的按键等到新的播放器出了第一帧（由 `Playback` 记录），或者停止后列表重绘时才算上屏
 			}
 		}
+		KeyActionEvent Unhandled;
+		while (KeyActions.Pop(Unhandled)); // 没有插卡时的按键直接丢弃
 
-		if (VideoPlayerPID == -1 && AudioPlayerPID == -1)
+		if (!Playback.IsActive())
 		{
 			if (NeedRelist)
 			{
-				if (GUI.count("ListView"))
+				if (Mounted)
 				{
-					auto& ListView = dynamic_cast<UIElementListView&>(*GUI.at("ListView"));
-					auto CurSelection = ListView.GetSelectionIndex();
-					ListView.ClearElements();
-					for (auto& filename : IterateDirectory(media_path))
+					// 先画出原来的列表，扫描完再更新
+					auto Files = std::make_shared<std::set<std::string>>();
+					auto Gen = CardGeneration;
+					IO.Post([Files, media_path]() { *Files = IterateDirectory(media_path); }, [&, Files, Gen]()
 					{
-						auto ListItem = std::make_shared<UIElementListItem>(FB, filename);
-						ListView.AddItem(filename, filename);
-					}
-					GUI.RearrangeElementsAsRoot();
-					ListView.SelectByIndex(CurSelection);
+						if (Gen != CardGeneration || !Mounted) return;
+						FillList(*Files, Browser->GetSelectionIndex());
+						NeedRedraw = true;
+					});
 				}
 				NeedRelist = false;
 				NeedRedraw = true;
 			}
-			if (NeedRedraw)
+			if (Thumbnails)
+			{ // 后台提取完的缩略图填进网格，没有完成的继续显示占位框
+				for (auto& Done : Thumbnails->TakeCompleted())
+				{
+					if (Grid->SetThumbnail(Done.first, Done.second)) NeedRedraw = true;
+				}
+			}
+			if (Animations.Tick())
 			{
-				GUI.Render();
-				NeedRedraw = false;
+				NeedRedraw = true;
 			}
-#if !defined(_MSC_VER)
-			FB.RefreshFrontBuffer();
-#endif
-			if (!Mounted)
+			if (NeedRedraw)
 			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+				Screens.Render();
+				NeedRedraw = false;
 			}
-			else
+			else if (Mounted && ListView && std::chrono::steady_clock::now() >= NextMarquee)
 			{
-				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				ListView->AnimateMarquee();
+				NextMarquee = std::chrono::steady_clock::now() + MarqueeInterval;
 			}
+#if !defined(_MSC_VER)
+			FB.RefreshDirtyRect();
+#endif
+			if (Latency.HasPending()) Latency.Presented(GetInputTimeNs());
 		}
-		else
+
+		// 睡到下一个按键动作、动画帧或标题滚动的时间，其它事件由 `Loop` 中注册的描述符和定时器唤醒
+		auto WakeTime = GetInputTimePoint(KeyMachine.GetNextDeadlineNs());
+		if (Mounted && !Playback.IsActive())
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+			WakeTime = std::min(WakeTime, Animations.GetNextFrameTime());
+			if (ListView && ListView->HasMarquee()) WakeTime = std::min(WakeTime, NextMarquee);
 		}
 #if defined(_MSC_VER)
+		WakeTime = std::chrono::steady_clock::now(); // 窗口消息需要及时处理，由下面的 Sleep(10) 控制节奏
+#endif
+		Loop.RunOnce(WakeTime);
+#if defined(_MSC_VER)
+		Children.Poll();
 		FB.RefreshFB();
 		FB.ProcessMessageNonBlocking();
 		if (FB.GetWindowIsDestroyed()) break;
@@ -0,0 +1,344 @@
+﻿#include "playback.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace TVOS
+{
+	static size_t GetFileSize(const std::string& File)
+	{
+		FILE* fp = fopen(File.c_str(), "rb");
+		if (fp)
+		{
+			fseek(fp, 0, SEEK_END);
+			auto size = ftell(fp);
+			fclose(fp);
+			return size > 0 ? size_t(size) : 0;
+		}
+		return 0;
+	}
+
+	// 设置音量、打开功放，不大的文件先整个读一遍，播放开头时不卡。在 I/O 线程中执行。
+	static void PrepareToPlay(const std::string& VideoFile, int Volume)
+	{
+#if !defined(_MSC_VER)
+		char buf[4096];
+		snprintf(buf, sizeof buf, "tinymix set 1 %d", Volume);
+		system(buf);
+		system("tinymix set 2 1");
+		system("tinymix set 13 0");
+
+		auto FileSize = GetFileSize(VideoFile);
+		if (FileSize > 0 && FileSize <= 16384 * 1024)
+		{
+			snprintf(buf, sizeof buf, "cat \"%s\" > /dev/null", VideoFile.c_str());
+			system(buf);
+		}
+#else
+		(void)VideoFile; (void)Volume;
+#endif
+	}
+
+	PlaybackController::PlaybackController(EventLoop& Loop, ChildProcessManager& Children, IOWorker& IO) :
+		Loop(Loop),
+		Children(Children),
+		IO(IO)
+#if defined(TVOS_HAS_COROUTINES)
+		, Tasks(Loop)
+#else
+		, Self(std::make_shared<PlaybackController*>(this))
+#endif
+	{
+		Children.OnExit = [this](pid_t Pid, int) { HandleExit(Pid); };
+	}
+
+	PlaybackController::~PlaybackController()
+	{
+#if !defined(TVOS_HAS_COROUTINES)
+		CancelWait();
+		*Self = nullptr;
+#endif
+		Children.OnExit = nullptr;
+	}
+
+	bool PlaybackController::IsActive() const
+	{
+		return State != StateType::Idle;
+	}
+
+	bool PlaybackController::PlayersRunning() const
+	{
+		return Children.IsRunning(VideoPID) || Children.IsRunning(AudioPID);
+	}
+
+	void PlaybackController::Record(const char* Step, Clock::time_point Start)
+	{
+		if (!Stats) return;
+		auto ToNs = [](Clock::time_point t) { return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count()); };
+		Stats->Duration(Step, ToNs(Start), ToNs(Clock::now()));
+	}
+
+	void PlaybackController::RecordPresented(uint64_t InputNs)
+	{
+		if (!Stats || !InputNs) return;
+		Stats->Presented(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count()));
+	}
+
+	// 只是开始结束播放器，由 `Children` 逐步升级信号并回收
+	void PlaybackController::StopPlayers()
+	{
+		if (VideoPID != -1)
+		{
+			printf("Stopping video player PID: %d\n", VideoPID);
+			Children.Stop(VideoPID);
+		}
+		if (AudioPID != -1 && AudioPID != VideoPID)
+		{
+			// 声卡要尽快释放给下一个播放器，SIGINT 之后很快就发 SIGTERM
+			printf("Stopping audio player PID: %d\n", AudioPID);
+			Children.Stop(AudioPID, std::chrono::milliseconds(50));
+		}
+	}
+
+	void PlaybackController::SpawnPlayers(const std::string& VideoFile, int StartSec)
+	{
+		char buf[4096];
+#if !defined(_MSC_VER)
+		snprintf(buf, sizeof buf, "ffmpeg -hide_banner -ss %d -i \"%s\" -an -pix_fmt bgra -f fbdev /dev/fb0 -vn -f wav pipe:1 -ar 44100 -ac 1", StartSec, VideoFile.c_str());
+		printf("%s | tinyplay stdin -r 44100 -c 1\n", buf);
+		Children.SpawnPipeline(buf, "tinyplay stdin -r 44100 -c 1", VideoPID, AudioPID);
+#else
+		(void)StartSec;
+		snprintf(buf, sizeof buf, "ffplay %s", VideoFile.c_str());
+		printf("%s\n", buf);
+		VideoPID = Children.Spawn(buf);
+		AudioPID = VideoPID;
+#endif
+		printf("Video Player PID: %d\n", VideoPID);
+		printf("Audio Player PID: %d\n", AudioPID);
+	}
+
+	void PlaybackController::Launch(const std::string& VideoFile, int StartSec, Clock::time_point Start)
+	{
+		if (OnClearScreen) OnClearScreen();
+		SpawnPlayers(VideoFile, StartSec);
+		Record("playback.spawn", Start);
+		if (VideoPID == -1)
+		{
+			// 启动失败，回到列表
+			State = StateType::Idle;
+			if (OnFinished) OnFinished();
+			return;
+		}
+		State = StateType::Playing;
+	}
+
+	void PlaybackController::HandleExit(pid_t Pid)
+	{
+		if (Pid == -1 || (Pid != VideoPID && Pid != AudioPID))
+		{
+			// 没等到退出的旧播放器退出前可能还在往屏幕上画，回到列表后再整个重绘一次
+			if (State == StateType::Idle && OnClearScreen) OnClearScreen();
+		}
+		else if (State == StateType::Playing)
+		{
+			// 播放完了或者播放器出错，另一个也结束掉，回到列表
+			Stop();
+		}
+#if !defined(TVOS_HAS_COROUTINES)
+		CheckWait(); // 可能正在等播放器退出
+#endif
+	}
+
+#if defined(TVOS_HAS_COROUTINES)
+	void PlaybackController::Play(const std::string& VideoFile, int Volume, int StartSec, uint64_t InputNs)
+	{
+		State = StateType::Starting;
+		Tasks.Spawn(RunPlay(VideoFile, Volume, StartSec, InputNs, ++Generation));
+	}
+
+	void PlaybackController::Stop()
+	{
+		if (State == StateType::Idle) return;
+		State = StateType::Stopping;
+		Tasks.Spawn(RunStop(++Generation));
+	}
+
+	Task PlaybackController::RunPlay(std::string VideoFile, int Volume, int StartSec, uint64_t InputNs, uint64_t Gen)
+	{
+		auto Start = Clock::now();
+
+		// 上一个播放器占着声卡和屏幕，等它退出再开始
+		StopPlayers();
+		auto Exited = WaitUntil([this]() { return !PlayersRunning(); }, ExitTimeout);
+		co_await Exited;
+		if (Gen != Generation) co_return;
+		Record("playback.stop", Start);
+		VideoPID = -1;
+		AudioPID = -1;
+
+		// 完成标志由结果和协程共同持有，协程被取代或销毁后结果才回来也没有关系
+		auto PrepareStart = Clock::now();
+		auto Prepared = std::make_shared<bool>(false);
+		if (IO.Post([VideoFile, Volume]() { PrepareToPlay(VideoFile, Volume); }, [Prepared]() { *Prepared = true; }))
+		{
+			auto PrepareDone = WaitUntil([Prepared]() { return *Prepared; }, PrepareTimeout);
+			co_await PrepareDone;
+			if (Gen != Generation) co_return;
+		}
+		Record("playback.prepare", PrepareStart);
+
+		Launch(VideoFile, StartSec, Start);
+		if (State != StateType::Playing) co_return;
+		if (!IsFirstFrameShown)
+		{
+			RecordPresented(InputNs);
+			co_return;
+		}
+		auto FirstFrame = WaitUntil([this]() { return IsFirstFrameShown() || !PlayersRunning(); }, FirstFrameTimeout);
+		auto Shown = co_await FirstFrame;
+		if (Gen != Generation) co_return;
+		if (Shown && PlayersRunning())
+		{
+			Record("playback.first_frame", Start);
+			RecordPresented(InputNs);
+		}
+	}
+
+	Task PlaybackController::RunStop(uint64_t Gen)
+	{
+		auto Start = Clock::now();
+		StopPlayers();
+		auto Exited = WaitUntil([this]() { return !PlayersRunning(); }, ExitTimeout);
+		co_await Exited;
+		if (Gen != Generation) co_return;
+		Record("playback.stop", Start);
+		VideoPID = -1;
+		AudioPID = -1;
+		State = StateType::Idle;
+		if (OnFinished) OnFinished();
+	}
+#else
+	void PlaybackController::WaitThen(std::function<bool()> Predicate, Clock::duration Timeout, uint64_t Gen, std::function<void(bool)> Then, Clock::duration ProbeInterval)
+	{
+		CancelWait();
+		if (Predicate())
+		{
+			Then(true);
+			return;
+		}
+		WaitPredicate = std::move(Predicate);
+		WaitContinuation = std::move(Then);
+		WaitGeneration = Gen;
+		TimeoutTimer = Loop.AddTimer(Clock::now() + Timeout, [this]()
+		{
+			TimeoutTimer = 0;
+			FinishWait(false);
+		});
+		if (ProbeInterval > Clock::duration::zero())
+		{
+			ProbeTimer = Loop.AddTimer(Clock::now() + ProbeInterval, [this]() { CheckWait(); }, ProbeInterval);
+		}
+	}
+
+	void PlaybackController::CheckWait()
+	{
+		if (WaitPredicate && WaitPredicate()) FinishWait(true);
+	}
+
+	void PlaybackController::FinishWait(bool Result)
+	{
+		if (!WaitContinuation) return;
+		auto Then = std::move(WaitContinuation);
+		auto Gen = WaitGeneration;
+		CancelWait(); // 取消后定时器的回调对象仍然有效，直到它返回
+		if (Gen == Generation) Then(Result);
+	}
+
+	void PlaybackController::CancelWait()
+	{
+		if (TimeoutTimer) Loop.CancelTimer(TimeoutTimer);
+		if (ProbeTimer) Loop.CancelTimer(ProbeTimer);
+		TimeoutTimer = 0;
+		ProbeTimer = 0;
+		WaitPredicate = nullptr;
+		WaitContinuation = nullptr;
+	}
+
+	void PlaybackController::Play(const std::string& VideoFile, int Volume, int StartSec, uint64_t InputNs)
+	{
+		auto Start = Clock::now();
+		auto Gen = ++Generation;
+		State = StateType::Starting;
+
+		// 上一个播放器占着声卡和屏幕，等它退出再开始
+		StopPlayers();
+		WaitThen([this]() { return !PlayersRunning(); }, ExitTimeout, Gen, [this, VideoFile, Volume, StartSec, InputNs, Gen, Start](bool)
+		{
+			Record("playback.stop", Start);
+			VideoPID = -1;
+			AudioPID = -1;
+			PrepareThenLaunch(VideoFile, Volume, StartSec, InputNs, Gen, Start);
+		});
+	}
+
+	void PlaybackController::PrepareThenLaunch(const std::string& VideoFile, int Volume, int StartSec, uint64_t InputNs, uint64_t Gen, Clock::time_point Start)
+	{
+		auto PrepareStart = Clock::now();
+		auto LaunchAndWatch = [this, VideoFile, StartSec, InputNs, Gen, Start, PrepareStart](bool)
+		{
+			Record("playback.prepare", PrepareStart);
+			Launch(VideoFile, StartSec, Start);
+			if (State != StateType::Playing) return;
+			if (!IsFirstFrameShown)
+			{
+				RecordPresented(InputNs);
+				return;
+			}
+			// 画面没有事件通知，只有这一步定时探测
+			WaitThen([this]() { return IsFirstFrameShown() || !PlayersRunning(); }, FirstFrameTimeout, Gen, [this, InputNs, Start](bool Shown)
+			{
+				if (Shown && PlayersRunning())
+				{
+					Record("playback.first_frame", Start);
+					RecordPresented(InputNs);
+				}
+			}, std::chrono::milliseconds(10));
+		};
+
+		// 完成标志由结果和等待的回调共同持有，请求被取代后结果才回来也没有关系。结果回来时推进等待的步骤
+		auto Prepared = std::make_shared<bool>(false);
+		auto Self = this->Self;
+		if (IO.Post([VideoFile, Volume]() { PrepareToPlay(VideoFile, Volume); }, [Prepared, Self]()
+		{
+			*Prepared = true;
+			if (*Self) (*Self)->CheckWait();
+		}))
+		{
+			WaitThen([Prepared]() { return *Prepared; }, PrepareTimeout, Gen, LaunchAndWatch);
+		}
+		else
+		{
+			LaunchAndWatch(true);
+		}
+	}
+
+	void PlaybackController::Stop()
+	{
+		if (State == StateType::Idle) return;
+		auto Start = Clock::now();
+		auto Gen = ++Generation;
+		State = StateType::Stopping;
+		StopPlayers();
+		WaitThen([this]() { return !PlayersRunning(); }, ExitTimeout, Gen, [this, Start](bool)
+		{
+			Record("playback.stop", Start);
+			VideoPID = -1;
+			AudioPID = -1;
+			State = StateType::Idle;
+			if (OnFinished) OnFinished();
+		});
+	}
+#endif
+}
@@ -0,0 +1,99 @@
+﻿#pragma once
+#include "childproc.hpp"
+#include "eventloop.hpp"
+#include "ioworker.hpp"
+#include "latency.hpp"
+#include "task.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace TVOS
+{
+	// 播放器的启动、切换与停止。切换视频时依次：结束正在运行的播放器并等它们退出、设置声卡和预读文件、清屏、
+	// 启动新的播放器、等它画出第一帧，每一步都是协程中的一次 `co_await`，主循环在等待期间照常处理按键和插拔。
+	// 设置声卡和预读文件交给 I/O 线程，界面线程不访问 SD 卡。
+	// 等待中又来了新的请求（例如连按 下一个）时，旧的过程在下一步之前放弃，由新的过程接着做。
+	// 各步骤的耗时记到 `Stats` 中："playback.stop"、"playback.prepare"、"playback.spawn"、"playback.first_frame"。
+	// 编译器不支持协程时（板子上的 GCC 9）同样的步骤写成一串回调，由播放器退出和 I/O 完成的通知推进，等待的内容和记录的耗时都一样。
+	class PlaybackController
+	{
+	public:
+		using Clock = EventLoop::Clock;
+
+	protected:
+		enum class StateType
+		{
+			Idle,
+			Starting, // 正在结束上一个播放器或者启动这一个
+			Playing,
+			Stopping, // 正在等播放器退出，之后回到列表
+		};
+
+		EventLoop& Loop;
+		ChildProcessManager& Children;
+		IOWorker& IO;
+		StateType State = StateType::Idle;
+		pid_t VideoPID = -1;
+		pid_t AudioPID = -1;
+		uint64_t Generation = 0; // 每次请求加一，协程每一步之后检查自己是不是已经被后来的请求取代
+
+		void StopPlayers();
+		bool PlayersRunning() const;
+		void SpawnPlayers(const std::string& VideoFile, int StartSec);
+		void Launch(const std::string& VideoFile, int StartSec, Clock::time_point Start); // 清屏并启动播放器
+		void HandleExit(pid_t Pid);
+		void Record(const char* Step, Clock::time_point Start);
+		void RecordPresented(uint64_t InputNs); // 请求的结果上屏了，InputNs 为 0 时不是按键触发的
+
+#if defined(TVOS_HAS_COROUTINES)
+		TaskScheduler Tasks; // 销毁时取消还在等待的步骤，它们不会再访问这个对象
+		Task RunPlay(std::string VideoFile, int Volume, int StartSec, uint64_t InputNs, uint64_t Gen);
+		Task RunStop(uint64_t Gen);
+#else
+		// 正在等待的步骤，新的请求取代它时取消。播放器退出、I/O 完成时检查条件，定时器只用于超时和探测第一帧。
+		std::function<bool()> WaitPredicate;
+		std::function<void(bool)> WaitContinuation;
+		uint64_t WaitGeneration = 0;
+		EventLoop::TimerID TimeoutTimer = 0;
+		EventLoop::TimerID ProbeTimer = 0;
+		std::shared_ptr<PlaybackController*> Self; // I/O 线程的结果回来时，通过它知道控制器是否还在
+
+		// Predicate 成立或者超过 Timeout 时调用 Then，参数为是否成立。已经成立时立即调用。
+		// 条件由 `CheckWait()` 检查；ProbeInterval 不为 0 时另外每隔这么久检查一次，用于没有事件通知的条件。
+		void WaitThen(std::function<bool()> Predicate, Clock::duration Timeout, uint64_t Gen, std::function<void(bool)> Then, Clock::duration ProbeInterval = Clock::duration::zero());
+		void CheckWait();
+		void FinishWait(bool Result);
+		void CancelWait();
+		void PrepareThenLaunch(const std::string& VideoFile, int Volume, int StartSec, uint64_t InputNs, uint64_t Gen, Clock::time_point Start);
+#endif
+
+	public:
+		PlaybackController(EventLoop& Loop, ChildProcessManager& Children, IOWorker& IO);
+		~PlaybackController();
+		PlaybackController(const PlaybackController&) = delete;
+		PlaybackController& operator = (const PlaybackController&) = delete;
+
+		Clock::duration ExitTimeout = std::chrono::milliseconds(2000); // 等播放器退出的最长时间，超过时不再等
+		Clock::duration PrepareTimeout = std::chrono::milliseconds(5000); // 设置声卡、预读文件最多等多久
+		Clock::duration FirstFrameTimeout = std::chrono::milliseconds(3000);
+
+		std::function<void()> OnClearScreen; // 播放器开始之前清屏，之后回到列表时需要整个重绘
+		std::function<bool()> IsFirstFrameShown; // 播放器是否已经往屏幕上画了东西，没有时不等第一帧
+		std::function<void()> OnFinished; // 播放器都退出了（停止或者播放完），回到列表
+		LatencyRecorder* Stats = nullptr;
+
+		// 停止当前的播放（如果有），从 StartSec 秒开始播放 VideoFile。
+		// InputNs 为触发的按键时间（CLOCK_MONOTONIC），不为 0 时在看到第一帧时调用 `Stats->Presented()`。
+		void Play(const std::string& VideoFile, int Volume, int StartSec, uint64_t InputNs = 0);
+
+		// 停止播放，播放器都退出后调用 `OnFinished`
+		void Stop();
+
+		// 正在开始、播放或者停止，这期间屏幕归播放器使用
+		bool IsActive() const;
+	};
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace TVOS
+{
+	// 有界的单生产者单消费者队列，不加锁。
+	// 只能有一个线程调用 `Push()`，一个线程调用 `Pop()`，两者可以是同一个线程。队列满时 `Push()` 失败，由生产者决定丢弃还是重试。
+	template<typename T, size_t Capacity>
+	class SPSCQueue
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+	protected:
+		std::array<T, Capacity> Slots;
+
+		// 读写位置一直递增，取模得到下标。分开放在不同的缓存行，生产者和消费者不会互相干扰。
+		alignas(64) std::atomic<size_t> Head = 0; // 消费者写
+		alignas(64) std::atomic<size_t> Tail = 0; // 生产者写
+
+	public:
+		SPSCQueue() = default;
+		SPSCQueue(const SPSCQueue&) = delete;
+		SPSCQueue& operator = (const SPSCQueue&) = delete;
+
+		bool Push(const T& Item)
+		{
+			auto t = Tail.load(std::memory_order_relaxed);
+			if (t - Head.load(std::memory_order_acquire) >= Capacity) return false;
+			Slots[t & (Capacity - 1)] = Item;
+			Tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// 队列满时不移动 Item
+		bool Push(T&& Item)
+		{
+			auto t = Tail.load(std::memory_order_relaxed);
+			if (t - Head.load(std::memory_order_acquire) >= Capacity) return false;
+			Slots[t & (Capacity - 1)] = std::move(Item);
+			Tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool Pop(T& Item)
+		{
+			auto h = Head.load(std::memory_order_relaxed);
+			if (h == Tail.load(std::memory_order_acquire)) return false;
+			Item = std::move(Slots[h & (Capacity - 1)]);
+			Head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool IsEmpty() const
+		{
+			return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_acquire);
+		}
+
+		// 另一个线程同时在操作时只是一个近似值
+		size_t GetSize() const
+		{
+			return Tail.load(std::memory_order_acquire) - Head.load(std::memory_order_acquire);
+		}
+
+		static constexpr size_t GetCapacity()
+		{
+			return Capacity;
+		}
+	};
+}
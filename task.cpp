@@ -0,0 +1,172 @@
+﻿#include "task.hpp"
+
+#if defined(TVOS_HAS_COROUTINES)
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace TVOS
+{
+	Task Task::promise_type::get_return_object()
+	{
+		return Task(Handle::from_promise(*this));
+	}
+
+	void Task::promise_type::unhandled_exception()
+	{
+		try
+		{
+			throw;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "[WARN] Task failed: " << e.what() << "\n";
+		}
+		catch (...)
+		{
+			std::cerr << "[WARN] Task failed.\n";
+		}
+	}
+
+	Task::Task(Handle Coroutine) :
+		Coroutine(Coroutine)
+	{
+	}
+
+	Task::Task(Task&& Other) noexcept :
+		Coroutine(Other.Coroutine)
+	{
+		Other.Coroutine = nullptr;
+	}
+
+	Task& Task::operator = (Task&& Other) noexcept
+	{
+		if (this != &Other)
+		{
+			if (Coroutine) Coroutine.destroy();
+			Coroutine = Other.Coroutine;
+			Other.Coroutine = nullptr;
+		}
+		return *this;
+	}
+
+	Task::~Task()
+	{
+		if (Coroutine) Coroutine.destroy();
+	}
+
+	TaskScheduler::TaskScheduler(EventLoop& Loop) :
+		Loop(Loop)
+	{
+	}
+
+	TaskScheduler::~TaskScheduler()
+	{
+		for (auto Coroutine : Tasks) Coroutine.destroy();
+	}
+
+	EventLoop& TaskScheduler::GetLoop()
+	{
+		return Loop;
+	}
+
+	void TaskScheduler::Spawn(Task NewTask)
+	{
+		auto Coroutine = NewTask.Coroutine;
+		if (!Coroutine) return;
+		NewTask.Coroutine = nullptr;
+		Coroutine.promise().Scheduler = this;
+		Tasks.push_back(Coroutine);
+		Resume(Coroutine);
+	}
+
+	void TaskScheduler::Resume(Task::Handle Coroutine)
+	{
+		Coroutine.resume();
+		if (!Coroutine.done()) return;
+		Tasks.erase(std::remove(Tasks.begin(), Tasks.end(), Coroutine), Tasks.end());
+		Coroutine.destroy();
+	}
+
+	size_t TaskScheduler::GetTaskCount() const
+	{
+		return Tasks.size();
+	}
+
+	SleepAwaiter::SleepAwaiter(EventLoop::Clock::duration Duration) :
+		Duration(Duration)
+	{
+	}
+
+	SleepAwaiter::~SleepAwaiter()
+	{
+		// 协程在挂起时被销毁，定时器不能再恢复它
+		if (Timer) Scheduler->GetLoop().CancelTimer(Timer);
+	}
+
+	bool SleepAwaiter::await_ready() const noexcept
+	{
+		return Duration <= EventLoop::Clock::duration::zero();
+	}
+
+	void SleepAwaiter::await_suspend(Task::Handle Coroutine)
+	{
+		Scheduler = Coroutine.promise().Scheduler;
+		Timer = Scheduler->GetLoop().AddTimer(EventLoop::Clock::now() + Duration, [this, Coroutine]()
+		{
+			// 恢复之后这个对象可能已经不在了
+			Timer = 0;
+			Scheduler->Resume(Coroutine);
+		});
+	}
+
+	WaitUntilAwaiter::WaitUntilAwaiter(std::function<bool()> Predicate, EventLoop::Clock::duration Timeout, EventLoop::Clock::duration Interval) :
+		Predicate(std::move(Predicate)),
+		Timeout(Timeout),
+		Interval(Interval)
+	{
+	}
+
+	WaitUntilAwaiter::~WaitUntilAwaiter()
+	{
+		if (Timer) Scheduler->GetLoop().CancelTimer(Timer);
+	}
+
+	bool WaitUntilAwaiter::await_ready()
+	{
+		Result = Predicate();
+		return Result;
+	}
+
+	void WaitUntilAwaiter::await_suspend(Task::Handle Coroutine)
+	{
+		Scheduler = Coroutine.promise().Scheduler;
+		auto& Loop = Scheduler->GetLoop();
+		auto Now = EventLoop::Clock::now();
+		auto Deadline = Now + Timeout;
+		Timer = Loop.AddTimer(Now + Interval, [this, Coroutine, Deadline]()
+		{
+			Result = Predicate();
+			if (!Result && EventLoop::Clock::now() < Deadline) return;
+			Scheduler->GetLoop().CancelTimer(Timer);
+			Timer = 0;
+			Scheduler->Resume(Coroutine);
+		}, Interval);
+	}
+
+	bool WaitUntilAwaiter::await_resume() const noexcept
+	{
+		return Result;
+	}
+
+	SleepAwaiter Sleep(EventLoop::Clock::duration Duration)
+	{
+		return SleepAwaiter(Duration);
+	}
+
+	WaitUntilAwaiter WaitUntil(std::function<bool()> Predicate, EventLoop::Clock::duration Timeout, EventLoop::Clock::duration Interval)
+	{
+		return WaitUntilAwaiter(std::move(Predicate), Timeout, Interval);
+	}
+}
+#endif
@@ -0,0 +1,122 @@
+﻿#pragma once
+#include "eventloop.hpp"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// 编译器支持 C++20 协程时才有 `Task`。板子上的工具链（GCC 9）没有协程，调用者需要准备不等待的做法。
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define TVOS_HAS_COROUTINES 1
+#endif
+#endif
+
+#if defined(TVOS_HAS_COROUTINES)
+#include <coroutine>
+
+namespace TVOS
+{
+	class TaskScheduler;
+
+	// 在主循环中运行的协程。`co_await` 下面的 `Sleep()`、`WaitUntil()` 时挂起，由主循环的定时器恢复，不阻塞线程。
+	// 创建时先不运行，交给 `TaskScheduler::Spawn()` 之后开始，结束后由调度器销毁。
+	// GCC 会把 `co_await` 操作数中的临时对象（例如转换成 std::function 的 lambda）析构两次，
+	// 带捕获的等待对象先存成局部变量再 `co_await`。
+	class Task
+	{
+	public:
+		struct promise_type
+		{
+			TaskScheduler* Scheduler = nullptr;
+
+			Task get_return_object();
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception(); // 打印异常后结束这个协程，不影响主循环
+		};
+		using Handle = std::coroutine_handle<promise_type>;
+
+	protected:
+		Handle Coroutine;
+		friend class TaskScheduler;
+
+	public:
+		explicit Task(Handle Coroutine);
+		Task(Task&& Other) noexcept;
+		Task& operator = (Task&& Other) noexcept;
+		~Task(); // 没有交给调度器的协程直接销毁
+		Task(const Task&) = delete;
+		Task& operator = (const Task&) = delete;
+	};
+
+	// 持有正在运行的协程。析构时销毁还没有结束的协程，它们挂起时注册的定时器随之取消。
+	class TaskScheduler
+	{
+	protected:
+		EventLoop& Loop;
+		std::vector<Task::Handle> Tasks;
+
+	public:
+		TaskScheduler(EventLoop& Loop);
+		~TaskScheduler();
+		TaskScheduler(const TaskScheduler&) = delete;
+		TaskScheduler& operator = (const TaskScheduler&) = delete;
+
+		EventLoop& GetLoop();
+
+		// 立即运行到第一次挂起
+		void Spawn(Task NewTask);
+
+		// 继续运行挂起的协程，结束了就销毁
+		void Resume(Task::Handle Coroutine);
+
+		size_t GetTaskCount() const;
+	};
+
+	// `co_await Sleep(...)`：经过 Duration 后继续
+	class SleepAwaiter
+	{
+	protected:
+		EventLoop::Clock::duration Duration;
+		TaskScheduler* Scheduler = nullptr;
+		EventLoop::TimerID Timer = 0;
+
+	public:
+		SleepAwaiter(EventLoop::Clock::duration Duration);
+		~SleepAwaiter();
+		SleepAwaiter(const SleepAwaiter&) = delete;
+		SleepAwaiter& operator = (const SleepAwaiter&) = delete;
+
+		bool await_ready() const noexcept;
+		void await_suspend(Task::Handle Coroutine);
+		void await_resume() const noexcept {}
+	};
+
+	// `co_await WaitUntil(...)`：每隔 Interval 检查一次 Predicate，成立时返回 true，超过 Timeout 返回 false
+	class WaitUntilAwaiter
+	{
+	protected:
+		std::function<bool()> Predicate;
+		EventLoop::Clock::duration Timeout;
+		EventLoop::Clock::duration Interval;
+		TaskScheduler* Scheduler = nullptr;
+		EventLoop::TimerID Timer = 0;
+		bool Result = false;
+
+	public:
+		WaitUntilAwaiter(std::function<bool()> Predicate, EventLoop::Clock::duration Timeout, EventLoop::Clock::duration Interval);
+		~WaitUntilAwaiter();
+		WaitUntilAwaiter(const WaitUntilAwaiter&) = delete;
+		WaitUntilAwaiter& operator = (const WaitUntilAwaiter&) = delete;
+
+		bool await_ready();
+		void await_suspend(Task::Handle Coroutine);
+		bool await_resume() const noexcept;
+	};
+
+	SleepAwaiter Sleep(EventLoop::Clock::duration Duration);
+	WaitUntilAwaiter WaitUntil(std::function<bool()> Predicate, EventLoop::Clock::duration Timeout, EventLoop::Clock::duration Interval = std::chrono::milliseconds(10));
+}
+#endif
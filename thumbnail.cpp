@@ -0,0 +1,291 @@
+﻿#include "thumbnail.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#if !defined(_MSC_VER)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#else
+#include <Windows.h>
+#define pclose _pclose
+#endif
+
+namespace TVOS
+{
+	// 缓存文件格式：文件头之后是一条条记录，新的记录总是追加在末尾，同一个键以最后一条为准。
+	// 记录：键长度（4 字节）、键、像素数据长度（4 字节，提取失败时为 0）、像素数据（屏幕的像素格式）。
+	static const char CacheMagic[4] = { 'T', 'V', 'T', 'H' };
+	static const uint32_t CacheVersion = 1;
+	static const size_t CacheHeaderSize = 12;
+	static const uint32_t MaxKeyLength = 4096;
+
+	// 像素数据的字节数。`ImageBlock::GetSizeInBytes()` 是整个对象占用的内存，不能用在这里
+	static size_t GetPixelBytes(const ImageBlock& ib)
+	{
+		return ib.Pixels.size() * sizeof ib.Pixels[0];
+	}
+
+	ThumbnailCache::ThumbnailCache(const std::string& MediaDir, int Width, int Height) :
+		ThumbnailCache(MediaDir, Width, Height, ExtractWithFFmpeg)
+	{
+	}
+
+	ThumbnailCache::ThumbnailCache(const std::string& MediaDir, int Width, int Height, ExtractorType Extractor) :
+		MediaDir(MediaDir),
+		CacheFile((std::filesystem::path(MediaDir) / CacheFileName).string()),
+		Width(Width),
+		Height(Height),
+		Extractor(std::move(Extractor)),
+		Worker(&ThumbnailCache::WorkerProc, this)
+	{
+	}
+
+	ThumbnailCache::~ThumbnailCache()
+	{
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Quit = true;
+			Pending.clear();
+		}
+		Wakeup.notify_all();
+		Worker.join();
+	}
+
+	void ThumbnailCache::Request(const std::string& FileName)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			if (std::find(Pending.begin(), Pending.end(), FileName) != Pending.end()) return;
+			Pending.push_back(FileName);
+		}
+		Wakeup.notify_one();
+	}
+
+	void ThumbnailCache::CancelPending()
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Pending.clear();
+	}
+
+	std::vector<std::pair<std::string, std::shared_ptr<ImageBlock>>> ThumbnailCache::TakeCompleted()
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		return std::move(Completed);
+	}
+
+	void ThumbnailCache::WorkerProc()
+	{
+		// 只降低这个线程的优先级，不影响界面
+#if !defined(_MSC_VER)
+		setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), 19);
+#else
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+		LoadIndex();
+
+		while (true)
+		{
+			std::string FileName;
+			{
+				std::unique_lock<std::mutex> Lock(Mutex);
+				Wakeup.wait(Lock, [this]() { return Quit || !Pending.empty(); });
+				if (Quit) return;
+				FileName = std::move(Pending.front());
+				Pending.pop_front();
+			}
+
+			std::shared_ptr<ImageBlock> Thumbnail;
+			auto Key = MakeKey(FileName);
+			auto it = Key.empty() ? Index.end() : Index.find(Key);
+			if (it != Index.end())
+			{
+				if (it->second) Thumbnail = ReadCached(it->second);
+			}
+			else
+			{
+				Thumbnail = Extractor((std::filesystem::path(MediaDir) / FileName).string(), Width, Height);
+				if (Thumbnail && (Thumbnail->w != Width || Thumbnail->h != Height)) Thumbnail = nullptr;
+				if (!Key.empty()) AppendToCache(Key, Thumbnail.get());
+			}
+
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				Completed.emplace_back(std::move(FileName), std::move(Thumbnail));
+			}
+			if (OnCompleted) OnCompleted();
+		}
+	}
+
+	std::string ThumbnailCache::MakeKey(const std::string& FileName) const
+	{
+		std::error_code ec;
+		auto Path = std::filesystem::path(MediaDir) / FileName;
+		auto Size = std::filesystem::file_size(Path, ec);
+		if (ec) return "";
+		auto ModifyTime = std::filesystem::last_write_time(Path, ec);
+		if (ec) return "";
+		return FileName + "|" + std::to_string(Size) + "|" + std::to_string(ModifyTime.time_since_epoch().count());
+	}
+
+	void ThumbnailCache::LoadIndex()
+	{
+		std::ifstream f(CacheFile, std::ios::binary);
+		if (!f) return;
+
+		char Magic[4];
+		uint32_t Version = 0;
+		uint16_t w = 0, h = 0;
+		f.read(Magic, 4);
+		f.read(reinterpret_cast<char*>(&Version), 4);
+		f.read(reinterpret_cast<char*>(&w), 2);
+		f.read(reinterpret_cast<char*>(&h), 2);
+		if (!f || memcmp(Magic, CacheMagic, 4) || Version != CacheVersion || w != Width || h != Height)
+		{ // 格式或缩略图大小不同，整个重建
+			f.close();
+			std::error_code ec;
+			std::filesystem::remove(CacheFile, ec);
+			return;
+		}
+
+		std::error_code ec;
+		uint64_t FileSize = std::filesystem::file_size(CacheFile, ec);
+		if (ec) return;
+		uint64_t GoodSize = CacheHeaderSize;
+		while (true)
+		{
+			uint32_t KeyLength = 0, PixelBytes = 0;
+			if (!f.read(reinterpret_cast<char*>(&KeyLength), 4) || KeyLength > MaxKeyLength) break;
+			std::string Key(KeyLength, '\0');
+			if (!f.read(&Key[0], KeyLength)) break;
+			if (!f.read(reinterpret_cast<char*>(&PixelBytes), 4)) break;
+			if (PixelBytes && PixelBytes != uint32_t(Width) * Height * 4) break;
+			uint64_t Offset = GoodSize + 8 + KeyLength;
+			if (Offset + PixelBytes > FileSize) break;
+			if (PixelBytes) f.seekg(PixelBytes, std::ios::cur);
+			Index[Key] = PixelBytes ? Offset : 0;
+			GoodSize = Offset + PixelBytes;
+		}
+
+		// 最后一条记录不完整（写入时断电或拔卡），截掉它，之后的记录才能接在正确的位置
+		f.close();
+		if (FileSize > GoodSize) std::filesystem::resize_file(CacheFile, GoodSize, ec);
+	}
+
+	std::shared_ptr<ImageBlock> ThumbnailCache::ReadCached(uint64_t Offset) const
+	{
+		std::ifstream f(CacheFile, std::ios::binary);
+		if (!f.seekg(Offset)) return nullptr;
+		auto Thumbnail = std::make_shared<ImageBlock>(Width, Height);
+		if (!f.read(reinterpret_cast<char*>(&Thumbnail->Pixels[0]), GetPixelBytes(*Thumbnail))) return nullptr;
+		return Thumbnail;
+	}
+
+	void ThumbnailCache::AppendToCache(const std::string& Key, const ImageBlock* Thumbnail)
+	{
+		std::error_code ec;
+		bool NewFile = !std::filesystem::exists(CacheFile, ec);
+		std::ofstream f(CacheFile, std::ios::binary | std::ios::app);
+		if (!f) return;
+		if (NewFile)
+		{
+			uint16_t w = uint16_t(Width), h = uint16_t(Height);
+			f.write(CacheMagic, 4);
+			f.write(reinterpret_cast<const char*>(&CacheVersion), 4);
+			f.write(reinterpret_cast<const char*>(&w), 2);
+			f.write(reinterpret_cast<const char*>(&h), 2);
+		}
+		uint64_t Offset = uint64_t(f.tellp());
+
+		uint32_t KeyLength = uint32_t(Key.size());
+		uint32_t PixelBytes = Thumbnail ? uint32_t(GetPixelBytes(*Thumbnail)) : 0;
+		f.write(reinterpret_cast<const char*>(&KeyLength), 4);
+		f.write(Key.data(), KeyLength);
+		f.write(reinterpret_cast<const char*>(&PixelBytes), 4);
+		if (Thumbnail) f.write(reinterpret_cast<const char*>(&Thumbnail->Pixels[0]), PixelBytes);
+		f.flush();
+		if (f) Index[Key] = Thumbnail ? Offset + 8 + KeyLength : 0;
+	}
+
+	std::shared_ptr<ImageBlock> ThumbnailCache::ExtractWithFFmpeg(const std::string& VideoPath, int Width, int Height)
+	{
+		// 缩放到框内并补黑边，直接输出与屏幕相同的 BGRA 像素
+		char Filter[256];
+		snprintf(Filter, sizeof Filter, "scale=%d:%d:force_original_aspect_ratio=decrease,pad=%d:%d:(ow-iw)/2:(oh-ih)/2", Width, Height, Width, Height);
+		auto Thumbnail = std::make_shared<ImageBlock>(Width, Height);
+		auto PixelBytes = GetPixelBytes(*Thumbnail);
+		size_t Bytes = 0;
+
+#if !defined(_MSC_VER)
+		// 文件名来自 SD 卡，作为单独的参数传给 ffmpeg，不经过 shell 解释
+		int pipefd[2];
+		if (pipe2(pipefd, O_CLOEXEC) == -1)
+		{
+			perror("pipe2()");
+			return nullptr;
+		}
+		posix_spawn_file_actions_t Actions;
+		posix_spawn_file_actions_init(&Actions);
+		posix_spawn_file_actions_adddup2(&Actions, pipefd[1], STDOUT_FILENO);
+
+		// 主循环为了用 signalfd 屏蔽了一些信号，子进程恢复默认
+		posix_spawnattr_t Attr;
+		posix_spawnattr_init(&Attr);
+		sigset_t Mask;
+		sigemptyset(&Mask);
+		posix_spawnattr_setsigmask(&Attr, &Mask);
+		sigaddset(&Mask, SIGCHLD);
+		sigaddset(&Mask, SIGUSR1);
+		posix_spawnattr_setsigdefault(&Attr, &Mask);
+		posix_spawnattr_setflags(&Attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+		pid_t Pid = -1;
+		const char* Argv[] = { "nice", "-n", "19", "ffmpeg", "-nostdin", "-v", "quiet", "-i", VideoPath.c_str(), "-an", "-frames:v", "1", "-vf", Filter, "-pix_fmt", "bgra", "-f", "rawvideo", "pipe:1", nullptr };
+		int ret = posix_spawnp(&Pid, "nice", &Actions, &Attr, const_cast<char* const*>(Argv), environ);
+		posix_spawnattr_destroy(&Attr);
+		posix_spawn_file_actions_destroy(&Actions);
+		close(pipefd[1]);
+		if (ret != 0)
+		{
+			close(pipefd[0]);
+			std::cerr << "[WARN] Could not run ffmpeg for `" << VideoPath << "`: " << strerror(ret) << "\n";
+			return nullptr;
+		}
+
+		auto Buffer = reinterpret_cast<char*>(&Thumbnail->Pixels[0]);
+		while (Bytes < PixelBytes)
+		{
+			auto n = read(pipefd[0], Buffer + Bytes, PixelBytes - Bytes);
+			if (n > 0) Bytes += size_t(n);
+			else if (n == 0 || errno != EINTR) break;
+		}
+		close(pipefd[0]);
+		// 只回收自己启动的这个进程，不影响主循环管理的播放器
+		while (waitpid(Pid, nullptr, 0) == -1 && errno == EINTR);
+#else
+		char buf[4096];
+		snprintf(buf, sizeof buf, "ffmpeg -v quiet -i \"%s\" -an -frames:v 1 -vf \"%s\" -pix_fmt bgra -f rawvideo pipe:1", VideoPath.c_str(), Filter);
+		auto fp = _popen(buf, "rb");
+		if (!fp)
+		{
+			std::cerr << "[WARN] Could not run ffmpeg for `" << VideoPath << "`.\n";
+			return nullptr;
+		}
+		Bytes = fread(&Thumbnail->Pixels[0], 1, PixelBytes, fp);
+		pclose(fp);
+#endif
+		if (Bytes != PixelBytes) return nullptr;
+		return Thumbnail;
+	}
+}
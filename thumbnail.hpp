@@ -0,0 +1,73 @@
+﻿#pragma once
+#include "graphics.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace TVOS
+{
+	// 视频缩略图的后台提取与缓存。
+	// 工作线程以最低优先级用 ffmpeg 解出第一帧并缩小，转换成屏幕的像素格式后追加到媒体目录里的缓存文件。
+	// 缓存以 文件名 + 大小 + 修改时间 为键，文件变了自然不再命中。提取失败也会记录下来，不会反复尝试。
+	// 主线程只调用 `Request()` 与 `TakeCompleted()`，都只是在锁内操作队列，不会等待提取。
+	class ThumbnailCache
+	{
+	public:
+		static constexpr const char* CacheFileName = ".tvos_thumbs";
+
+		// 返回缩略图，失败时返回 nullptr。默认调用 ffmpeg，可替换用于测试。
+		using ExtractorType = std::function<std::shared_ptr<ImageBlock>(const std::string& VideoPath, int Width, int Height)>;
+
+	protected:
+		std::string MediaDir;
+		std::string CacheFile;
+		int Width;
+		int Height;
+		ExtractorType Extractor;
+
+		std::mutex Mutex;
+		std::condition_variable Wakeup;
+		std::deque<std::string> Pending;
+		std::vector<std::pair<std::string, std::shared_ptr<ImageBlock>>> Completed;
+		bool Quit = false;
+
+		// 以下只由工作线程访问：缓存文件中每条记录的像素数据的偏移，0 表示提取失败
+		std::unordered_map<std::string, uint64_t> Index;
+		std::thread Worker;
+
+		void WorkerProc();
+		void LoadIndex();
+		std::shared_ptr<ImageBlock> ReadCached(uint64_t Offset) const;
+		void AppendToCache(const std::string& Key, const ImageBlock* Thumbnail);
+		std::string MakeKey(const std::string& FileName) const;
+
+	public:
+		// 缓存文件放在 MediaDir 里。缩略图大小变了的话缓存文件会被重建。
+		ThumbnailCache(const std::string& MediaDir, int Width, int Height);
+		ThumbnailCache(const std::string& MediaDir, int Width, int Height, ExtractorType Extractor);
+		~ThumbnailCache(); // 等待正在进行的提取结束，卸载存储卡前销毁
+		ThumbnailCache(const ThumbnailCache&) = delete;
+		ThumbnailCache& operator = (const ThumbnailCache&) = delete;
+
+		static std::shared_ptr<ImageBlock> ExtractWithFFmpeg(const std::string& VideoPath, int Width, int Height);
+
+		// 请求 MediaDir 中某个文件的缩略图，已在队列中的请求会被忽略
+		void Request(const std::string& FileName);
+		void CancelPending();
+
+		// 取出已完成的缩略图：文件名与图像，提取失败时图像为 nullptr
+		std::vector<std::pair<std::string, std::shared_ptr<ImageBlock>>> TakeCompleted();
+
+		// 有缩略图完成时在工作线程中调用，用于唤醒主循环。需在第一次 `Request()` 之前设置。
+		std::function<void()> OnCompleted;
+	};
+}
@@ -7,101 +7,64 @@ namespace UTF
 	{
 	}
 
+	uint32_t DecodeUtf8(const uint8_t*& Ptr, const uint8_t* End)
+	{
+		uint32_t Lead = *Ptr++;
+		if (Lead < 0x80) return Lead; // 0xxxxxxx
+
+		// 按 RFC 3629 的表格确定序列长度以及第二个字节的合法范围
+		int Length;
+		uint8_t Lower = 0x80, Upper = 0xBF;
+		uint32_t CodePoint;
+		if (Lead >= 0xC2 && Lead <= 0xDF) // 110xxxxx
+		{
+			Length = 2;
+			CodePoint = Lead & 0x1F;
+		}
+		else if (Lead >= 0xE0 && Lead <= 0xEF) // 1110xxxx
+		{
+			Length = 3;
+			CodePoint = Lead & 0x0F;
+			if (Lead == 0xE0) Lower = 0xA0; // 过长编码
+			if (Lead == 0xED) Upper = 0x9F; // 代理区
+		}
+		else if (Lead >= 0xF0 && Lead <= 0xF4) // 11110xxx
+		{
+			Length = 4;
+			CodePoint = Lead & 0x07;
+			if (Lead == 0xF0) Lower = 0x90; // 过长编码
+			if (Lead == 0xF4) Upper = 0x8F; // 超过 U+10FFFF
+		}
+		else
+		{ // 单独的后续字节、0xC0 0xC1 以及已被废弃的 5、6 字节形式
+			return ReplacementCharacter;
+		}
+
+		for (int i = 1; i < Length; i++)
+		{
+			if (Ptr >= End || *Ptr < Lower || *Ptr > Upper)
+			{ // 只跳过已读取的合法前缀，当前字节留给下一个字符
+				return ReplacementCharacter;
+			}
+			CodePoint = (CodePoint << 6) | (*Ptr++ & 0x3F);
+			Lower = 0x80;
+			Upper = 0xBF;
+		}
+		return CodePoint;
+	}
+
 	std::vector<uint32_t> Utf8_to_Utf32(const std::string& Utf8s)
 	{
-		size_t i = 0;
 		std::vector<uint32_t> ret;
-		while(i < Utf8s.length())
+		ret.reserve(Utf8s.size());
+		auto Ptr = reinterpret_cast<const uint8_t*>(Utf8s.data());
+		auto End = Ptr + Utf8s.size();
+		while (Ptr < End)
 		{
-			if((Utf8s[i] & 0xFE) == 0xFC)//1111110x
-			{
-				if(i + 6 <= Utf8s.size())
-				{
-					ret.push_back
-					(
-						((uint32_t(Utf8s[i + 0]) & 0x01) << 30)|
-						((uint32_t(Utf8s[i + 1]) & 0x3F) << 24)|
-						((uint32_t(Utf8s[i + 2]) & 0x3F) << 18)|
-						((uint32_t(Utf8s[i + 3]) & 0x3F) << 12)|
-						((uint32_t(Utf8s[i + 4]) & 0x3F) << 6)|
-						((uint32_t(Utf8s[i + 5]) & 0x3F) << 0)
-					);
-					i += 6;
-				}
-				else
-					throw UtfConversionError(std::string("Need more bytes for decoding an UTF-8 string."));
-			}
-			else if((Utf8s[i] & 0xFC) == 0xF8)//111110xx
-			{
-				if(i + 5 <= Utf8s.size())
-				{
-					ret.push_back
-					(
-						((uint32_t(Utf8s[i + 0]) & 0x03) << 24)|
-						((uint32_t(Utf8s[i + 1]) & 0x3F) << 18)|
-						((uint32_t(Utf8s[i + 2]) & 0x3F) << 12)|
-						((uint32_t(Utf8s[i + 3]) & 0x3F) << 6)|
-						((uint32_t(Utf8s[i + 4]) & 0x3F) << 0)
-					);
-					i += 5;
-				}
-				else
-					throw UtfConversionError(std::string("Need more bytes for decoding an UTF-8 string."));
-			}
-			else if((Utf8s[i] & 0xF8) == 0xF0)//11110xxx
-			{
-				if(i + 4 <= Utf8s.size())
-				{
-					ret.push_back
-					(
-						((uint32_t(Utf8s[i + 0]) & 0x07) << 18)|
-						((uint32_t(Utf8s[i + 1]) & 0x3F) << 12)|
-						((uint32_t(Utf8s[i + 2]) & 0x3F) << 6)|
-						((uint32_t(Utf8s[i + 3]) & 0x3F) << 0)
-					);
-					i += 4;
-				}
-				else
-					throw UtfConversionError(std::string("Need more bytes for decoding an UTF-8 string."));
-			}
-			else if((Utf8s[i] & 0xF0) == 0xE0)//1110xxxx
-			{
-				if(i + 3 <= Utf8s.size())
-				{
-					ret.push_back
-					(
-						((uint32_t(Utf8s[i + 0]) & 0x0F) << 12)|
-						((uint32_t(Utf8s[i + 1]) & 0x3F) << 6)|
-						((uint32_t(Utf8s[i + 2]) & 0x3F) << 0)
-					);
-					i += 3;
-				}
-				else
-					throw UtfConversionError(std::string("Need more bytes for decoding an UTF-8 string."));
-			}
-			else if((Utf8s[i] & 0xE0) == 0xC0)//110xxxxx
-			{
-				if(i + 2 <= Utf8s.size())
-				{
-					ret.push_back
-					(
-						((uint32_t(Utf8s[i + 0]) & 0x1F) << 6)|
-						((uint32_t(Utf8s[i + 1]) & 0x3F) << 0)
-					);
-					i += 2;
-				}
-				else
-					throw UtfConversionError(std::string("Need more bytes for decoding an UTF-8 string."));
-			}
-			else if((Utf8s[i] & 0xC0) == 0x80)//10xxxxxx
-			{
-				throw UtfConversionError(std::string("Invalid start byte for UTF-8 string: ") + std::to_string(Utf8s[i]));
-			}
-			else if((Utf8s[i] & 0x80) == 0x00)//0xxxxxxx
-			{
-				ret.push_back(Utf8s[i] & 0x7F);
-				i++;
-			}
+			auto AsciiRun = CountAsciiRun(Ptr, End);
+			ret.insert(ret.end(), Ptr, Ptr + AsciiRun);
+			Ptr += AsciiRun;
+			if (Ptr < End) ret.push_back(DecodeUtf8(Ptr, End));
 		}
 		return ret;
 	}
@@ -109,53 +72,31 @@ namespace UTF
 	std::string Utf32_to_Utf8(const std::vector<uint32_t>& Utf32s)
 	{
 		std::string ret;
-		size_t i = 0;
-		while(i < Utf32s.size())
+		ret.reserve(Utf32s.size());
+		for (auto ch : Utf32s)
 		{
-			if(Utf32s[i] >= 0x4000000)
-			{
-				ret.push_back(char(0xFC | ((Utf32s[i] >> 30) & 0x01)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 24) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 18) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 12) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 6) & 0x3F)));
-				ret.push_back(char(0x80 | (Utf32s[i] & 0x3F)));
-				i += 6;
-			}
-			else if(Utf32s[i] >= 0x200000)
-			{
-				ret.push_back(char(0xF8 | ((Utf32s[i] >> 24) & 0x03)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 18) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 12) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 6) & 0x3F)));
-				ret.push_back(char(0x80 | (Utf32s[i] & 0x3F)));
-				i += 5;
-			}
-			else if(Utf32s[i] >= 0x10000)
+			if (ch > 0x10FFFF || (ch >= 0xD800 && ch <= 0xDFFF)) ch = ReplacementCharacter;
+			if (ch >= 0x10000)
 			{
-				ret.push_back(char(0xF0 | ((Utf32s[i] >> 18) & 0x07)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 12) & 0x3F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 6) & 0x3F)));
-				ret.push_back(char(0x80 | (Utf32s[i] & 0x3F)));
-				i += 4;
+				ret.push_back(char(0xF0 | ((ch >> 18) & 0x07)));
+				ret.push_back(char(0x80 | ((ch >> 12) & 0x3F)));
+				ret.push_back(char(0x80 | ((ch >> 6) & 0x3F)));
+				ret.push_back(char(0x80 | (ch & 0x3F)));
 			}
-			else if(Utf32s[i] >= 0x0800)
+			else if (ch >= 0x0800)
 			{
-				ret.push_back(char(0xE0 | ((Utf32s[i] >> 12) & 0x0F)));
-				ret.push_back(char(0x80 | ((Utf32s[i] >> 6) & 0x3F)));
-				ret.push_back(char(0x80 | (Utf32s[i] & 0x3F)));
-				i += 3;
+				ret.push_back(char(0xE0 | ((ch >> 12) & 0x0F)));
+				ret.push_back(char(0x80 | ((ch >> 6) & 0x3F)));
+				ret.push_back(char(0x80 | (ch & 0x3F)));
 			}
-			else if(Utf32s[i] >= 0x0080)
+			else if (ch >= 0x0080)
 			{
-				ret.push_back(char(0xC0 | ((Utf32s[i] >> 6) & 0x1F)));
-				ret.push_back(char(0x80 | (Utf32s[i] & 0x3F)));
-				i += 2;
+				ret.push_back(char(0xC0 | ((ch >> 6) & 0x1F)));
+				ret.push_back(char(0x80 | (ch & 0x3F)));
 			}
 			else
 			{
-				ret.push_back(char(Utf32s[i]));
-				i++;
+				ret.push_back(char(ch));
 			}
 		}
 		return ret;
@@ -4,6 +4,8 @@
 #include <vector>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <stdexcept>
 
 namespace UTF
@@ -14,7 +16,94 @@ namespace UTF
 		UtfConversionError(const std::string& what) noexcept;
 	};
 
+	constexpr uint32_t ReplacementCharacter = 0xFFFD;
+
+	// 按 RFC 3629 解码一个字符并前移 `Ptr`。不合法的字节序列（过长编码、代理区、超过 U+10FFFF、被截断的序列等）
+	// 按其最长的合法前缀解码为一个 U+FFFD，不抛出异常。调用前必须保证 `Ptr < End`。
+	uint32_t DecodeUtf8(const uint8_t*& Ptr, const uint8_t* End);
+
+	// 返回从 `Ptr` 开始连续的 ASCII 字节数，每次检查 8 个字节
+	inline size_t CountAsciiRun(const uint8_t* Ptr, const uint8_t* End)
+	{
+		auto Start = Ptr;
+		while (End - Ptr >= 8)
+		{
+			uint64_t Word;
+			memcpy(&Word, Ptr, 8);
+			if (Word & 0x8080808080808080ull) break;
+			Ptr += 8;
+		}
+		while (Ptr < End && *Ptr < 0x80) Ptr++;
+		return size_t(Ptr - Start);
+	}
+
+	// 不分配内存的 UTF-8 解码区间，用法：`for (auto ch : UTF::Utf8Decoder(s))`
+	// 被解码的字符串在遍历期间必须保持有效。
+	class Utf8Decoder
+	{
+	protected:
+		const uint8_t* Begin;
+		const uint8_t* End;
+
+	public:
+		class Iterator
+		{
+		protected:
+			const uint8_t* Cur = nullptr;
+			const uint8_t* Next = nullptr;
+			const uint8_t* End = nullptr;
+			const uint8_t* AsciiEnd = nullptr; // 在此之前的字节都已确认是 ASCII
+			uint32_t CodePoint = 0;
+
+			void Decode()
+			{
+				if (Cur >= End) { Next = End; return; }
+				if (Cur < AsciiEnd || *Cur < 0x80)
+				{
+					if (Cur >= AsciiEnd) AsciiEnd = Cur + CountAsciiRun(Cur, End);
+					CodePoint = *Cur;
+					Next = Cur + 1;
+					return;
+				}
+				Next = Cur;
+				CodePoint = DecodeUtf8(Next, End);
+			}
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = uint32_t;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const uint32_t*;
+			using reference = uint32_t;
+
+			Iterator() = default;
+			Iterator(const uint8_t* Cur, const uint8_t* End) : Cur(Cur), End(End), AsciiEnd(Cur) { Decode(); }
+
+			uint32_t operator * () const { return CodePoint; }
+			Iterator& operator ++ () { Cur = Next; Decode(); return *this; }
+			Iterator operator ++ (int) { auto ret = *this; ++*this; return ret; }
+			bool operator == (const Iterator& other) const { return Cur == other.Cur; }
+			bool operator != (const Iterator& other) const { return Cur != other.Cur; }
+
+			// 当前字符在原字符串中的位置
+			const uint8_t* GetPosition() const { return Cur; }
+		};
+
+		Utf8Decoder(const char* Utf8s, size_t Length) :
+			Begin(reinterpret_cast<const uint8_t*>(Utf8s)),
+			End(reinterpret_cast<const uint8_t*>(Utf8s) + Length)
+		{
+		}
+
+		Utf8Decoder(const std::string& Utf8s) :
+			Utf8Decoder(Utf8s.data(), Utf8s.size())
+		{
+		}
+
+		Iterator begin() const { return Iterator(Begin, End); }
+		Iterator end() const { return Iterator(End, End); }
+	};
+
 	std::vector<uint32_t> Utf8_to_Utf32(const std::string& Utf8s);
 	std::string Utf32_to_Utf8(const std::vector<uint32_t>& Utf32s);
 }
-